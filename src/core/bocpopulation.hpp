@@ -0,0 +1,265 @@
+#ifndef KGD_BOC_POPULATION_HPP
+#define KGD_BOC_POPULATION_HPP
+
+#include <new>
+#include <vector>
+
+#include "crossover.h"
+
+/*!
+ * \file bocpopulation.hpp
+ *
+ * Definition of a packed (structure of arrays) container for the crossover
+ * data of a whole population
+ */
+
+namespace genotype {
+
+namespace _details {
+
+/// Allocator returning memory aligned on \p A bytes (e.g. a cache line or the
+/// widest SIMD register)
+template <typename T, size_t A = 64>
+struct AlignedAllocator {
+  using value_type = T; ///< Type of the allocated objects
+
+  /// Rebinding structure required by the standard containers
+  template <typename U> struct rebind { using other = AlignedAllocator<U, A>; };
+
+  AlignedAllocator (void) = default;
+
+  /// Conversion from another allocator type
+  template <typename U>
+  AlignedAllocator (const AlignedAllocator<U, A>&) {}
+
+  /// \returns uninitialized aligned storage for \p n objects
+  T* allocate (size_t n) {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(A)));
+  }
+
+  /// Frees storage obtained through allocate()
+  void deallocate (T *p, size_t) {
+    ::operator delete(p, std::align_val_t(A));
+  }
+
+  /// Allocators are stateless and thus always equal
+  friend bool operator== (const AlignedAllocator&, const AlignedAllocator&) {
+    return true;
+  }
+
+  /// Allocators are stateless and thus never different
+  friend bool operator!= (const AlignedAllocator&, const AlignedAllocator&) {
+    return false;
+  }
+};
+
+/// Helper alias to a vector with aligned storage
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+} // end of namespace _details
+
+/// Structure of arrays holding the four BOCData fields of a population.
+///
+/// Population-wide passes (compatibility sweeps, clamping) run over contiguous
+/// aligned arrays with branch-free bodies.
+class BOCPopulation {
+public:
+  /// Helper alias to the source of randomness
+  using Dice = rng::AbstractDice;
+
+  /// Helper alias to the sex enumeration
+  using Sex = BOCData::Sex;
+
+  /// Helper alias to the float arrays
+  using Floats = _details::AlignedVector<float>;
+
+  /// \returns the number of individuals
+  size_t size (void) const {
+    return _optimalDistance.size();
+  }
+
+  /// Remove all contents
+  void clear (void) {
+    _optimalDistance.clear();
+    _inbreedTolerance.clear();
+    _outbreedTolerance.clear();
+    _sex.clear();
+  }
+
+  /// Prepare exactly \p n units of storage space
+  void reserve (size_t n) {
+    _optimalDistance.reserve(n);
+    _inbreedTolerance.reserve(n);
+    _outbreedTolerance.reserve(n);
+    _sex.reserve(n);
+  }
+
+  /// Append the fields of \p d
+  void push_back (const BOCData &d) {
+    _optimalDistance.push_back(d.optimalDistance);
+    _inbreedTolerance.push_back(d.inbreedTolerance);
+    _outbreedTolerance.push_back(d.outbreedTolerance);
+    _sex.push_back(d.sex);
+  }
+
+  /// \returns a copy of the \p i-th individual's crossover data
+  BOCData at (uint i) const {
+    BOCData d;
+    get(i, d);
+    return d;
+  }
+
+  /// Copies the fields of the \p i-th individual into \p d
+  void get (uint i, BOCData &d) const {
+    d.optimalDistance = _optimalDistance[i];
+    d.inbreedTolerance = _inbreedTolerance[i];
+    d.outbreedTolerance = _outbreedTolerance[i];
+    d.sex = _sex[i];
+  }
+
+  /// Overwrites the fields of the \p i-th individual with those of \p d
+  void set (uint i, const BOCData &d) {
+    _optimalDistance[i] = d.optimalDistance;
+    _inbreedTolerance[i] = d.inbreedTolerance;
+    _outbreedTolerance[i] = d.outbreedTolerance;
+    _sex[i] = d.sex;
+  }
+
+  /// \returns the sex of the \p i-th individual
+  Sex sex (uint i) const { return _sex[i]; }
+
+  /// \returns the optimal distances array
+  const Floats& optimalDistances (void) const { return _optimalDistance; }
+
+  /// \returns the inbreed tolerances array
+  const Floats& inbreedTolerances (void) const { return _inbreedTolerance; }
+
+  /// \returns the outbreed tolerances array
+  const Floats& outbreedTolerances (void) const { return _outbreedTolerance; }
+
+  // ==========================================================================
+  // == Gather/scatter
+
+  /// Replaces the contents with the crossover data of the genomes in
+  /// [\p begin, \p end[
+  ///
+  /// \tparam IT Iterator to the begin/end of the population
+  /// \tparam F Functor for extracting a genome reference from an iterator
+  template <typename IT, typename F>
+  void gather (IT begin, IT end, F genomeExtractor) {
+    clear();
+    for (IT it = begin; it != end; ++it) {
+      const auto &g = genomeExtractor(*it);
+      using G = std::decay_t<decltype(g)>;
+      push_back(BOCDataAccessor<G>::get(g));
+    }
+  }
+
+  /// \overload
+  template <typename GENOME>
+  void gather (const std::vector<GENOME> &population) {
+    reserve(population.size());
+    gather(population.begin(), population.end(),
+           [] (const GENOME &g) -> const GENOME& { return g; });
+  }
+
+  /// Writes back the crossover data into the genomes in [\p begin, \p end[
+  ///
+  /// \attention The range must have the same size (and order) as the one used
+  /// in gather()
+  ///
+  /// \tparam IT Iterator to the begin/end of the population
+  /// \tparam F Functor for extracting a (mutable) genome reference from an
+  /// iterator
+  template <typename IT, typename F>
+  void scatter (IT begin, IT end, F genomeExtractor) const {
+    uint i = 0;
+    for (IT it = begin; it != end; ++it, ++i) {
+      assert(i < size());
+      auto &g = genomeExtractor(*it);
+      using G = std::decay_t<decltype(g)>;
+      get(i, BOCDataAccessor<G>::get(g));
+    }
+    assert(i == size());
+  }
+
+  /// \overload
+  template <typename GENOME>
+  void scatter (std::vector<GENOME> &population) const {
+    scatter(population.begin(), population.end(),
+            [] (GENOME &g) -> GENOME& { return g; });
+  }
+
+  // ==========================================================================
+  // == Kernels
+
+  /// Evaluates, for each individual \c i, its compatibility at
+  /// \p distances[i] into \p compatibilities[i]
+  ///
+  /// Same values as BOCData::operator()(const float*, float*, size_t) const
+  /// (see BOCData::batchGaussoid)
+  void compatibilities (const float *distances, float *compatibilities) const {
+    const float *mu = _optimalDistance.data(),
+                *si = _inbreedTolerance.data(),
+                *so = _outbreedTolerance.data();
+    const size_t n = size();
+    for (size_t i=0; i<n; i++)
+      compatibilities[i] = BOCData::batchGaussoid(distances[i] - mu[i],
+                                                  1. / si[i], 1. / so[i]);
+  }
+
+  /// \overload
+  void compatibilities (const std::vector<float> &distances,
+                        std::vector<float> &compatibilities) const {
+    assert(distances.size() == size());
+    compatibilities.resize(size());
+    this->compatibilities(distances.data(), compatibilities.data());
+  }
+
+  /// Mutates the \p i-th individual (a single field picked according to the
+  /// mutation rates, see BOCKernels::mutate)
+  void mutate (uint i, Dice &dice) {
+    BOCKernels::mutate(_optimalDistance[i], _inbreedTolerance[i],
+                       _outbreedTolerance[i], _sex[i], dice);
+  }
+
+  /// Mutates each individual with probability \p p
+  void mutate (float p, Dice &dice) {
+    for (uint i=0; i<size(); i++)
+      if (dice(p))  mutate(i, dice);
+  }
+
+  /// Restricts every floating point field to its mutation bounds
+  void clamp (void) {
+    using Config = config::EDNAConfigFile<BOCData>;
+    clamp(_optimalDistance, Config::optimalDistanceBounds());
+    clamp(_inbreedTolerance, Config::inbreedToleranceBounds());
+    clamp(_outbreedTolerance, Config::outbreedToleranceBounds());
+  }
+
+private:
+  /// \see BOCData::optimalDistance
+  Floats _optimalDistance;
+
+  /// \see BOCData::inbreedTolerance
+  Floats _inbreedTolerance;
+
+  /// \see BOCData::outbreedTolerance
+  Floats _outbreedTolerance;
+
+  /// \see BOCData::sex
+  std::vector<Sex> _sex;
+
+  /// Branch-free clamping of \p values into [\p bounds.min, \p bounds.max]
+  static void clamp (Floats &values, const config::Bounds<float> &bounds) {
+    const float min = bounds.min, max = bounds.max;
+    float *v = values.data();
+    for (size_t i=0, n=values.size(); i<n; i++)
+      v[i] = std::min(std::max(v[i], min), max);
+  }
+};
+
+} // end of namespace genotype
+
+#endif // KGD_BOC_POPULATION_HPP
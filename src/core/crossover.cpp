@@ -1,3 +1,8 @@
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
 #include "crossover.h"
 
 #define GENOME BOCData
@@ -50,3 +55,145 @@ DEFINE_GENOME_DISTANCE_WEIGHTS({
 DEFINE_PARAMETER(float, mutateChild, .5)
 
 #undef CFILE
+
+// ============================================================================
+// == Specialized kernels
+
+namespace genotype {
+
+namespace {
+
+using Config = config::EDNAConfigFile<BOCData>;
+
+/// Snapshot of the configuration data used by the kernels. Fields are stored
+/// in the (alphabetical) order used by the generic EDNA iteration
+struct KernelsCache {
+  enum Field { INBREED, OPTIMAL, OUTBREED, SEX, FIELDS };
+
+  Config::Bf inbreedBounds, optimalBounds, outbreedBounds;
+  config::Bounds<BOCData::Sex> sexBounds;
+  float weights [FIELDS];
+  float rates [FIELDS];
+  float ratesSum;
+
+  /// Printed values of all the above (identifies a configuration)
+  std::string key;
+
+  /// \returns a snapshot of the current configuration values
+  static KernelsCache current (void) {
+    KernelsCache c;
+    c.inbreedBounds = Config::inbreedToleranceBounds();
+    c.optimalBounds = Config::optimalDistanceBounds();
+    c.outbreedBounds = Config::outbreedToleranceBounds();
+    c.sexBounds = Config::sexBounds();
+
+    static const char* names [FIELDS] = {
+      "inbreedTolerance", "optimalDistance", "outbreedTolerance", "sex"
+    };
+    const auto &dw = Config::distanceWeights();
+    const auto &mr = Config::mutationRates();
+    c.ratesSum = 0;
+    for (uint i=0; i<FIELDS; i++) {
+      c.weights[i] = dw.at(names[i]);
+      c.rates[i] = mr.at(names[i]);
+      c.ratesSum += c.rates[i];
+    }
+
+    std::ostringstream oss;
+    oss.precision(std::numeric_limits<float>::max_digits10);
+    oss << c.inbreedBounds << ";" << c.optimalBounds << ";"
+        << c.outbreedBounds << ";" << c.sexBounds;
+    for (uint i=0; i<FIELDS; i++) oss << ";" << c.weights[i] << ";" << c.rates[i];
+    c.key = oss.str();
+
+    return c;
+  }
+};
+
+/// All the configurations seen so far, by key. Snapshots are never deleted so
+/// that kernels running concurrently with a reload keep a valid one
+std::map<std::string, std::unique_ptr<const KernelsCache>> snapshots;
+
+/// Protects snapshots
+std::mutex snapshotsMutex;
+
+/// The snapshot in use
+std::atomic<const KernelsCache*> active (nullptr);
+
+/// Makes the snapshot matching the current configuration the active one
+void reload (void) {
+  KernelsCache c = KernelsCache::current();
+
+  std::lock_guard<std::mutex> lock (snapshotsMutex);
+  auto &ptr = snapshots[c.key];
+  if (!ptr) ptr.reset(new KernelsCache(std::move(c)));
+  active.store(ptr.get(), std::memory_order_release);
+}
+
+const KernelsCache& cache (void) {
+  static std::once_flag loaded;
+  std::call_once(loaded, reload);
+
+  const KernelsCache *c = active.load(std::memory_order_acquire);
+  assert(c->key == KernelsCache::current().key);  // Missing reloadConfig() ?
+  return *c;
+}
+
+} // end of anonymous namespace
+
+double BOCKernels::distance (const BOCData &lhs, const BOCData &rhs) {
+  using F = KernelsCache;
+  const KernelsCache &c = cache();
+  double d = 0;
+  d += c.weights[F::INBREED]
+     * c.inbreedBounds.distance(lhs.inbreedTolerance, rhs.inbreedTolerance);
+  d += c.weights[F::OPTIMAL]
+     * c.optimalBounds.distance(lhs.optimalDistance, rhs.optimalDistance);
+  d += c.weights[F::OUTBREED]
+     * c.outbreedBounds.distance(lhs.outbreedTolerance, rhs.outbreedTolerance);
+  d += c.weights[F::SEX] * c.sexBounds.distance(lhs.sex, rhs.sex);
+  return d;
+}
+
+void BOCKernels::mutate (BOCData &d, rng::AbstractDice &dice) {
+  mutate(d.optimalDistance, d.inbreedTolerance, d.outbreedTolerance, d.sex,
+         dice);
+}
+
+void BOCKernels::mutate (float &optimalDistance, float &inbreedTolerance,
+                         float &outbreedTolerance, BOCData::Sex &sex,
+                         rng::AbstractDice &dice) {
+  using F = KernelsCache;
+  const KernelsCache &c = cache();
+  if (c.ratesSum <= 0)  return;
+
+  float r = dice(0.f, c.ratesSum);
+  if ((r -= c.rates[F::INBREED]) < 0)
+    c.inbreedBounds.mutate(inbreedTolerance, dice);
+  else if ((r -= c.rates[F::OPTIMAL]) < 0)
+    c.optimalBounds.mutate(optimalDistance, dice);
+  else if ((r -= c.rates[F::OUTBREED]) < 0)
+    c.outbreedBounds.mutate(outbreedTolerance, dice);
+  else
+    c.sexBounds.mutate(sex, dice);
+}
+
+BOCData BOCKernels::cross (const BOCData &lhs, const BOCData &rhs,
+                           rng::AbstractDice &dice) {
+  BOCData child;
+  child.inbreedTolerance = dice.toss(lhs.inbreedTolerance, rhs.inbreedTolerance);
+  child.optimalDistance = dice.toss(lhs.optimalDistance, rhs.optimalDistance);
+  child.outbreedTolerance = dice.toss(lhs.outbreedTolerance, rhs.outbreedTolerance);
+  child.sex = dice.toss(lhs.sex, rhs.sex);
+  return child;
+}
+
+void BOCKernels::reloadConfig (void) {
+  reload();
+}
+
+void BOCData::mutate (Dice &dice) {
+  BOCKernels::mutate(*this, dice);
+}
+
+} // end of namespace genotype
@@ -1,7 +1,11 @@
 #ifndef KGD_CROSSOVER_HPP
 #define KGD_CROSSOVER_HPP
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
 #include <functional>
 #include <atomic>
 
@@ -21,22 +25,112 @@
 
 namespace genotype {
 
+namespace _details {
+
+/// Branch-free approximation of \f$ e^x \f$ for \f$ x \leq 0 \f$
+///
+/// Range reduction to \f$ 2^k e^r \f$ with \f$ |r| \leq \ln(2)/2 \f$ and a
+/// degree 6 polynomial for \f$ e^r \f$. Maximum absolute error is below
+/// 1.2e-7 (relative: 1.7e-7) over \f$ ]-\infty,0] \f$.
+/// Inputs below -708 (including \f$ -\infty \f$) are clamped
+/// (result < 3.3e-308).
+///
+/// Clamping is a min/max operation (no branch) so that loops calling this
+/// function can be vectorized.
+inline double fastExp (double x) {
+  static constexpr double LOG2E = 1.4426950408889634074;
+  static constexpr double LN2 = 0.69314718055994530942;
+  static constexpr double ROUND = 6755399441055744.; // 1.5 * 2^52
+
+  x = std::max(x, -708.);
+  double kr = x * LOG2E + ROUND;  // Integer part now in the low mantissa bits
+  double k = kr - ROUND;
+  double r = x - k * LN2;
+  double p = 1 + r * (1 + r * (1./2 + r * (1./6 + r * (1./24
+               + r * (1./120 + r * (1./720))))));
+
+  uint64_t bits;
+  std::memcpy(&bits, &kr, sizeof(bits));
+  bits = (bits + 1023) << 52;
+  double s;
+  std::memcpy(&s, &bits, sizeof(s));
+  return p * s;
+}
+
+/// Approximation of \f$ ln(x) \f$ for \f$ x > 0 \f$ (normal numbers only)
+///
+/// Splits \p x into \f$ m.2^e \f$ with \f$ m \in [\sqrt{.5},\sqrt{2}[ \f$ and
+/// uses the atanh series \f$ ln(m) = 2(s + s^3/3 + ... + s^9/9) \f$ with
+/// \f$ s = (m-1)/(m+1) \f$. Maximum relative error is below 2.1e-9.
+inline double fastLog (double x) {
+  static constexpr double LN2 = 0.69314718055994530942;
+  static constexpr double SQRT2 = 1.41421356237309504880;
+
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  int e = int((bits >> 52) & 0x7FF) - 1023;
+  bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+  double m;
+  std::memcpy(&m, &bits, sizeof(m));
+  if (m >= SQRT2) m *= .5, e++;
+
+  double s = (m - 1) / (m + 1), s2 = s * s;
+  return 2 * s * (1 + s2 * (1./3 + s2 * (1./5 + s2 * (1./7 + s2 * (1./9)))))
+       + e * LN2;
+}
+
+} // end of namespace _details
+
+struct BOCKernels;
+class BOCPopulation;
+
 /// Common crossover control data
+///
+/// When compiled with FAST_GAUSSOID, the compatibility function (and its
+/// inverse) use the polynomial approximations _details::fastExp and
+/// _details::fastLog instead of the standard library. Compatibilities are then
+/// within 1.2e-7 of the exact value.
 class BOCData : public EDNA<BOCData> {
   APT_EDNA()
 
+  friend struct BOCKernels;
+  friend class BOCPopulation;
+
   // ========================================================================
   // == Compatibility function
 
   /// The compatibility function. Two halves of an unnormalized gaussian.
   static double gaussoid (double d, double mu, double sigma) {
+#ifdef FAST_GAUSSOID
+    double x = (d == mu) ? 0 : (d - mu) / sigma;  // Even if sigma is null
+    return _details::fastExp(-.5 * x * x);
+#else
     return utils::gauss(d, mu, sigma);
+#endif
   }
 
   /// The inverse compatibility function. Returns the distances for this
   ///  compatibility value
   static double gaussoid_inverse (double c, double mu, double sigma, int sign) {
+#ifdef FAST_GAUSSOID
+    if (c <= 0) return sign < 0 ? 0 : std::numeric_limits<double>::infinity();
+    return std::max(0., mu + sign * sigma * std::sqrt(-2 * _details::fastLog(c)));
+#else
     return std::max(0., utils::gauss_inverse(c, mu, sigma, sign));
+#endif
+  }
+
+  /// The compatibility function, as used by the batch evaluations, at offset
+  /// \p x from the optimal distance with \p ri (resp. \p ro) the inverse of
+  /// the inbreed (resp. outbreed) tolerance. Infinite inverses (null
+  /// tolerances) are valid.
+  static double batchGaussoid (double x, double ri, double ro) {
+    double y = (x == 0) ? 0. : x * (x < 0 ? ri : ro);
+#ifdef FAST_GAUSSOID
+    return _details::fastExp(-.5 * y * y);
+#else
+    return std::exp(-.5 * y * y);
+#endif
   }
 
   /// Genetic distance that maximises reproduction compatibility
@@ -61,6 +155,10 @@ public:
   // ========================================================================
   // == Member functions
 
+  /// Mutates a single field through BOCKernels::mutate (hides the generic
+  /// EDNA version, still reachable as EDNA<BOCData>::mutate)
+  void mutate (Dice &dice);
+
   /// \return the optimal genetic distance
   /// \see optimalDistance
   float getOptimalDistance (void) const { return optimalDistance; }
@@ -104,6 +202,31 @@ public:
     d_inbreed = gaussoid_inverse(compat, optimalDistance, inbreedTolerance, -1);
     d_outbreed = gaussoid_inverse(compat, optimalDistance, outbreedTolerance, 1);
   }
+
+  /// Evaluates the compatibility for \p n \p distances at once
+  ///
+  /// Same values as operator()(double) const, with the same approximation if
+  /// compiled with FAST_GAUSSOID, but with a loop body (selections only) that
+  /// the compiler can vectorize.
+  ///
+  /// \param distances the genetic distances to evaluate
+  /// \param compatibilities the corresponding compatibilities (output)
+  /// \param n the number of values
+  void operator() (const float *distances, float *compatibilities, size_t n) const {
+    const double mu = optimalDistance;
+    const double ri = 1. / inbreedTolerance,  // Infinite for a null tolerance
+                 ro = 1. / outbreedTolerance;
+    for (size_t i=0; i<n; i++)
+      compatibilities[i] = batchGaussoid(distances[i] - mu, ri, ro);
+  }
+
+  /// Evaluates the compatibility for all \p distances (e.g. a DCCache worth)
+  /// \see operator()(const float*, float*, size_t) const
+  void operator() (const std::vector<float> &distances,
+                   std::vector<float> &compatibilities) const {
+    compatibilities.resize(distances.size());
+    operator()(distances.data(), compatibilities.data(), distances.size());
+  }
 };
 
 DECLARE_GENOME_FIELD(BOCData, float, optimalDistance)
@@ -183,6 +306,57 @@ struct MutationSettings::BoundsOperators<genotype::BOCData::Sex, void> {
 
 namespace genotype {
 
+/// Straight-line implementations of the EDNA distance, mutation and crossing
+/// for BOCData.
+///
+/// The generic versions iterate over the runtime field metadata and look up
+/// weights/rates by name for every call. These kernels instead unroll the four
+/// fields and use a cached copy of the relevant configuration values. Per-field
+/// operations are delegated to the same config::Bounds objects so that results
+/// match the generic path (bit for bit, see src/tests/bockernels.cpp).
+///
+/// BOCData's own distance, mutate and cross go through these kernels (unless
+/// APT_GENERIC_BOCDATA is defined, for comparison purposes).
+///
+/// The configuration values are read once, on first use, and shared by all
+/// threads. Call reloadConfig() if the configuration is modified afterwards
+/// (debug builds assert that it was).
+struct BOCKernels {
+  /// \returns the weighted distance between \p lhs and \p rhs
+  static double distance (const BOCData &lhs, const BOCData &rhs);
+
+  /// Mutates a single field of \p d, picked according to the mutation rates
+  static void mutate (BOCData &d, rng::AbstractDice &dice);
+
+  /// \overload
+  ///
+  /// Operates on detached fields (e.g. from a BOCPopulation)
+  static void mutate (float &optimalDistance, float &inbreedTolerance,
+                      float &outbreedTolerance, BOCData::Sex &sex,
+                      rng::AbstractDice &dice);
+
+  /// \returns a child whose fields are randomly taken from \p lhs or \p rhs
+  static BOCData cross (const BOCData &lhs, const BOCData &rhs,
+                        rng::AbstractDice &dice);
+
+  /// Refreshes the cached configuration values. Previously seen configurations
+  /// are reused
+  static void reloadConfig (void);
+};
+
+#ifndef APT_GENERIC_BOCDATA
+/// \returns the distance between \p lhs and \p rhs (see BOCKernels::distance)
+inline double distance (const BOCData &lhs, const BOCData &rhs) {
+  return BOCKernels::distance(lhs, rhs);
+}
+
+/// \returns the crossing of \p lhs and \p rhs (see BOCKernels::cross)
+inline BOCData cross (const BOCData &lhs, const BOCData &rhs,
+                      rng::AbstractDice &dice) {
+  return BOCKernels::cross(lhs, rhs, dice);
+}
+#endif
+
 namespace _details {
 template <typename T, typename = void>
 struct requiresAlignment : std::false_type {};
@@ -198,8 +372,41 @@ double femaleBiased (const GENOME &female, const GENOME &/*male*/, double dist)
   return female.compatibility(dist);
 }
 
+/// \returns the genomic distance between \p lhs and \p rhs (for genomes
+/// without alignment)
+template <typename GENOME>
+std::enable_if_t<!requiresAlignment<GENOME>::value, double>
+genomicDistance (const GENOME &lhs, const GENOME &rhs) {
+  return distance(lhs, rhs);
 }
 
+/// \returns the genomic distance between \p lhs and \p rhs (for genomes
+/// requiring an alignment)
+template <typename GENOME>
+std::enable_if_t<requiresAlignment<GENOME>::value, double>
+genomicDistance (const GENOME &lhs, const GENOME &rhs) {
+  return distance(lhs, rhs, align(lhs, rhs));
+}
+
+}
+
+/// Accessor to the crossover data embedded in a genome.
+///
+/// Defaults to the \c cdata field. Specialize for genomes storing their
+/// BOCData elsewhere.
+template <typename GENOME>
+struct BOCDataAccessor {
+  /// \returns the crossover data of genome \p g
+  static const BOCData& get (const GENOME &g) {
+    return g.cdata;
+  }
+
+  /// \returns the (mutable) crossover data of genome \p g
+  static BOCData& get (GENOME &g) {
+    return g.cdata;
+  }
+};
+
 /// Crossing of \p mother and \p father.
 /// The algorithm is:
 ///   - Compute the genomic distqnce
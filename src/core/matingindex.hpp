@@ -0,0 +1,206 @@
+#ifndef KGD_MATING_INDEX_HPP
+#define KGD_MATING_INDEX_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include "crossover.h"
+
+/*!
+ * \file matingindex.hpp
+ *
+ * Definition of a metric index for retrieving compatible mates
+ */
+
+namespace genotype {
+
+/// Vantage-point tree over a (male) population answering the question: which
+/// individuals would a given female accept with at least a given compatibility?
+///
+/// The female's inverse compatibility (see BOCData::operator()(double, double&,
+/// double&)) provides the distance window [d_inbreed, d_outbreed] in which
+/// candidates must lie. This annulus is then used to prune whole subtrees
+/// through the triangle inequality so that only a fraction of the population
+/// is actually compared.
+///
+/// \attention Relies on the genomic distance being a metric. Stored genomes
+/// are referenced, not copied: they must outlive the index (or, at least, the
+/// next call to build()).
+///
+/// \tparam GENOME The genome structure to index
+template <typename GENOME>
+class MatingIndex {
+public:
+  /// Helper alias to the compatibility function type
+  using FCompat = _details::FCOMPAT<GENOME>;
+
+  /// A potential mate found by a query
+  struct Candidate {
+    const GENOME *genome; ///< The candidate
+    float distance;       ///< Its genomic distance to the querying female
+    float compatibility;  ///< The compatibility perceived through fcompat
+  };
+
+  /// Structure for storing statistics about the index usage
+  struct Stats {
+    uint queries = 0;     ///< Number of queries performed
+    uint comparisons = 0; ///< Number of distances computed while querying
+    uint candidates = 0;  ///< Number of candidates returned
+  };
+
+  /// Creates an empty index
+  MatingIndex (void) : _root(-1) {}
+
+  /// Rebuilds the index from the genomes in [\p begin, \p end[
+  ///
+  /// \tparam IT Iterator to the begin/end of the male population
+  /// \tparam F Functor for extracting a genome reference from an iterator
+  template <typename IT, typename F>
+  void build (IT begin, IT end, F genomeExtractor) {
+    _nodes.clear();
+    _items.clear();
+    for (IT it = begin; it != end; ++it)
+      _items.push_back({&genomeExtractor(*it), 0});
+
+    _nodes.reserve(_items.size());
+    _root = build(0, _items.size());
+  }
+
+  /// \overload
+  void build (const std::vector<GENOME> &males) {
+    build(males.begin(), males.end(), [] (const GENOME &g) -> const GENOME& {
+      return g;
+    });
+  }
+
+  /// \returns the number of indexed genomes
+  size_t size (void) const {
+    return _nodes.size();
+  }
+
+  /// Collects into \p candidates (cleared beforehand) all indexed genomes
+  /// with which \p female has a compatibility of at least \p minCompat.
+  ///
+  /// The distance window is computed from the female's crossover data so that
+  /// it is exact for the default (female-biased) compatibility function. For
+  /// other functions the window is used as a pre-filter and \p fcompat is
+  /// evaluated on every candidate inside it.
+  ///
+  /// \warning For non female-biased compatibility functions, \p fcompat must
+  /// never exceed the female's compatibility (e.g. the min of both partners).
+  void query (const GENOME &female, double minCompat,
+              std::vector<Candidate> &candidates,
+              FCompat fcompat = _details::femaleBiased<GENOME>) const {
+
+    candidates.clear();
+    _stats.queries++;
+    if (_root < 0)  return;
+
+    double dmin = 0, dmax = std::numeric_limits<double>::max();
+    if (minCompat > 0)
+      BOCDataAccessor<GENOME>::get(female)(std::min(1., minCompat), dmin, dmax);
+
+    std::vector<int> stack { _root };
+    while (!stack.empty()) {
+      const VPNode &n = _nodes[stack.back()];
+      stack.pop_back();
+
+      double d = _details::genomicDistance(female, *n.vantage);
+      _stats.comparisons++;
+
+      if (dmin <= d && d <= dmax) {
+        double c = fcompat(female, *n.vantage, d);
+        if (c >= minCompat) candidates.push_back({n.vantage, float(d), float(c)});
+      }
+
+      // Inner points x verify d(v,x) <= mu, hence d(q,x) in [d-mu, d+mu]
+      if (n.inner >= 0 && d - n.mu <= dmax && d + n.mu >= dmin)
+        stack.push_back(n.inner);
+
+      // Outer points x verify mu <= d(v,x) <= R, hence d(q,x) in [mu-d, d+R]
+      if (n.outer >= 0 && n.mu - d <= dmax && d + n.radius >= dmin)
+        stack.push_back(n.outer);
+    }
+
+    _stats.candidates += candidates.size();
+  }
+
+  /// \return the index usage statistics
+  const Stats& stats (void) const {
+    return _stats;
+  }
+
+  /// Resets the statistics
+  void resetStats (void) {
+    _stats = Stats{};
+  }
+
+private:
+  /// A node of the vantage-point tree
+  struct VPNode {
+    const GENOME *vantage;  ///< The reference point
+    double mu;      ///< Median distance between the vantage point and its subtree
+    double radius;  ///< Maximal distance between the vantage point and its subtree
+    int inner;      ///< Subtree with distances in [0,mu] (or -1)
+    int outer;      ///< Subtree with distances in [mu,radius] (or -1)
+  };
+
+  /// Temporary data used while building the tree
+  struct Item {
+    const GENOME *genome; ///< The indexed genome
+    double distance;      ///< Its distance to the current vantage point
+  };
+
+  /// Index of the root node (-1 if empty)
+  int _root;
+
+  /// The tree nodes
+  std::vector<VPNode> _nodes;
+
+  /// Building buffer
+  std::vector<Item> _items;
+
+  /// Usage statistics
+  mutable Stats _stats;
+
+  /// Recursively builds the subtree for items in [\p i, \p j[
+  /// \returns the index of the subtree root (or -1 if empty)
+  int build (size_t i, size_t j) {
+    if (i >= j) return -1;
+
+    int index = _nodes.size();
+    _nodes.push_back({_items[i].genome, 0, 0, -1, -1});
+    if (j - i == 1) return index;
+
+    const GENOME &v = *_items[i].genome;
+    double radius = 0;
+    for (size_t k=i+1; k<j; k++) {
+      double d = _details::genomicDistance(v, *_items[k].genome);
+      assert(0 <= d);
+      _items[k].distance = d;
+      radius = std::max(radius, d);
+    }
+
+    // Partition around the median distance
+    size_t m = i + 1 + (j - i - 1) / 2;
+    std::nth_element(_items.begin()+i+1, _items.begin()+m, _items.begin()+j,
+                     [] (const Item &lhs, const Item &rhs) {
+      return lhs.distance < rhs.distance;
+    });
+    double mu = _items[m].distance;
+
+    int inner = build(i+1, m);
+    int outer = build(m, j);
+
+    VPNode &n = _nodes[index];
+    n.mu = mu;
+    n.radius = radius;
+    n.inner = inner;
+    n.outer = outer;
+    return index;
+  }
+};
+
+} // end of namespace genotype
+
+#endif // KGD_MATING_INDEX_HPP
@@ -0,0 +1,367 @@
+#ifndef KGD_MATING_POOL_HPP
+#define KGD_MATING_POOL_HPP
+
+#include <vector>
+
+#include "bocpopulation.hpp"
+
+/*!
+ * \file matingpool.hpp
+ *
+ * Definition of a sex-aware mating pool with compatibility-biased sampling
+ */
+
+namespace genotype {
+
+namespace _details {
+
+/// Walker/Vose alias table for O(1) sampling of a discrete distribution
+struct AliasTable {
+  std::vector<float> prob;  ///< Probability of keeping a given bucket
+  std::vector<uint> alias;  ///< Fallback bucket
+  double total = 0;         ///< Sum of the input weights
+
+  /// Rebuilds the table for the (unnormalized) \p weights
+  void build (const std::vector<float> &weights) {
+    uint n = weights.size();
+    prob.resize(n);
+    alias.resize(n);
+
+    total = 0;
+    for (float w: weights) total += w;
+    if (total <= 0) return;
+
+    std::vector<uint> small, large;
+    small.reserve(n), large.reserve(n);
+    for (uint i=0; i<n; i++) {
+      prob[i] = weights[i] * n / total;
+      (prob[i] < 1 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+      uint s = small.back(), l = large.back();
+      small.pop_back();
+      alias[s] = l;
+      prob[l] = (prob[l] + prob[s]) - 1;
+      if (prob[l] < 1) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+
+    // Remaining buckets are full (up to rounding errors)
+    for (uint i: small) prob[i] = 1, alias[i] = i;
+    for (uint i: large) prob[i] = 1, alias[i] = i;
+  }
+
+  /// \returns whether at least one bucket has a non-null weight
+  bool valid (void) const {
+    return total > 0;
+  }
+
+  /// \returns a bucket index drawn according to the weights
+  uint sample (rng::AbstractDice &dice) const {
+    assert(valid());
+    uint i = dice(0u, uint(prob.size()-1));
+    return dice(0.f, 1.f) < prob[i] ? i : alias[i];
+  }
+};
+
+} // end of namespace _details
+
+/// Mating pool splitting a population by sex and sampling, for a given female,
+/// males with a probability proportional to her compatibility with them.
+///
+/// By default (Acceptance::CHOICE) the sampling itself accounts for the
+/// compatibility: a female with at least one compatible male always mates and
+/// no attempt is lost to a bail-out. This changes the distribution compared to
+/// random pairing, where a female mates with probability her mean
+/// compatibility over the males: choosy females (few compatible males) are
+/// favored. Acceptance::BAILOUT restores that distribution with a single toss
+/// per attempt, which leaves as many bail-outs per birth as random pairing
+/// restricted to female/male pairs.
+///
+/// The crossover data of each sex is stored in packed arrays so that the
+/// per-female weights are computed in a single vectorizable pass. Alias
+/// tables are built lazily, the first time a female looks for a mate, and
+/// kept until the next call to build() (i.e. once per simulation step) as
+/// long as the cached tables hold less than a given number of entries. Beyond
+/// that, females without a table fall back to plain bail-out: a uniformly
+/// drawn male accepted with their compatibility.
+///
+/// \attention Genomes are referenced, not copied: they must outlive the pool
+/// (or, at least, the next call to build()).
+///
+/// \tparam GENOME The genome structure to cross
+template <typename GENOME>
+class MatingPool {
+public:
+  /// Helper alias to the source of randomness
+  using Dice = rng::AbstractDice;
+
+  /// Structure for storing statistics about the pool usage
+  struct Stats {
+    uint attempts = 0;  ///< Number of calls to mate()
+    uint births = 0;    ///< Number of successful matings
+    uint bailouts = 0;  ///< Number of crossovers aborted by the compatibility
+    uint lonely = 0;    ///< Number of attempts without any compatible male
+  };
+
+  /// How the compatibility limits the matings (see the class description)
+  enum class Acceptance {
+    CHOICE, ///< Mating succeeds whenever a compatible male exists
+    BAILOUT ///< Mating succeeds with the mean compatibility over the males
+  };
+
+  /// Default maximal number of (female, male) entries in the cached tables
+  static constexpr size_t MAX_CACHED_ENTRIES = 1 << 22;
+
+  /// Creates an empty pool
+  ///
+  /// \param mutual Whether the males' own compatibility should also be
+  /// accounted for (sampling weights are then the min of both)
+  /// \param acceptance Whether sampled pairs are still subject to a global
+  /// acceptance toss
+  /// \param maxCachedEntries Upper bound on the memory used by the cached
+  /// tables (in number of males, summed over the females)
+  MatingPool (bool mutual = false, Acceptance acceptance = Acceptance::CHOICE,
+              size_t maxCachedEntries = MAX_CACHED_ENTRIES)
+    : _mutual(mutual), _acceptance(acceptance),
+      _maxCachedEntries(maxCachedEntries), _cachedEntries(0) {}
+
+  /// Rebuilds the pool from the genomes in [\p begin, \p end[ and discards
+  /// all cached sampling tables
+  ///
+  /// \tparam IT Iterator to the begin/end of the population
+  /// \tparam F Functor for extracting a genome reference from an iterator
+  template <typename IT, typename F>
+  void build (IT begin, IT end, F genomeExtractor) {
+    for (SexArrays *a: {&_females, &_males}) a->clear();
+    for (IT it = begin; it != end; ++it) {
+      const GENOME &g = genomeExtractor(*it);
+      const BOCData &d = BOCDataAccessor<GENOME>::get(g);
+      (d.sex == BOCData::FEMALE ? _females : _males).push_back(g, d);
+    }
+
+    _tables.clear();
+    _tables.resize(_females.size());
+    _built.assign(_females.size(), false);
+    _cachedEntries = 0;
+  }
+
+  /// \overload
+  void build (const std::vector<GENOME> &population) {
+    build(population.begin(), population.end(),
+          [] (const GENOME &g) -> const GENOME& { return g; });
+  }
+
+  /// \returns the number of females in the pool
+  size_t females (void) const {
+    return _females.size();
+  }
+
+  /// \returns the number of males in the pool
+  size_t males (void) const {
+    return _males.size();
+  }
+
+  /// \returns the \p i-th female
+  const GENOME& female (uint i) const {
+    return *_females.genomes[i];
+  }
+
+  /// \returns the \p i-th male
+  const GENOME& male (uint i) const {
+    return *_males.genomes[i];
+  }
+
+  /// Draws a male for the \p f-th female with probability proportional to
+  /// their compatibility
+  /// \returns the male index or -1 if none is compatible (or if her table
+  /// could not be cached)
+  int sampleMale (uint f, Dice &dice) {
+    const _details::AliasTable *t = table(f);
+    if (!t || !t->valid()) return -1;
+    return t->sample(dice);
+  }
+
+  /// Attempts a mating between the \p f-th female and a sampled male
+  ///
+  /// Succeeds if she has any compatible male or, with Acceptance::BAILOUT,
+  /// with probability her mean compatibility with the males (see the class
+  /// description). The chosen pair is then crossed without any further
+  /// bail-out.
+  ///
+  /// \param f Index of the female
+  /// \param litter Container for the children (see bailOutCrossver)
+  /// \param dice Source of randomness
+  /// \param oMale If not null, filled with the index of the chosen male (-1
+  /// on failure)
+  /// \returns whether mating was successful
+  bool mate (uint f, std::vector<GENOME> &litter, Dice &dice,
+             int *oMale = nullptr) {
+    _stats.attempts++;
+    if (oMale)  *oMale = -1;
+
+    if (_males.size() == 0) {
+      _stats.lonely++;
+      return false;
+    }
+
+    int m;
+    if (const _details::AliasTable *t = table(f)) {
+      if (!t->valid()) {
+        _stats.lonely++;
+        return false;
+      }
+
+      if (_acceptance == Acceptance::BAILOUT
+          && !dice(t->total / _males.size())) {
+        _stats.bailouts++;
+        return false;
+      }
+
+      m = t->sample(dice);
+
+    } else {  // Too many tables: plain bail-out
+      m = dice(0u, uint(_males.size()-1));
+      if (!dice(compatibility(f, m))) {
+        _stats.bailouts++;
+        return false;
+      }
+    }
+
+    if (oMale)  *oMale = m;
+    breed(female(f), male(m), litter, dice);
+    _stats.births++;
+    return true;
+  }
+
+  /// \return the pool usage statistics
+  const Stats& stats (void) const {
+    return _stats;
+  }
+
+  /// Resets the statistics
+  void resetStats (void) {
+    _stats = Stats{};
+  }
+
+private:
+  /// Packed crossover data for one sex
+  struct SexArrays {
+    std::vector<const GENOME*> genomes; ///< The individuals
+    BOCPopulation cdata;                ///< Their crossover data
+
+    /// Remove all contents
+    void clear (void) {
+      genomes.clear();
+      cdata.clear();
+    }
+
+    /// Append an individual
+    void push_back (const GENOME &g, const BOCData &d) {
+      genomes.push_back(&g);
+      cdata.push_back(d);
+    }
+
+    /// \returns the number of individuals
+    size_t size (void) const {
+      return genomes.size();
+    }
+  };
+
+  /// Whether to use the min of both partners' compatibilities
+  bool _mutual;
+
+  /// Whether sampled pairs are still subject to a global acceptance toss
+  Acceptance _acceptance;
+
+  /// Maximal number of entries in the cached tables
+  size_t _maxCachedEntries;
+
+  /// Number of entries in the cached tables
+  size_t _cachedEntries;
+
+  /// The females
+  SexArrays _females;
+
+  /// The males
+  SexArrays _males;
+
+  /// Per-female sampling tables
+  std::vector<_details::AliasTable> _tables;
+
+  /// Whether a given female's table is up to date
+  std::vector<bool> _built;
+
+  /// Buffer for distances/weights
+  std::vector<float> _distances, _weights, _maleWeights;
+
+  /// Usage statistics
+  Stats _stats;
+
+  /// Fills \p litter with children of the (accepted) \p mother and \p father
+  /// and potentially mutates them, as bailOutCrossver does
+  static void breed (const GENOME &mother, const GENOME &father,
+                     std::vector<GENOME> &litter, Dice &dice) {
+    if constexpr (_details::requiresAlignment<GENOME>::value) {
+      typename GENOME::Alignment alg = align(mother, father);
+      for (GENOME &child: litter) {
+        child = cross(mother, father, dice, alg);
+        if (dice(config::EDNAConfigFile<BOCData>::mutateChild()))
+          child.mutate(dice);
+      }
+
+    } else {
+      for (GENOME &child: litter) {
+        child = cross(mother, father, dice);
+        if (dice(config::EDNAConfigFile<BOCData>::mutateChild()))
+          child.mutate(dice);
+      }
+    }
+  }
+
+  /// \returns the compatibility between the \p f-th female and the \p m-th
+  /// male (with the same kernels as the tables)
+  float compatibility (uint f, uint m) const {
+    float d = _details::genomicDistance(female(f), male(m)), c, cm;
+    BOCDataAccessor<GENOME>::get(female(f))(&d, &c, 1);
+    if (_mutual) {
+      BOCDataAccessor<GENOME>::get(male(m))(&d, &cm, 1);
+      c = std::min(c, cm);
+    }
+    return c;
+  }
+
+  /// \returns the (lazily built) sampling table for the \p f-th female or
+  /// nullptr if the cached tables are full
+  const _details::AliasTable* table (uint f) {
+    if (_built[f])  return &_tables[f];
+
+    uint n = _males.size();
+    if (_cachedEntries + n > _maxCachedEntries) return nullptr;
+
+    const GENOME &g = female(f);
+    _distances.resize(n);
+    for (uint i=0; i<n; i++)
+      _distances[i] = _details::genomicDistance(g, male(i));
+
+    BOCDataAccessor<GENOME>::get(g)(_distances, _weights);
+
+    if (_mutual) {
+      _males.cdata.compatibilities(_distances, _maleWeights);
+      for (uint i=0; i<n; i++)
+        _weights[i] = std::min(_weights[i], _maleWeights[i]);
+    }
+
+    _tables[f].build(_weights);
+    _built[f] = true;
+    _cachedEntries += n;
+    return &_tables[f];
+  }
+};
+
+} // end of namespace genotype
+
+#endif // KGD_MATING_POOL_HPP
@@ -0,0 +1,541 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "journal.h"
+
+namespace phylogeny {
+
+namespace {
+
+/// Identifies a journal file (and its format version)
+constexpr char MAGIC [] = "APTJRNL2";
+
+/// Identifies a properly closed journal file
+constexpr char END_MAGIC [] = "APTJEND1";
+
+/// Size of the magic strings (without the null terminator)
+constexpr size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+/// Record types stored alongside the events (see JournalEvent::Type)
+enum Record : uint8_t {
+  KEYFRAME = JournalEvent::MC_CHANGED + 1,  ///< Complete state
+  INDEX                                     ///< Keyframes index
+};
+
+/// Writes \p v to \p os (in the native byte order)
+template <typename T>
+void put (std::ostream &os, T v) {
+  os.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+/// \copydoc put
+void put (std::ostream &os, SID sid) {
+  put(os, std::underlying_type<SID>::type(sid));
+}
+
+/// \copydoc put
+void put (std::ostream &os, GID gid) {
+  put(os, std::underlying_type<GID>::type(gid));
+}
+
+/// Writes the species in \p sids to \p os, preceded by their number
+void put (std::ostream &os, const std::vector<SID> &sids) {
+  put(os, uint32_t(sids.size()));
+  for (SID sid: sids) put(os, sid);
+}
+
+/// Writes the counts in \p counts to \p os, preceded by their number
+void put (std::ostream &os, const SpeciesCounts &counts) {
+  put(os, uint32_t(counts.size()));
+  for (const auto &c: counts) {
+    put(os, c.first);
+    put(os, uint32_t(c.second));
+  }
+}
+
+/// Reads \p v from \p is
+template <typename T>
+bool get (std::istream &is, T &v) {
+  return bool(is.read(reinterpret_cast<char*>(&v), sizeof(T)));
+}
+
+/// \copydoc get
+bool get (std::istream &is, SID &sid) {
+  std::underlying_type<SID>::type v;
+  if (!get(is, v)) return false;
+  sid = SID(v);
+  return true;
+}
+
+/// \copydoc get
+bool get (std::istream &is, GID &gid) {
+  std::underlying_type<GID>::type v;
+  if (!get(is, v)) return false;
+  gid = GID(v);
+  return true;
+}
+
+/// Reads species written by put(std::ostream&, const std::vector<SID>&)
+bool get (std::istream &is, std::vector<SID> &sids) {
+  uint32_t n;
+  if (!get(is, n)) return false;
+  sids.resize(n);
+  for (SID &sid: sids)  if (!get(is, sid)) return false;
+  return true;
+}
+
+/// Reads counts written by put(std::ostream&, const SpeciesCounts&)
+bool get (std::istream &is, SpeciesCounts &counts) {
+  uint32_t n;
+  if (!get(is, n)) return false;
+  counts.resize(n);
+  for (auto &c: counts) {
+    uint32_t count;
+    if (!get(is, c.first) || !get(is, count)) return false;
+    c.second = count;
+  }
+  return true;
+}
+
+} // end of anonymous namespace
+
+// =============================================================================
+// == State
+
+void JournalState::apply (const JournalEvent &e) {
+  switch (e.type) {
+  case JournalEvent::STEPPED:
+    for (SID sid: e.extinct)  living.erase(sid);
+    living.insert(e.revived.begin(), e.revived.end());
+    step = e.step;
+    for (SID sid: living) {
+      auto it = species.find(sid);
+      if (it != species.end())  it->second.lastAppearance = step;
+    }
+    for (const auto &c: e.counts) {
+      auto it = species.find(c.first);
+      if (it != species.end())  it->second.count = c.second;
+    }
+    break;
+
+  case JournalEvent::NEW_SPECIES:
+    species[e.sid] = { e.pid, step, step, 0, 0 };
+    break;
+
+  case JournalEvent::ENTERS_ENVELOPPE:
+    species[e.sid].enveloppe++;
+    break;
+
+  case JournalEvent::LEAVES_ENVELOPPE: {
+    uint &k = species[e.sid].enveloppe;
+    if (k > 0)  k--;
+    break;
+  }
+
+  case JournalEvent::MC_CHANGED:
+    species[e.sid].parent = e.newMC;
+    break;
+  }
+}
+
+// =============================================================================
+// == Writer
+
+JournalWriter::JournalWriter (const std::string &filename)
+  : _ofs(filename, std::ios::binary), _sinceKeyframe(0), _firstStep(-1),
+    _closed(false) {
+
+  if (!_ofs) {
+    std::cerr << "Failed to open '" << filename << "' for writing" << std::endl;
+    return;
+  }
+
+  _ofs.write(MAGIC, MAGIC_SIZE);
+}
+
+JournalWriter::~JournalWriter (void) {
+  if (!_closed) close();
+}
+
+void JournalWriter::onStepped (uint step, const LivingSet &living) {
+  JournalEvent e {JournalEvent::STEPPED};
+  e.step = step;
+  std::set_difference(living.begin(), living.end(),
+                      _state.living.begin(), _state.living.end(),
+                      std::back_inserter(e.revived));
+  std::set_difference(_state.living.begin(), _state.living.end(),
+                      living.begin(), living.end(),
+                      std::back_inserter(e.extinct));
+  e.counts.assign(_counts.begin(), _counts.end());
+  _counts.clear();
+  record(e);
+
+  if (_firstStep == uint(-1)) _firstStep = step;
+  if (_sinceKeyframe >= std::max<size_t>(KEYFRAME_EVENTS, _state.species.size()))
+    writeKeyframe();
+}
+
+void JournalWriter::onNewSpecies (SID pid, SID sid) {
+  JournalEvent e {JournalEvent::NEW_SPECIES};
+  e.pid = pid;
+  e.sid = sid;
+  record(e);
+}
+
+void JournalWriter::onGenomeEntersEnveloppe (SID sid, GID gid) {
+  JournalEvent e {JournalEvent::ENTERS_ENVELOPPE};
+  e.sid = sid;
+  e.gid = gid;
+  record(e);
+}
+
+void JournalWriter::onGenomeLeavesEnveloppe (SID sid, GID gid) {
+  JournalEvent e {JournalEvent::LEAVES_ENVELOPPE};
+  e.sid = sid;
+  e.gid = gid;
+  record(e);
+}
+
+void JournalWriter::onMajorContributorChanged (SID sid, SID oldMC, SID newMC) {
+  JournalEvent e {JournalEvent::MC_CHANGED};
+  e.sid = sid;
+  e.pid = oldMC;
+  e.newMC = newMC;
+  record(e);
+}
+
+void JournalWriter::record (const JournalEvent &e) {
+  _state.apply(e);
+  _sinceKeyframe++;
+  if (!good())  return;
+
+  put(_ofs, uint8_t(e.type));
+  switch (e.type) {
+  case JournalEvent::STEPPED:
+    put(_ofs, uint32_t(e.step));
+    put(_ofs, e.revived);
+    put(_ofs, e.extinct);
+    put(_ofs, e.counts);
+    break;
+
+  case JournalEvent::NEW_SPECIES:
+    put(_ofs, e.pid);
+    put(_ofs, e.sid);
+    break;
+
+  case JournalEvent::ENTERS_ENVELOPPE:
+  case JournalEvent::LEAVES_ENVELOPPE:
+    put(_ofs, e.sid);
+    put(_ofs, e.gid);
+    break;
+
+  case JournalEvent::MC_CHANGED:
+    put(_ofs, e.sid);
+    put(_ofs, e.pid);
+    put(_ofs, e.newMC);
+    break;
+  }
+}
+
+void JournalWriter::writeKeyframe (void) {
+  _sinceKeyframe = 0;
+  if (!good())  return;
+
+  uint64_t offset = _ofs.tellp();
+  _keyframes.push_back({ _state.step, offset });
+
+  // Size is filled in afterwards so that readers can skip keyframes
+  put(_ofs, uint8_t(KEYFRAME));
+  put(_ofs, uint64_t(0));
+
+  put(_ofs, uint32_t(_state.step));
+  put(_ofs, uint32_t(_state.species.size()));
+  for (const auto &p: _state.species) {
+    const JournalState::Species &s = p.second;
+    put(_ofs, p.first);
+    put(_ofs, s.parent);
+    put(_ofs, uint32_t(s.firstAppearance));
+    put(_ofs, uint32_t(s.lastAppearance));
+    put(_ofs, uint32_t(s.count));
+    put(_ofs, uint32_t(s.enveloppe));
+  }
+  put(_ofs, std::vector<SID>(_state.living.begin(), _state.living.end()));
+
+  uint64_t end = _ofs.tellp();
+  _ofs.seekp(offset + 1);
+  put(_ofs, end - offset);
+  _ofs.seekp(end);
+}
+
+bool JournalWriter::close (void) {
+  _closed = true;
+  if (!good())  return false;
+
+  uint64_t offset = _ofs.tellp();
+  put(_ofs, uint8_t(INDEX));
+  put(_ofs, uint32_t(_firstStep == uint(-1) ? 0 : _firstStep));
+  put(_ofs, uint32_t(_state.step));
+  put(_ofs, uint32_t(_keyframes.size()));
+  for (const auto &k: _keyframes) {
+    put(_ofs, uint32_t(k.first));
+    put(_ofs, k.second);
+  }
+  put(_ofs, offset);
+  _ofs.write(END_MAGIC, MAGIC_SIZE);
+
+  _ofs.close();
+  return !_ofs.fail();
+}
+
+// =============================================================================
+// == Reader
+
+Journal::Journal (const std::string &filename)
+  : _ifs(filename, std::ios::binary), _good(false), _firstStep(0),
+    _lastStep(0), _dataBegin(MAGIC_SIZE), _dataEnd(MAGIC_SIZE) {
+
+  char magic [MAGIC_SIZE];
+  if (!_ifs || !_ifs.read(magic, MAGIC_SIZE)
+      || std::strncmp(magic, MAGIC, MAGIC_SIZE) != 0) {
+    std::cerr << "'" << filename << "' is not a valid journal" << std::endl;
+    return;
+  }
+
+  if (!readIndex()) {
+    std::cerr << "Journal '" << filename << "' was not properly closed."
+              << " Rebuilding its index" << std::endl;
+    scan();
+  }
+
+  _ifs.clear();
+  _ifs.seekg(_dataBegin);
+  _good = bool(_ifs);
+}
+
+bool Journal::readIndex (void) {
+  _ifs.clear();
+  _ifs.seekg(0, std::ios::end);
+  uint64_t size = _ifs.tellg();
+  if (size < 2 * MAGIC_SIZE + sizeof(uint64_t)) return false;
+
+  uint64_t offset;
+  char magic [MAGIC_SIZE];
+  _ifs.seekg(size - MAGIC_SIZE - sizeof(uint64_t));
+  if (!get(_ifs, offset) || !_ifs.read(magic, MAGIC_SIZE)
+      || std::strncmp(magic, END_MAGIC, MAGIC_SIZE) != 0
+      || offset < _dataBegin || offset >= size)
+    return false;
+
+  uint8_t type;
+  uint32_t first, last, n;
+  _ifs.seekg(offset);
+  if (!get(_ifs, type) || type != INDEX
+      || !get(_ifs, first) || !get(_ifs, last) || !get(_ifs, n))
+    return false;
+
+  _keyframes.resize(n);
+  for (auto &k: _keyframes) {
+    uint32_t step;
+    if (!get(_ifs, step) || !get(_ifs, k.second))  return false;
+    k.first = step;
+  }
+
+  _firstStep = first;
+  _lastStep = last;
+  _dataEnd = offset;
+  return true;
+}
+
+void Journal::scan (void) {
+  _ifs.clear();
+  _ifs.seekg(0, std::ios::end);
+  const uint64_t size = _ifs.tellg();
+  _ifs.seekg(_dataBegin);
+  _keyframes.clear();
+
+  // Stops at the first truncated (or unknown) record
+  uint64_t end = _dataBegin;
+  _dataEnd = size;
+  bool stepped = false;
+  JournalEvent e;
+  while (true) {
+    uint64_t offset = _ifs.tellg();
+    uint8_t type;
+    if (!get(_ifs, type) || type == INDEX) break;
+
+    if (type == KEYFRAME) {
+      uint64_t length;
+      uint32_t step;
+      if (!get(_ifs, length) || !get(_ifs, step) || offset + length > size)
+        break;
+      _keyframes.push_back({ step, offset });
+      _ifs.seekg(offset + length);
+
+    } else {
+      _ifs.seekg(offset);
+      if (!read(e)) break;
+      if (e.type == JournalEvent::STEPPED) {
+        if (!stepped) _firstStep = e.step;
+        _lastStep = e.step;
+        stepped = true;
+      }
+    }
+
+    end = _ifs.tellg();
+  }
+  _dataEnd = end;
+}
+
+bool Journal::read (JournalEvent &e) {
+  uint8_t type;
+  while (true) {
+    if (uint64_t(_ifs.tellg()) >= _dataEnd || !get(_ifs, type)) return false;
+    if (type != KEYFRAME) break;
+
+    uint64_t offset = uint64_t(_ifs.tellg()) - 1, size;
+    if (!get(_ifs, size) || !_ifs.seekg(offset + size)) return false;
+  }
+
+  e = JournalEvent{JournalEvent::Type(type)};
+  e.step = _state.step;
+
+  uint32_t step;
+  switch (type) {
+  case JournalEvent::STEPPED:
+    if (!get(_ifs, step)) return false;
+    e.step = step;
+    return get(_ifs, e.revived) && get(_ifs, e.extinct)
+        && get(_ifs, e.counts);
+
+  case JournalEvent::NEW_SPECIES:
+    return get(_ifs, e.pid) && get(_ifs, e.sid);
+
+  case JournalEvent::ENTERS_ENVELOPPE:
+  case JournalEvent::LEAVES_ENVELOPPE:
+    return get(_ifs, e.sid) && get(_ifs, e.gid);
+
+  case JournalEvent::MC_CHANGED:
+    return get(_ifs, e.sid) && get(_ifs, e.pid) && get(_ifs, e.newMC);
+
+  default:
+    return false;
+  }
+}
+
+void Journal::readKeyframe (void) {
+  uint8_t type;
+  uint64_t size;
+  uint32_t step, n;
+  if (!get(_ifs, type) || type != KEYFRAME || !get(_ifs, size)
+      || !get(_ifs, step) || !get(_ifs, n)) {
+    _good = false;
+    return;
+  }
+
+  _state = JournalState();
+  _state.step = step;
+  for (uint i=0; i<n; i++) {
+    SID sid;
+    JournalState::Species s;
+    uint32_t first, last, count, k;
+    if (!get(_ifs, sid) || !get(_ifs, s.parent)
+        || !get(_ifs, first) || !get(_ifs, last) || !get(_ifs, count)
+        || !get(_ifs, k)) {
+      _good = false;
+      return;
+    }
+    s.firstAppearance = first;
+    s.lastAppearance = last;
+    s.count = count;
+    s.enveloppe = k;
+    _state.species.emplace_hint(_state.species.end(), sid, s);
+  }
+
+  std::vector<SID> living;
+  if (!get(_ifs, living)) _good = false;
+  _state.living = LivingSet(living.begin(), living.end());
+}
+
+bool Journal::nextStep (uint step, std::vector<JournalEvent> &events) {
+  events.clear();
+  if (!_good) return false;
+
+  // Events are grouped with the step that follows them
+  uint64_t begin = _ifs.tellg();
+  JournalEvent e;
+  while (read(e)) {
+    events.push_back(std::move(e));
+    if (events.back().type == JournalEvent::STEPPED) break;
+  }
+
+  if (events.empty() || events.back().type != JournalEvent::STEPPED
+      || events.back().step > step) {
+    events.clear();
+    _ifs.clear();
+    _ifs.seekg(begin);
+    return false;
+  }
+
+  for (const JournalEvent &e: events)  _state.apply(e);
+  return true;
+}
+
+void Journal::seek (uint step) {
+  _good = true;
+  _ifs.clear();
+
+  auto it = std::upper_bound(_keyframes.begin(), _keyframes.end(), step,
+                             [] (uint s, const std::pair<uint, uint64_t> &k) {
+    return s < k.first;
+  });
+
+  if (it == _keyframes.begin()) {
+    _state = JournalState();
+    _ifs.seekg(_dataBegin);
+
+  } else {
+    _ifs.seekg(std::prev(it)->second);
+    readKeyframe();
+  }
+
+  std::vector<JournalEvent> events;
+  while (nextStep(step, events));
+}
+
+bool Journal::events (uint step, size_t limit,
+                      std::vector<JournalEvent> &events) {
+  events.clear();
+  if (!_good) return false;
+
+  // Only the complete steps are kept
+  const uint64_t begin = _ifs.tellg();
+  size_t complete = 0;
+  bool exhausted = false;
+  JournalEvent e;
+  while (read(e)) {
+    if (e.type == JournalEvent::STEPPED && e.step > step) break;
+    events.push_back(std::move(e));
+    if (events.back().type == JournalEvent::STEPPED)
+      complete = events.size();
+    if (events.size() > limit) {
+      exhausted = true;
+      break;
+    }
+  }
+  events.resize(complete);
+
+  _ifs.clear();
+  _ifs.seekg(begin);
+  return !exhausted;
+}
+
+uint Journal::keyframeBefore (uint step) const {
+  auto it = std::upper_bound(_keyframes.begin(), _keyframes.end(), step,
+                             [] (uint s, const std::pair<uint, uint64_t> &k) {
+    return s < k.first;
+  });
+  return it == _keyframes.begin() ? _firstStep : std::prev(it)->first;
+}
+
+} // end of namespace phylogeny
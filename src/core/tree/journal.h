@@ -0,0 +1,271 @@
+#ifndef KGD_JOURNAL_H
+#define KGD_JOURNAL_H
+
+/*!
+ * \file journal.h
+ *
+ * Contains the definitions for recording and reading back the events of a
+ * phylogenic tree
+ */
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "treetypes.h"
+
+namespace phylogeny {
+
+/// Number of individuals observed (see SpeciesData::count), by species
+using SpeciesCounts = std::vector<std::pair<SID, uint>>;
+
+/// A single recorded event of a phylogenic tree (see Callbacks_t)
+struct JournalEvent {
+  /// The type of event
+  enum Type : uint8_t {
+    STEPPED,          ///< \see Callbacks_t::onStepped
+    NEW_SPECIES,      ///< \see Callbacks_t::onNewSpecies
+    ENTERS_ENVELOPPE, ///< \see Callbacks_t::onGenomeEntersEnveloppe
+    LEAVES_ENVELOPPE, ///< \see Callbacks_t::onGenomeLeavesEnveloppe
+    MC_CHANGED        ///< \see Callbacks_t::onMajorContributorChanged
+  } type; ///< This event's type
+
+  /// Timestamp of the tree when the event occured
+  uint step = 0;
+
+  /// Species concerned
+  SID sid = SID::INVALID;
+
+  /// Parent species (NEW_SPECIES) or previous major contributor (MC_CHANGED)
+  SID pid = SID::INVALID;
+
+  /// New major contributor (MC_CHANGED)
+  SID newMC = SID::INVALID;
+
+  /// Genome concerned (ENTERS_ENVELOPPE, LEAVES_ENVELOPPE)
+  GID gid = GID::INVALID;
+
+  /// Species that are alive again (STEPPED)
+  std::vector<SID> revived;
+
+  /// Species that are no longer alive (STEPPED)
+  std::vector<SID> extinct;
+
+  /// Observation counts of the species that changed since the previous step
+  /// (STEPPED)
+  SpeciesCounts counts;
+};
+
+/// The state of a phylogenic tree, as far as its journal is concerned
+struct JournalState {
+  /// What is known of a species
+  struct Species {
+    SID parent; ///< Its major contributor
+    uint firstAppearance; ///< \copydoc SpeciesData::firstAppearance
+    uint lastAppearance;  ///< \copydoc SpeciesData::lastAppearance
+    uint count;           ///< \copydoc SpeciesData::count
+    uint enveloppe; ///< Number of enveloppe points
+  };
+
+  /// The timestamp of the last step
+  uint step = 0;
+
+  /// All species created so far
+  std::map<SID, Species> species;
+
+  /// The species alive as of the last step
+  LivingSet living;
+
+  /// Updates this state with the contents of event \p e
+  void apply (const JournalEvent &e);
+};
+
+/// What changed in a phylogenic tree when going back to a previous step (see
+/// PlaybackTree::rewind)
+struct Rewind {
+  /// A rooting change, undone
+  struct Reparent {
+    SID sid;  ///< The species that moved
+    SID from; ///< Its major contributor before rewinding
+    SID to;   ///< Its major contributor afterwards
+  };
+
+  /// The rooting changes, in the order they were undone
+  std::vector<Reparent> reparented;
+
+  /// The species that no longer exist, most recent first
+  std::vector<SID> removed;
+
+  /// The remaining species whose data (or enveloppe) may have changed
+  std::set<SID> changed;
+};
+
+/// Records the events of a phylogenic tree into a binary file
+///
+/// The state of the tree is periodically stored (as a keyframe) so that
+/// readers can jump anywhere in the journal without replaying it from the
+/// start. Keyframes are spaced by at least as many events as there are
+/// species in the tree: their cost is thus amortized over the events and
+/// restoring one is about as expensive as replaying the events that follow.
+/// An index of the keyframes is appended when the journal is closed.
+class JournalWriter {
+public:
+  /// Minimal number of events between two keyframes
+  static constexpr uint KEYFRAME_EVENTS = 1 << 16;
+
+  /// Creates (or truncates) journal file \p filename
+  JournalWriter (const std::string &filename);
+
+  /// Closes the journal, if still open
+  ~JournalWriter (void);
+
+  /// \returns whether no error has occurred so far
+  bool good (void) const {
+    return bool(_ofs);
+  }
+
+  /// Records a step event
+  /// \copydetails Callbacks_t::onStepped
+  void onStepped (uint step, const LivingSet &living);
+
+  /// Notes that \p count individuals of species \p sid were observed so far
+  /// (stored with the next step)
+  void onCountChanged (SID sid, uint count) {
+    _counts[sid] = count;
+  }
+
+  /// Records a species creation event
+  /// \copydetails Callbacks_t::onNewSpecies
+  void onNewSpecies (SID pid, SID sid);
+
+  /// Records an enveloppe insertion event
+  /// \copydetails Callbacks_t::onGenomeEntersEnveloppe
+  void onGenomeEntersEnveloppe (SID sid, GID gid);
+
+  /// Records an enveloppe removal event
+  /// \copydetails Callbacks_t::onGenomeLeavesEnveloppe
+  void onGenomeLeavesEnveloppe (SID sid, GID gid);
+
+  /// Records a rooting change event
+  /// \copydetails Callbacks_t::onMajorContributorChanged
+  void onMajorContributorChanged (SID sid, SID oldMC, SID newMC);
+
+  /// Writes the keyframes index and closes the file
+  /// \returns whether writing succeeded
+  bool close (void);
+
+private:
+  /// Destination
+  std::ofstream _ofs;
+
+  /// The state of the tree, as recorded so far
+  JournalState _state;
+
+  /// Number of events since the last keyframe
+  uint _sinceKeyframe;
+
+  /// Timestamp of the first step (if any)
+  uint _firstStep;
+
+  /// Observation counts changed since the last step
+  std::map<SID, uint> _counts;
+
+  /// Timestamp and file offset of every keyframe
+  std::vector<std::pair<uint, uint64_t>> _keyframes;
+
+  /// Whether close() has been called
+  bool _closed;
+
+  /// Writes event \p e and applies it to the state
+  void record (const JournalEvent &e);
+
+  /// Writes the current state
+  void writeKeyframe (void);
+};
+
+/// Reads back a journal written by JournalWriter
+class Journal {
+public:
+  /// Opens journal file \p filename and reads its keyframes index (rebuilt
+  /// by scanning the file if it was not properly closed)
+  Journal (const std::string &filename);
+
+  /// \returns whether the journal could be read so far
+  bool good (void) const {
+    return _good;
+  }
+
+  /// \returns the timestamp of the first recorded step
+  uint firstStep (void) const {
+    return _firstStep;
+  }
+
+  /// \returns the timestamp of the last recorded step
+  uint lastStep (void) const {
+    return _lastStep;
+  }
+
+  /// \returns the state of the tree after the events read so far
+  const JournalState& state (void) const {
+    return _state;
+  }
+
+  /// Reads, and applies to the state, all the events up to the next step
+  /// if that step is not later than \p step.
+  /// \returns whether anything was read
+  bool nextStep (uint step, std::vector<JournalEvent> &events);
+
+  /// Restores the state as it was after the last step not later than \p step
+  void seek (uint step);
+
+  /// Reads, without applying them to the state nor moving forward, all the
+  /// events up to the last step not later than \p step. Gives up once more
+  /// than \p limit events were read
+  /// \returns whether all of them could be read
+  bool events (uint step, size_t limit, std::vector<JournalEvent> &events);
+
+  /// \returns the timestamp of the last keyframe not later than \p step (or
+  /// that of the first step if there is none)
+  uint keyframeBefore (uint step) const;
+
+private:
+  /// Source
+  std::ifstream _ifs;
+
+  /// Whether the journal could be read so far
+  bool _good;
+
+  /// Timestamps of the first and last recorded steps
+  uint _firstStep, _lastStep;
+
+  /// Offset of the first event
+  uint64_t _dataBegin;
+
+  /// Offset past the last event
+  uint64_t _dataEnd;
+
+  /// Timestamp and file offset of every keyframe
+  std::vector<std::pair<uint, uint64_t>> _keyframes;
+
+  /// The state of the tree after the events read so far
+  JournalState _state;
+
+  /// Reads the index written by JournalWriter::close
+  /// \returns whether there was a valid one
+  bool readIndex (void);
+
+  /// Builds the index by reading the whole file
+  void scan (void);
+
+  /// Reads the next event into \p e (skipping keyframes)
+  /// \returns whether there was one
+  bool read (JournalEvent &e);
+
+  /// Replaces the state with the keyframe at the current position
+  void readKeyframe (void);
+};
+
+} // end of namespace phylogeny
+
+#endif // KGD_JOURNAL_H
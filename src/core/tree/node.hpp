@@ -169,6 +169,12 @@ public:
                     _children.end());
   }
 
+  /// Forces the main parent to \p p without going through the contributors
+  /// (used when replaying a journal)
+  void setParent (Node *p) {
+    _parent = p;
+  }
+
   /// Helper function generating a lambda binded to the provided collection
   /// \p nodes
   static auto elligibilityTester (const Collection &nodes) {
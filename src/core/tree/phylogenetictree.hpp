@@ -15,6 +15,7 @@
 #include "treetypes.h"
 #include "node.hpp"
 #include "callbacks.hpp"
+#include "journal.h"
 
 /*!
  * \file phylogenetictree.hpp
@@ -92,6 +93,7 @@ public:
     _step = 0;
     _root = nullptr;
     _callbacks = nullptr;
+    _journal = nullptr;
   }
 
   /// Constructs a deep copy of that PTree
@@ -102,6 +104,7 @@ public:
     updateElligibilities();
 
     _callbacks = nullptr;
+    _journal = nullptr;
 
     _rsetSize = that._rsetSize;
     _stillborns = that._stillborns;
@@ -141,6 +144,7 @@ private:
     swap(lhs._root, rhs._root);
     swap(lhs._nodes, rhs._nodes);
     swap(lhs._callbacks, rhs._callbacks);
+    swap(lhs._journal, rhs._journal);
     swap(lhs._rsetSize, rhs._rsetSize);
     swap(lhs._stillborns, rhs._stillborns);
     swap(lhs._step, rhs._step);
@@ -176,6 +180,11 @@ public:
     return it->second;
   }
 
+  /// \return whether species \p i is (still) in this tree
+  bool contains (SID i) const {
+    return _nodes.find(i) != _nodes.end();
+  }
+
   /// \return the user data for enveloppe point \p gid or nullptr if it is a
   /// regular individual
   UserData* getUserData (const PID &pid) const {
@@ -215,6 +224,9 @@ public:
   /// Sets the callbacks used by this ptree
   void setCallbacks (Callbacks *c) const { _callbacks = c; }
 
+  /// Sets the journal recording the events of this ptree (null to stop)
+  void setJournal (JournalWriter *j) const { _journal = j; }
+
   /// Sets the current timestep for this PTree
   void setStep (uint step) {
     _step = step;
@@ -259,6 +271,7 @@ public:
 
     // Potentially notify outside world
     if (_callbacks) _callbacks->onStepped(step, _aliveSpecies);
+    if (_journal) _journal->onStepped(step, _aliveSpecies);
   }
 
   /// Insert \p g into this PTree
@@ -367,11 +380,10 @@ public:
 // =============================================================================
 // == Member variables
 
-private:
+protected:
   /// Identificator for the next species
   SID _nextNodeID;
 
-protected:
   /// The PTree root. Null until the first genome is inserted
   Node_ptr _root;
 
@@ -388,6 +400,9 @@ protected:
   /// Pointer to the callbacks object. Null by default
   mutable Callbacks *_callbacks;
 
+  /// Pointer to the journal recorder. Null by default
+  mutable JournalWriter *_journal;
+
 // =============================================================================
 // == Helper functions
 
@@ -421,6 +436,8 @@ protected:
     if (parent) parent->addChild(p);
     if (_callbacks)
       _callbacks->onNewSpecies(parent ? parent->id() : SID::INVALID, p->id());
+    if (_journal)
+      _journal->onNewSpecies(parent ? parent->id() : SID::INVALID, p->id());
 
     return p;
   }
@@ -673,6 +690,8 @@ protected:
       species->rset.back().timestamp = _step;
       if (callbacks)  callbacks->onGenomeEntersEnveloppe(species->id(),
                                                          g.genealogy().self.gid);
+      if (_journal) _journal->onGenomeEntersEnveloppe(species->id(),
+                                                      g.genealogy().self.gid);
       for (uint i=0; i<k; i++)
         dist[{i, k}] = dccache.distances[i];
 
@@ -704,6 +723,10 @@ protected:
           callbacks->onGenomeLeavesEnveloppe(species->id(), ep_id);
           callbacks->onGenomeEntersEnveloppe(species->id(), g.genealogy().self.gid);
         }
+        if (_journal) {
+          _journal->onGenomeLeavesEnveloppe(species->id(), ep_id);
+          _journal->onGenomeEntersEnveloppe(species->id(), g.genealogy().self.gid);
+        }
 
         ep.userData->removedFromEnveloppe();
         userData = ep.userData.get();
@@ -719,6 +742,7 @@ protected:
     }
 
     species->data.count++;
+    if (_journal) _journal->onCountChanged(species->id(), species->data.count);
     species->data.currentlyAlive++;
     species->data.lastAppearance = step;
 
@@ -762,7 +786,11 @@ protected:
         checkMC();
 #endif
 
-        _callbacks->onMajorContributorChanged(s->id(),
+        if (_callbacks)
+          _callbacks->onMajorContributorChanged(s->id(),
+                                                oldMC->id(), newMC->id());
+        if (_journal)
+          _journal->onMajorContributorChanged(s->id(),
                                               oldMC->id(), newMC->id());
       }
     }
@@ -0,0 +1,276 @@
+#ifndef KGD_PLAYBACKTREE_HPP
+#define KGD_PLAYBACKTREE_HPP
+
+/*!
+ * \file playbacktree.hpp
+ *
+ * Contains the definition of a phylogenic tree rebuilt from its journal
+ */
+
+#include "phylogenetictree.hpp"
+
+namespace phylogeny {
+
+/// A phylogenic tree whose contents are read from a journal (see
+/// JournalWriter) instead of being computed from a population.
+///
+/// Moving forward replays the recorded events and forwards them to the
+/// callbacks, exactly as the original tree did. Going back a little undoes the
+/// events in reverse and reports what changed (see rewind). Jumping elsewhere
+/// restores the closest keyframe and silently rebuilds the hierarchy:
+/// observers are expected to rebuild their own view afterwards.
+///
+/// \attention Enveloppe genomes are not journaled: enveloppe points are
+/// placeholders (default genome, no user data) only accounting for the
+/// enveloppe sizes.
+template <typename GENOME, typename UDATA>
+class PlaybackTree : public PhylogeneticTree<GENOME, UDATA> {
+  /// Helper alias to the base class
+  using Base = PhylogeneticTree<GENOME, UDATA>;
+
+public:
+  /// \copydoc PhylogeneticTree::Node
+  using Node = typename Base::Node;
+
+  /// \copydoc PhylogeneticTree::Node_ptr
+  using Node_ptr = typename Base::Node_ptr;
+
+  /// Opens journal \p filename and restores the state at its first step
+  PlaybackTree (const std::string &filename) : _journal(filename) {
+    if (_journal.good())  seek(_journal.firstStep());
+  }
+
+  /// \returns whether the journal could be read
+  bool good (void) const {
+    return _journal.good();
+  }
+
+  /// \returns the timestamp of the first recorded step
+  uint firstStep (void) const {
+    return _journal.firstStep();
+  }
+
+  /// \returns the timestamp of the last recorded step
+  uint lastStep (void) const {
+    return _journal.lastStep();
+  }
+
+  /// \returns whether reaching \p step through advanceTo() is cheaper than
+  /// through seek() (i.e. no keyframe lies in between)
+  bool advanceIsCheaper (uint step) const {
+    return this->_step <= step && _journal.keyframeBefore(step) <= this->_step;
+  }
+
+  /// Replays all the events up to the last step not later than \p step
+  ///
+  /// Callbacks:
+  ///   - All of them, as recorded
+  ///
+  /// \returns whether any step was replayed
+  bool advanceTo (uint step) {
+    bool advanced = false;
+    while (_journal.nextStep(step, _events)) {
+      for (const JournalEvent &e: _events)  replay(e);
+      advanced = true;
+    }
+    return advanced;
+  }
+
+  /// Restores the tree as it was after the last step not later than \p step.
+  /// No callbacks are sent
+  void seek (uint step) {
+    _journal.seek(step);
+
+    // Reset everything but the callbacks
+    auto callbacks = this->_callbacks;
+    Base::operator=(Base());
+    this->_callbacks = callbacks;
+
+    const JournalState &state = _journal.state();
+    for (const auto &p: state.species) {
+      SID sid = this->nextNodeID();
+      assert(sid == p.first);
+
+      Node_ptr n = Node::make_shared(Contributors(sid));
+      n->data.firstAppearance = p.second.firstAppearance;
+      n->data.lastAppearance = p.second.lastAppearance;
+      n->data.count = p.second.count;
+      n->data.currentlyAlive = state.living.count(sid);
+      n->data.pendingCandidates = 0;
+      n->rset.resize(p.second.enveloppe);
+      this->_nodes[sid] = n;
+    }
+
+    for (const auto &p: state.species) {
+      const Node_ptr &n = this->_nodes.at(p.first);
+      if (p.second.parent == SID::INVALID) {
+        if (!this->_root) this->_root = n;
+        continue;
+      }
+      Node_ptr parent = this->_nodes.at(p.second.parent);
+      n->setParent(parent.get());
+      parent->addChild(n);
+    }
+
+    this->_aliveSpecies = state.living;
+    this->_step = state.step;
+  }
+
+  /// Restores the tree as it was after the last step not later than \p step
+  /// by undoing the events recorded since then. Only possible when going
+  /// back by at most a few keyframes worth of events (otherwise seek() is
+  /// cheaper). No callbacks are sent: observers are expected to apply the
+  /// differences stored in \p r
+  /// \returns whether the tree was rewound (unchanged otherwise)
+  bool rewind (uint step, Rewind &r) {
+    r = Rewind();
+    if (step >= this->_step)  return false;
+
+    const uint current = this->_step;
+    const size_t limit = 4 * std::max<size_t>(JournalWriter::KEYFRAME_EVENTS,
+                                              this->_nodes.size());
+    _journal.seek(step);
+    if (!_journal.events(current, limit, _events)) {
+      _journal.seek(current);
+      return false;
+    }
+
+    for (auto it = _events.rbegin(); it != _events.rend(); ++it) {
+      const JournalEvent &e = *it;
+      switch (e.type) {
+      case JournalEvent::STEPPED:
+        r.changed.insert(e.revived.begin(), e.revived.end());
+        r.changed.insert(e.extinct.begin(), e.extinct.end());
+        for (const auto &c: e.counts) r.changed.insert(c.first);
+        break;
+
+      case JournalEvent::NEW_SPECIES: {
+        Node_ptr n = this->_nodes.at(e.sid);
+        if (Node *parent = n->parent()) parent->delChild(n);
+        if (this->_root == n) this->_root = nullptr;
+        this->_nodes.erase(e.sid);
+        this->_nextNodeID = e.sid;
+        r.changed.erase(e.sid);
+        r.removed.push_back(e.sid);
+        break;
+      }
+
+      case JournalEvent::ENTERS_ENVELOPPE:
+      case JournalEvent::LEAVES_ENVELOPPE:
+        r.changed.insert(e.sid);
+        break;
+
+      case JournalEvent::MC_CHANGED: {
+        Node_ptr n = this->_nodes.at(e.sid);
+        n->parent()->delChild(n);
+        Node_ptr oldMC = this->_nodes.at(e.pid);
+        n->setParent(oldMC.get());
+        oldMC->addChild(n);
+        r.reparented.push_back({ e.sid, e.newMC, e.pid });
+        break;
+      }
+      }
+    }
+
+    const JournalState &state = _journal.state();
+    r.changed.insert(state.living.begin(), state.living.end());
+    for (SID sid: r.changed) {
+      Node &n = *this->_nodes.at(sid);
+      const JournalState::Species &s = state.species.at(sid);
+      n.data.lastAppearance = s.lastAppearance;
+      n.data.count = s.count;
+      n.data.currentlyAlive = state.living.count(sid);
+      n.rset.resize(s.enveloppe);
+    }
+
+    this->_aliveSpecies = state.living;
+    this->_step = state.step;
+    return true;
+  }
+
+private:
+  /// The source of the events
+  Journal _journal;
+
+  /// Buffer for the events of a single step
+  std::vector<JournalEvent> _events;
+
+  /// Applies event \p e to the tree and forwards it to the callbacks
+  void replay (const JournalEvent &e) {
+    auto callbacks = this->_callbacks;
+    switch (e.type) {
+    case JournalEvent::STEPPED: {
+      for (SID sid: e.extinct)
+        if (auto it = this->_nodes.find(sid); it != this->_nodes.end())
+          it->second->data.currentlyAlive = 0;
+      for (SID sid: e.revived)
+        this->_nodes.at(sid)->data.currentlyAlive = 1;
+
+      for (SID sid: e.extinct)  this->_aliveSpecies.erase(sid);
+      this->_aliveSpecies.insert(e.revived.begin(), e.revived.end());
+      for (SID sid: this->_aliveSpecies)
+        this->_nodes.at(sid)->data.lastAppearance = e.step;
+      for (const auto &c: e.counts)
+        if (auto it = this->_nodes.find(c.first); it != this->_nodes.end())
+          it->second->data.count = c.second;
+      this->_step = e.step;
+
+      if (callbacks)  callbacks->onStepped(e.step, this->_aliveSpecies);
+      break;
+    }
+
+    case JournalEvent::NEW_SPECIES: {
+      SID sid = this->nextNodeID();
+      assert(sid == e.sid);
+
+      Node_ptr n = Node::make_shared(Contributors(sid));
+      n->data.firstAppearance = this->_step;
+      n->data.lastAppearance = this->_step;
+      n->data.count = 0;
+      n->data.currentlyAlive = 0;
+      n->data.pendingCandidates = 0;
+      this->_nodes[sid] = n;
+
+      if (e.pid != SID::INVALID) {
+        Node_ptr parent = this->_nodes.at(e.pid);
+        n->setParent(parent.get());
+        parent->addChild(n);
+      } else if (!this->_root)
+        this->_root = n;
+
+      if (callbacks)  callbacks->onNewSpecies(e.pid, sid);
+      break;
+    }
+
+    case JournalEvent::ENTERS_ENVELOPPE: {
+      Node &n = *this->_nodes.at(e.sid);
+      n.rset.emplace_back();
+      n.rset.back().timestamp = this->_step;
+      if (callbacks)  callbacks->onGenomeEntersEnveloppe(e.sid, e.gid);
+      break;
+    }
+
+    case JournalEvent::LEAVES_ENVELOPPE: {
+      Node &n = *this->_nodes.at(e.sid);
+      if (!n.rset.empty())  n.rset.pop_back();
+      if (callbacks)  callbacks->onGenomeLeavesEnveloppe(e.sid, e.gid);
+      break;
+    }
+
+    case JournalEvent::MC_CHANGED: {
+      Node_ptr n = this->_nodes.at(e.sid);
+      if (Node *oldMC = n->parent())  oldMC->delChild(n);
+      Node_ptr newMC = this->_nodes.at(e.newMC);
+      n->setParent(newMC.get());
+      newMC->addChild(n);
+      if (callbacks)
+        callbacks->onMajorContributorChanged(e.sid, e.pid, e.newMC);
+      break;
+    }
+    }
+  }
+};
+
+} // end of namespace phylogeny
+
+#endif // KGD_PLAYBACKTREE_HPP
@@ -0,0 +1,42 @@
+#include "treediff.h"
+
+namespace phylogeny {
+
+std::vector<SID> TreeDiff::matches (const Hierarchy &lhs, const Hierarchy &rhs,
+                                    const Matcher &same) {
+  // Both are sorted: merge them to find the species present in both
+  std::vector<SID> matched;
+  auto r = rhs.begin();
+  for (const auto &l: lhs) {
+    while (r != rhs.end() && r->first < l.first) ++r;
+    if (r != rhs.end() && l.first == r->first && same(l.first))
+      matched.push_back(l.first);
+  }
+  return matched;
+}
+
+TreeDiff TreeDiff::compute (const Hierarchy &lhs, const Hierarchy &rhs,
+                            const std::vector<SID> &matched) {
+  TreeDiff d;
+
+  // A species whose parent is not the same one elsewhere moved as well
+  const auto isMatched = [&matched] (SID sid) {
+    return std::binary_search(matched.begin(), matched.end(), sid);
+  };
+  auto r = rhs.begin();
+  for (const auto &l: lhs) {
+    if (!isMatched(l.first)) {
+      d.missing.push_back(l.first);
+      continue;
+    }
+    while (r->first < l.first) ++r;
+
+    if (l.second != r->second
+        || (l.second != SID::INVALID && !isMatched(l.second)))
+      d.reparented.push_back(l.first);
+  }
+
+  return d;
+}
+
+} // end of namespace phylogeny
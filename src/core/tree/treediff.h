@@ -0,0 +1,124 @@
+#ifndef KGD_TREEDIFF_H
+#define KGD_TREEDIFF_H
+
+/*!
+ * \file treediff.h
+ *
+ * Contains the definition for the structural comparison of phylogenic trees
+ */
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "../ptreeconfig.h"
+#include "treetypes.h"
+
+namespace phylogeny {
+
+/// Structural differences between two phylogenic trees.
+///
+/// Identificators are assigned sequentially within each run: two species
+/// sharing one are only matched if their genomes agree (see sameSpecies).
+/// This makes sense for trees sharing (part of) their history, e.g. replays of
+/// a run or runs started from the same seed with diverging configurations.
+/// Species of independent runs are (almost) never matched.
+struct TreeDiff {
+  /// The (species, parent) pairs of a tree, sorted by species
+  using Hierarchy = std::vector<std::pair<SID, SID>>;
+
+  /// Decides whether the species with a given identificator in both trees
+  /// is the same one
+  using Matcher = std::function<bool(SID)>;
+
+  /// Species of the left tree absent from the right one
+  std::vector<SID> missing;
+
+  /// Species of both trees whose parent differs
+  std::vector<SID> reparented;
+
+  /// \returns the hierarchy of tree \p pt (a PhylogeneticTree)
+  template <typename PT>
+  static Hierarchy hierarchy (const PT &pt) {
+    Hierarchy h;
+    h.reserve(pt.width());
+    if (!pt.root())  return h;
+
+    std::vector<const typename PT::Node*> stack { pt.root().get() };
+    while (!stack.empty()) {
+      auto *n = stack.back();
+      stack.pop_back();
+
+      auto *p = n->parent();
+      h.emplace_back(n->id(), p ? p->id() : SID::INVALID);
+      for (const auto &c: n->children())  stack.push_back(c.get());
+    }
+
+    std::sort(h.begin(), h.end());
+    return h;
+  }
+
+  /// \returns whether species \p lhs and \p rhs (nodes of two different
+  /// trees) are the same: whether one of their representatives would accept
+  /// the other, as when a genome is assigned to a species
+  template <typename N>
+  static bool sameSpecies (const N &lhs, const N &rhs) {
+    const double threshold = config::PTree::compatibilityThreshold();
+    for (const auto &l: lhs.rset) {
+      for (const auto &r: rhs.rset) {
+        double d = distance(l.genome, r.genome);
+        double c = std::min(l.genome.compatibility(d),
+                            r.genome.compatibility(d));
+        if (c >= threshold) return true;
+      }
+    }
+    return false;
+  }
+
+  /// \returns the (sorted) identificators present in both hierarchies \p lhs
+  /// and \p rhs whose species \p same deems identical. Symmetric if \p same
+  /// is (as sameSpecies): the matches of a pair of trees hold both ways
+  static std::vector<SID> matches (const Hierarchy &lhs, const Hierarchy &rhs,
+                                   const Matcher &same);
+
+  /// \returns the species matched in tree \p lhs (of hierarchy \p hl) and in
+  /// tree \p rhs (of hierarchy \p hr)
+  template <typename PT>
+  static std::vector<SID> matches (const PT &lhs, const Hierarchy &hl,
+                                   const PT &rhs, const Hierarchy &hr) {
+    return matches(hl, hr, [&lhs, &rhs] (SID sid) {
+      return sameSpecies(*lhs.nodeAt(sid), *rhs.nodeAt(sid));
+    });
+  }
+
+  /// \returns the differences of hierarchy \p lhs with respect to \p rhs,
+  /// given the species \p matched in both (see matches)
+  static TreeDiff compute (const Hierarchy &lhs, const Hierarchy &rhs,
+                           const std::vector<SID> &matched);
+
+  /// \returns the differences of hierarchy \p lhs with respect to \p rhs.
+  /// Species with the same identificator in both are only matched if \p same
+  /// agrees
+  static TreeDiff compute (const Hierarchy &lhs, const Hierarchy &rhs,
+                           const Matcher &same) {
+    return compute(lhs, rhs, matches(lhs, rhs, same));
+  }
+
+  /// \returns the differences of tree \p lhs (of hierarchy \p hl) with
+  /// respect to tree \p rhs (of hierarchy \p hr)
+  template <typename PT>
+  static TreeDiff compute (const PT &lhs, const Hierarchy &hl,
+                           const PT &rhs, const Hierarchy &hr) {
+    return compute(hl, hr, matches(lhs, hl, rhs, hr));
+  }
+
+  /// \returns the differences of tree \p lhs with respect to \p rhs
+  template <typename PT>
+  static TreeDiff compute (const PT &lhs, const PT &rhs) {
+    return compute(lhs, hierarchy(lhs), rhs, hierarchy(rhs));
+  }
+};
+
+} // end of namespace phylogeny
+
+#endif // KGD_TREEDIFF_H
@@ -0,0 +1,383 @@
+#include <cctype>
+#include <fstream>
+#include <iostream>
+
+#include "headlessrenderer.h"
+
+namespace render {
+
+// ============================================================================
+// == Constants
+// ============================================================================
+
+static constexpr Color WHITE = Color::rgb(255, 255, 255);
+
+/// Qt::gray
+static constexpr Color AXIS_COLOR = Color::rgb(160, 160, 164);
+
+/// Qt::darkGray
+static constexpr Color PATH_DEFAULT_COLOR = Color::rgb(128, 128, 128);
+
+/// Qt::red
+static constexpr Color PATH_SURVIVOR_COLOR = Color::rgb(255, 0, 0);
+
+/// Dash pattern of the legend axis (in pen widths, as Qt::DashLine)
+static constexpr float DASH_ON = 4, DASH_OFF = 2;
+
+/// \returns the fill color of the \p i-th legend disk
+static Color legendColor (uint i) {
+  double v = double(i) / LEGEND_TICKS;
+  return Color::mix(Color::rgb(0, 255 * (1 - v), 255 * v), WHITE, 16./255.);
+}
+
+
+// ============================================================================
+// == Data preparation
+// ============================================================================
+
+HeadlessRenderer::HeadlessRenderer (const TreeSnapshot &tree,
+                                    const RenderConfig &config)
+  : _tree(tree), _config(config), _slots(0), _radius(0) {
+  prepare();
+}
+
+void HeadlessRenderer::prepare (void) {
+  const auto &species = _tree.species;
+  const uint n = species.size();
+  const uint time = std::min(_tree.step, _config.clippingRange);
+  _items.resize(n);
+  _radius = std::max(1u, _tree.step);
+
+  for (uint i=0; i<n; i++) {
+    Item &it = _items[i];
+    it.alive = species[i].lastAppearance >= time;
+    it.onSurvivorPath = it.alive;
+    it.survivorEnd = species[i].firstAppearance;
+  }
+
+  // Propagate survivorship upwards (children always come after their parent)
+  for (uint i=n-1; i>0 && i<n; i--) {
+    const Item &it = _items[i];
+    if (!it.onSurvivorPath) continue;
+
+    Item &p = _items[species[i].parent];
+    p.onSurvivorPath = true;
+    p.survivorEnd = std::max(p.survivorEnd, species[i].firstAppearance);
+  }
+
+  // Filter and assign slots in depth-first order: as subtrees are contiguous
+  // this is the compact radial layout
+  std::vector<uint> slots (n);
+  for (uint i=0; i<n; i++) {
+    const TreeSnapshot::Species &s = species[i];
+    Item &it = _items[i];
+
+    if (it.alive) it.survivorEnd = s.lastAppearance;
+
+    it.visible =
+        (!_config.survivorsOnly || it.onSurvivorPath)
+        && s.lastAppearance - s.firstAppearance >= _config.minSurvival
+        && s.fullness >= _config.minEnveloppe
+        && s.firstAppearance <= _config.clippingRange
+        && (s.parent == uint(-1) || _items[s.parent].visible);
+
+    if (it.visible) slots[i] = _slots++;
+
+    it.pathColor = PATH_DEFAULT_COLOR;
+    it.timelineColors[0] = it.timelineColors[1] = PATH_DEFAULT_COLOR;
+    if (_config.color == RenderConfig::SURVIVORS && it.onSurvivorPath) {
+      it.pathColor = it.timelineColors[0] = PATH_SURVIVOR_COLOR;
+
+    } else if (_config.color == RenderConfig::CUSTOM) {
+      auto cit = _config.colorSpecs.find(s.id);
+      if (cit != _config.colorSpecs.end())
+        it.pathColor = it.timelineColors[0] = it.timelineColors[1] = cit->second;
+    }
+
+    it.named = _config.showNames
+        && (_config.color != RenderConfig::SURVIVORS || it.onSurvivorPath);
+  }
+
+  RadialCoordinates rc (_slots);
+  for (uint i=0; i<n; i++)
+    if (_items[i].visible)
+      _items[i].angle = rc.angle(slots[i]);
+}
+
+double HeadlessRenderer::margin (void) const {
+  return NODE_SIZE * nodeWidth(_radius);
+}
+
+double HeadlessRenderer::nodeRadius (uint i) const {
+  return NODE_RADIUS * _tree.species[i].fullness * nodeWidth(_radius);
+}
+
+bool HeadlessRenderer::renderTo (const std::string &filename) const {
+  std::string ext = filename.substr(filename.find_last_of('.') + 1);
+  for (char &c: ext)  c = std::tolower(c);
+
+  if (ext == "svg") return renderSVG(filename);
+  if (ext == "png") return renderPNG(filename);
+
+  std::cerr << "Unknown output format '" << ext << "' for headless rendering"
+            << " of '" << filename << "'" << std::endl;
+  return false;
+}
+
+
+// ============================================================================
+// == Vector output
+// ============================================================================
+
+namespace {
+
+/// Compact textual representation of \p v
+std::string num (double v) {
+  char buffer [32];
+  snprintf(buffer, sizeof(buffer), "%.7g", v);
+  return buffer;
+}
+
+/// Appends point \p (a,r) (in polar coordinates) to \p s
+void point (std::string &s, double a, double r) {
+  s += num(r * std::cos(a));
+  s += ' ';
+  s += num(r * std::sin(a));
+}
+
+/// All the lines (or plops) of a single color in a layer
+struct SVGPath {
+  Color color;    ///< Stroke color
+  std::string d;  ///< Path data
+};
+
+/// Lines grouped by color
+using SVGLayer = std::map<uint32_t, SVGPath>;
+
+/// \returns the path data for \p color in \p layer
+std::string& data (SVGLayer &layer, const Color &c) {
+  SVGPath &p = layer[c.key()];
+  p.color = c;
+  return p.d;
+}
+
+/// Writes \p layer as a group of paths with width \p width
+void write (std::ostream &os, const SVGLayer &layer, double width) {
+  os << "<g fill=\"none\" stroke-linecap=\"round\" stroke-linejoin=\"round\""
+        " stroke-width=\"" << num(width) << "\">\n";
+  for (const auto &p: layer)
+    os << "<path stroke=\"" << p.second.color.hex() << "\" d=\""
+       << p.second.d << "\"/>\n";
+  os << "</g>\n";
+}
+
+} // end of anonymous namespace
+
+bool HeadlessRenderer::renderSVG (const std::string &filename) const {
+  std::ofstream os (filename);
+  if (!os) {
+    std::cerr << "Failed to open '" << filename << "' for writing" << std::endl;
+    return false;
+  }
+
+  const double R = _radius, ext = R + margin();
+  const double aw = pathWidth(AXIS_WIDTH, R), pw = pathWidth(PATH_WIDTH, R);
+  const double plop = plopRadius(PATH_WIDTH, R);
+
+  os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+     << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\""
+     << " width=\"" << num(2*ext) << "\" height=\"" << num(2*ext) << "\""
+     << " viewBox=\"" << num(-ext) << " " << num(-ext) << " "
+                      << num(2*ext) << " " << num(2*ext) << "\">\n"
+     << "<rect x=\"" << num(-ext) << "\" y=\"" << num(-ext) << "\" width=\""
+     << num(2*ext) << "\" height=\"" << num(2*ext) << "\" fill=\"white\"/>\n";
+
+  // Legend disks, in reverse order so that they overlap correctly
+  for (uint i=LEGEND_TICKS; i>0; i--)
+    os << "<circle r=\"" << num(R * i / LEGEND_TICKS) << "\" fill=\""
+       << legendColor(i).hex() << "\"/>\n";
+
+  // Axis
+  os << "<g fill=\"none\" stroke=\"" << AXIS_COLOR.hex() << "\" stroke-width=\""
+     << num(aw) << "\" stroke-dasharray=\"" << num(DASH_ON * aw) << " "
+     << num(DASH_OFF * aw) << "\">\n";
+  std::string axis = "M0 0 L";
+  point(axis, LEGEND_PHASE, R);
+  os << "<path d=\"" << axis << "\"/>\n";
+  for (uint i=1; i<=LEGEND_TICKS; i++)
+    os << "<circle r=\"" << num(R * i / LEGEND_TICKS) << "\"/>\n";
+  os << "</g>\n";
+
+  // Tick values
+  os << "<g font-family=\"monospace\" font-size=\"" << num(fontSize(R))
+     << "\" text-anchor=\"middle\" dominant-baseline=\"central\""
+        " stroke=\"white\" stroke-width=\"" << num(.2 * fontSize(R))
+     << "\" paint-order=\"stroke\">\n";
+  for (uint i=1; i<=LEGEND_TICKS; i++) {
+    double h = R * i / LEGEND_TICKS;
+    os << "<text x=\"" << num(h * std::cos(LEGEND_PHASE)) << "\" y=\""
+       << num(h * std::sin(LEGEND_PHASE)) << "\">" << prettyNumber(h)
+       << "</text>\n";
+  }
+  os << "</g>\n";
+
+  // Timelines and paths: extinct then survivors
+  const auto &species = _tree.species;
+  for (bool survivors: {false, true}) {
+    SVGLayer timelines, paths, plops;
+    for (uint i=0; i<species.size(); i++) {
+      const TreeSnapshot::Species &s = species[i];
+      const Item &it = _items[i];
+      if (!it.visible || it.onSurvivorPath != survivors)  continue;
+
+      const double a = it.angle;
+      const uint r[3] = { s.firstAppearance, it.survivorEnd, s.lastAppearance };
+      for (uint k=0; k<2; k++) {
+        if (r[k] == r[k+1]) continue;
+        std::string &d = data(timelines, it.timelineColors[k]);
+        d += 'M', point(d, a, r[k]), d += 'L', point(d, a, r[k+1]);
+      }
+      std::string &d = data(plops, it.timelineColors[r[1] != r[2]]);
+      d += 'M', point(d, a, r[2]), d += "h0";
+
+      if (s.parent == uint(-1)) continue;
+      const double a0 = _items[s.parent].angle, r0 = s.firstAppearance;
+      std::string &pd = data(paths, it.pathColor);
+      pd += 'M', point(pd, a0, r0);
+      pd += 'A' + num(r0) + ' ' + num(r0) + " 0 "
+          + (std::fabs(a - a0) > M_PI ? "1 " : "0 ") + (a > a0 ? "1 " : "0 ");
+      point(pd, a, r0);
+
+      std::string &p = data(plops, it.pathColor);
+      p += 'M', point(p, a0, r0), p += "h0";
+    }
+
+    write(os, timelines, pw);
+    write(os, paths, pw);
+    write(os, plops, 2 * plop);
+  }
+
+  // Species nodes: extinct then survivors
+  for (bool survivors: {false, true}) {
+    os << "<g fill=\"white\" font-family=\"sans-serif\" text-anchor=\"middle\""
+          " dominant-baseline=\"central\">\n";
+    for (uint i=0; i<species.size(); i++) {
+      const Item &it = _items[i];
+      if (!it.visible || !it.named || it.onSurvivorPath != survivors) continue;
+
+      double nr = nodeRadius(i), scale = nr / NODE_RADIUS;
+      if (nr <= 0)  continue;
+
+      const TreeSnapshot::Species &s = species[i];
+      std::string x = num(s.firstAppearance * std::cos(it.angle)),
+                  y = num(s.firstAppearance * std::sin(it.angle));
+      os << "<circle cx=\"" << x << "\" cy=\"" << y << "\" r=\"" << num(nr)
+         << "\" stroke=\"" << it.pathColor.hex() << "\" stroke-width=\""
+         << num(scale) << "\"/>\n"
+         << "<text x=\"" << x << "\" y=\"" << y << "\" fill=\"black\""
+            " font-size=\"" << num(12 * scale) << "\">" << s.id << "</text>\n";
+    }
+    os << "</g>\n";
+  }
+
+  os << "</svg>\n";
+  return bool(os);
+}
+
+
+// ============================================================================
+// == Raster output
+// ============================================================================
+
+void HeadlessRenderer::rasterize (RasterImage &image) const {
+  const double R = _radius;
+  const double aw = pathWidth(AXIS_WIDTH, R), pw = pathWidth(PATH_WIDTH, R);
+  const double plop = plopRadius(PATH_WIDTH, R);
+
+  // Legend disks, in reverse order so that they overlap correctly
+  for (uint i=LEGEND_TICKS; i>0; i--)
+    image.fillDisk(0, 0, R * i / LEGEND_TICKS, legendColor(i));
+
+  // Dashed axis
+  const double on = DASH_ON * aw, period = (DASH_ON + DASH_OFF) * aw;
+  const double ca = std::cos(LEGEND_PHASE), sa = std::sin(LEGEND_PHASE);
+  for (double l=0; l<R; l+=period) {
+    double l1 = std::min(R, l + on);
+    image.drawLine(l * ca, l * sa, l1 * ca, l1 * sa, aw, AXIS_COLOR);
+  }
+  for (uint i=1; i<=LEGEND_TICKS; i++) {
+    double h = R * i / LEGEND_TICKS;
+    for (double a=0; a<2*M_PI; a+=period/h)
+      image.drawArc(h, a, std::min(2*M_PI, a + on/h), aw, AXIS_COLOR);
+  }
+
+  // Tick values (with a white halo, as in vector outputs)
+  const double fs = fontSize(R);
+  for (uint i=1; i<=LEGEND_TICKS; i++) {
+    double h = R * i / LEGEND_TICKS;
+    std::string v = prettyNumber(h);
+    image.drawText(h * ca, h * sa, v, fs, WHITE, .1 * fs);
+    image.drawText(h * ca, h * sa, v, fs, Color::rgb(0, 0, 0));
+  }
+
+  // Timelines and paths: extinct then survivors
+  const auto &species = _tree.species;
+  for (bool survivors: {false, true}) {
+    for (uint i=0; i<species.size(); i++) {
+      const TreeSnapshot::Species &s = species[i];
+      const Item &it = _items[i];
+      if (!it.visible || it.onSurvivorPath != survivors)  continue;
+
+      const double ca = std::cos(it.angle), sa = std::sin(it.angle);
+      const uint r[3] = { s.firstAppearance, it.survivorEnd, s.lastAppearance };
+      for (uint k=0; k<2; k++)
+        if (r[k] != r[k+1])
+          image.drawLine(r[k] * ca, r[k] * sa, r[k+1] * ca, r[k+1] * sa,
+                         pw, it.timelineColors[k]);
+      image.fillDisk(r[2] * ca, r[2] * sa, plop,
+                     it.timelineColors[r[1] != r[2]]);
+    }
+
+    for (uint i=0; i<species.size(); i++) {
+      const TreeSnapshot::Species &s = species[i];
+      const Item &it = _items[i];
+      if (!it.visible || it.onSurvivorPath != survivors
+          || s.parent == uint(-1))  continue;
+
+      const double a0 = _items[s.parent].angle, r0 = s.firstAppearance;
+      image.drawArc(r0, a0, it.angle, pw, it.pathColor);
+      image.fillDisk(r0 * std::cos(a0), r0 * std::sin(a0), plop, it.pathColor);
+    }
+  }
+
+  // Species nodes: extinct then survivors
+  for (bool survivors: {false, true}) {
+    for (uint i=0; i<species.size(); i++) {
+      const Item &it = _items[i];
+      if (!it.visible || !it.named || it.onSurvivorPath != survivors) continue;
+
+      double nr = nodeRadius(i), scale = nr / NODE_RADIUS;
+      if (nr <= 0)  continue;
+
+      double r = species[i].firstAppearance;
+      double x = r * std::cos(it.angle), y = r * std::sin(it.angle);
+      image.fillDisk(x, y, nr + .5 * scale, it.pathColor);
+      image.fillDisk(x, y, nr - .5 * scale, WHITE);
+      image.drawText(x, y, std::to_string(uint(species[i].id)), 12 * scale,
+                     Color::rgb(0, 0, 0));
+    }
+  }
+}
+
+bool HeadlessRenderer::renderPNG (const std::string &filename) const {
+  const double ext = _radius + margin();
+  const double scale = _config.rasterRadius / _radius;
+  const uint size = std::ceil(2 * ext * scale);
+
+  RasterImage image (size, size, WHITE);
+  image.setTransform(scale, .5 * size, .5 * size);
+  rasterize(image);
+  return image.savePNG(filename);
+}
+
+} // end of namespace render
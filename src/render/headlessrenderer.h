@@ -0,0 +1,187 @@
+#ifndef KGD_HEADLESS_RENDERER_H
+#define KGD_HEADLESS_RENDERER_H
+
+#include <map>
+
+#include "../core/tree/phylogenetictree.hpp"
+#include "radiallayout.h"
+#include "rasterimage.h"
+
+/*!
+ * \file headlessrenderer.h
+ *
+ * Qt-free rendering of phylogenetic trees into SVG or PNG files, for use on
+ * machines without any graphical stack (e.g. cluster builds)
+ */
+
+namespace render {
+
+/// Subset of gui::ViewerConfig that makes sense for static renderings
+struct RenderConfig {
+
+  /// Minimal survival a species must have to be shown
+  uint minSurvival = 0;
+
+  /// Minimal enveloppe fullness a species must have to be shown
+  float minEnveloppe = 0;
+
+  /// Maximal range for survival monitoring
+  uint clippingRange = -1;
+
+  /// Whether only show paths leading to still alive species
+  bool survivorsOnly = false;
+
+  /// Whether to display nodes
+  bool showNames = true;
+
+  /// Tree rasterized radius (in pixels) when rendering to PNG
+  float rasterRadius = 1000;
+
+  /// Values for the node/timelines color
+  enum Colors {
+    NONE = 0, ///< No color
+    SURVIVORS = 1,  ///< Color survivor paths in red
+    CUSTOM = 2  ///< Color path from specific species
+  };
+  Colors color = Colors::SURVIVORS; ///< Current color mode
+
+  /// Custom colors for specific species (used in CUSTOM mode)
+  std::map<phylogeny::SID, Color> colorSpecs;
+};
+
+/// Flat, read-only, copy of the data in a phylogenetic tree that is needed
+/// for rendering
+struct TreeSnapshot {
+
+  /// Rendering data for a single species
+  struct Species {
+    phylogeny::SID id;    ///< Species identificator
+    uint parent;          ///< Index of the parent species (-1 for the root)
+    uint firstAppearance; ///< Time at which the species appeared
+    uint lastAppearance;  ///< Time at which the species was last seen
+    float fullness;       ///< Ratio of filled enveloppe points
+  };
+
+  /// All species in depth-first order (parents before children) with the
+  /// children visited in the same order as in the graphical viewer
+  std::vector<Species> species;
+
+  /// Current time step of the tree
+  uint step = 0;
+
+  /// Extracts the relevant data from \p ptree
+  template <typename GENOME, typename UDATA>
+  static TreeSnapshot from (const phylogeny::PhylogeneticTree<GENOME, UDATA> &ptree) {
+    using Node_ptr = typename phylogeny::PhylogeneticTree<GENOME, UDATA>::Node_ptr;
+    TreeSnapshot s;
+    s.step = ptree.step();
+    if (!ptree.root())  return s;
+
+    std::vector<std::pair<const Node_ptr*, uint>> stack { { &ptree.root(), -1 } };
+    while (!stack.empty()) {
+      const Node_ptr &n = *stack.back().first;
+      uint parent = stack.back().second;
+      stack.pop_back();
+
+      uint index = s.species.size();
+      s.species.push_back({
+        n->id(), parent, n->data.firstAppearance, n->data.lastAppearance,
+        float(n->rset.size()) / config::PTree::rsetSize()
+      });
+
+      // The viewer shows the most recent subspecies first: pushing children
+      // in insertion order pops them in reverse
+      for (const Node_ptr &c: n->children())  stack.push_back({ &c, index });
+    }
+    return s;
+  }
+};
+
+/// Draws a phylogenetic tree, as the graphical viewer would, without relying
+/// on Qt.
+///
+/// Species are laid out compactly (as with gui::ViewerConfig::layoutSlack set
+/// to zero) and drawn by layers: extinct then survivor timelines and paths,
+/// then the nodes. Vector outputs group every line of a given color into a
+/// single element so that files remain manageable for very large trees.
+///
+/// \note PNG outputs draw the legend values and species names with a minimal
+/// bitmap font (see RasterImage::drawText)
+///
+/// \note Only the species, their names and the legend are drawn: no tracking
+/// wedges (custom colors only apply to the paths), levels of detail or
+/// contributors, and no PDF output
+class HeadlessRenderer {
+public:
+  /// Prepares the rendering of \p tree with options \p config
+  HeadlessRenderer (const TreeSnapshot &tree,
+                    const RenderConfig &config = RenderConfig());
+
+  /// \overload
+  template <typename GENOME, typename UDATA>
+  HeadlessRenderer (const phylogeny::PhylogeneticTree<GENOME, UDATA> &ptree,
+                    const RenderConfig &config = RenderConfig())
+    : HeadlessRenderer(TreeSnapshot::from(ptree), config) {}
+
+  /// \returns the number of species that will be drawn
+  uint visibleSpecies (void) const {
+    return _slots;
+  }
+
+  /// Writes the tree to \p filename, as an SVG file
+  /// \returns whether writing succeeded
+  bool renderSVG (const std::string &filename) const;
+
+  /// Writes the tree to \p filename, as a PNG file
+  /// \returns whether writing succeeded
+  bool renderPNG (const std::string &filename) const;
+
+  /// Draws the tree into \p image (whose transform is left untouched)
+  void rasterize (RasterImage &image) const;
+
+  /// Writes the tree to \p filename in a format deduced from its extension
+  /// (svg or png)
+  /// \returns whether writing succeeded
+  bool renderTo (const std::string &filename) const;
+
+private:
+  /// Per-species geometric and display data
+  struct Item {
+    bool alive;           ///< Whether the species is still alive
+    bool onSurvivorPath;  ///< Whether a living species descends from this one
+    bool visible;         ///< Whether the species passes all filters
+    bool named;           ///< Whether to draw the species node
+    double angle;         ///< Angular position
+    uint survivorEnd;     ///< End of the survivor part of the timeline
+    Color pathColor;      ///< Color of the path from the parent species
+    Color timelineColors [2]; ///< Colors of the two timeline parts
+  };
+
+  /// The tree data
+  const TreeSnapshot _tree;
+
+  /// The rendering options
+  const RenderConfig _config;
+
+  /// Display data (same order as TreeSnapshot::species)
+  std::vector<Item> _items;
+
+  /// Number of visible species (and thus of layout slots)
+  uint _slots;
+
+  /// Radius of the tree (i.e. current time step)
+  double _radius;
+
+  /// Computes visibility, survivorship, colors and positions
+  void prepare (void);
+
+  /// Margin around the tree (in scene units)
+  double margin (void) const;
+
+  /// \returns the radius at which a species' node is drawn
+  double nodeRadius (uint i) const;
+};
+
+} // end of namespace render
+
+#endif // KGD_HEADLESS_RENDERER_H
@@ -0,0 +1,195 @@
+#include <iostream>
+
+#include "pngwriter.h"
+
+namespace render {
+
+namespace {
+
+/// \returns the CRC32 (as defined by the PNG specification) of \p data
+uint32_t crc32 (const uint8_t *data, size_t n, uint32_t crc = 0xFFFFFFFF) {
+  static const auto table = [] {
+    std::vector<uint32_t> t (256);
+    for (uint32_t i=0; i<256; i++) {
+      uint32_t c = i;
+      for (int k=0; k<8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  for (size_t i=0; i<n; i++)  crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+/// Appends \p v to \p out in big endian order
+void putU32 (std::vector<uint8_t> &out, uint32_t v) {
+  for (int s=24; s>=0; s-=8) out.push_back((v >> s) & 0xFF);
+}
+
+} // end of anonymous namespace
+
+PNGWriter::PNGWriter (const std::string &filename, uint width, uint height,
+                      bool alpha)
+  : _ofs(filename, std::ios::binary), _width(width), _height(height),
+    _channels(alpha ? 4 : 3), _rows(0), _closed(false), _bitBuffer(0), _bitCount(0),
+    _adlerA(1), _adlerB(0) {
+
+  if (!_ofs) {
+    std::cerr << "Failed to open '" << filename << "' for writing" << std::endl;
+    return;
+  }
+
+  static constexpr uint8_t signature [] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'
+  };
+  _ofs.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+  std::vector<uint8_t> header;
+  putU32(header, _width);
+  putU32(header, _height);
+  // 8 bits RGB(A), no interlace
+  header.insert(header.end(), { 8, uint8_t(_channels == 4 ? 6 : 2), 0, 0, 0 });
+  chunk("IHDR", header);
+
+  _out = { 0x78, 0x01 };  // zlib header
+  bits(1, 1); // Final block
+  bits(1, 2); // Fixed huffman codes
+}
+
+PNGWriter::~PNGWriter (void) {
+  if (!_closed) close();
+}
+
+void PNGWriter::writeRows (const uint8_t *pixels, uint rows) {
+  if (!good())  return;
+
+  // Keep the previous row for back-references
+  const size_t bytes = _channels * size_t(_width), stride = 1 + bytes;
+  size_t kept = std::min(_raw.size(), stride);
+  _raw.erase(_raw.begin(), _raw.end() - kept);
+
+  for (uint j=0; j<rows; j++) {
+    _raw.push_back(0);  // No filtering
+    _raw.insert(_raw.end(), pixels + j * bytes, pixels + (j+1) * bytes);
+  }
+  _rows += rows;
+
+  for (size_t i=kept; i<_raw.size(); i++)
+    _adlerA = (_adlerA + _raw[i]) % 65521, _adlerB = (_adlerB + _adlerA) % 65521;
+
+  compress(kept);
+  chunk("IDAT", _out);
+  _out.clear();
+}
+
+bool PNGWriter::close (void) {
+  _closed = true;
+  if (!good())  return false;
+
+  if (_rows != _height) {
+    std::cerr << "PNG stream closed after " << _rows << " rows instead of "
+              << _height << std::endl;
+    _ofs.setstate(std::ios::failbit);
+    return false;
+  }
+
+  symbol(256);
+  if (_bitCount > 0)  _out.push_back(_bitBuffer & 0xFF);
+  _bitBuffer = 0, _bitCount = 0;
+  putU32(_out, (_adlerB << 16) | _adlerA);
+  chunk("IDAT", _out);
+  chunk("IEND", {});
+
+  _ofs.close();
+  return !_ofs.fail();
+}
+
+void PNGWriter::bits (uint32_t v, int n) {
+  _bitBuffer |= v << _bitCount;
+  _bitCount += n;
+  while (_bitCount >= 8) {
+    _out.push_back(_bitBuffer & 0xFF);
+    _bitBuffer >>= 8;
+    _bitCount -= 8;
+  }
+}
+
+void PNGWriter::code (uint32_t code, int n) {
+  uint32_t r = 0;
+  for (int i=0; i<n; i++) r |= ((code >> i) & 1) << (n - 1 - i);
+  bits(r, n);
+}
+
+void PNGWriter::symbol (uint s) {
+  if (s < 144)      code(0x30 + s, 8);
+  else if (s < 256) code(0x190 + s - 144, 9);
+  else if (s < 280) code(s - 256, 7);
+  else              code(0xC0 + s - 280, 8);
+}
+
+void PNGWriter::match (uint length, uint distance) {
+  static constexpr uint lBase [] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+    67, 83, 99, 115, 131, 163, 195, 227, 258
+  };
+  static constexpr uint lExtra [] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+    5, 5, 5, 5, 0
+  };
+  static constexpr uint dBase [] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+    769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+  };
+  static constexpr uint dExtra [] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+    11, 11, 12, 12, 13, 13
+  };
+
+  uint l = 28;
+  while (lBase[l] > length) l--;
+  symbol(257 + l);
+  bits(length - lBase[l], lExtra[l]);
+
+  uint d = 29;
+  while (dBase[d] > distance) d--;
+  code(d, 5);
+  bits(distance - dBase[d], dExtra[d]);
+}
+
+void PNGWriter::compress (size_t begin) {
+  const size_t stride = 1 + _channels * size_t(_width);
+  const auto runLength = [this] (size_t i, size_t distance) {
+    size_t l = 0;
+    while (l < 258 && i + l < _raw.size() && _raw[i+l] == _raw[i+l-distance])
+      l++;
+    return l;
+  };
+
+  size_t i = begin;
+  while (i < _raw.size()) {
+    size_t best = 0, distance = 0;
+    for (size_t d: { size_t(_channels), stride }) {
+      if (d > i || d > 32768) continue;
+      size_t l = runLength(i, d);
+      if (l > best) best = l, distance = d;
+    }
+
+    if (best >= 3) {
+      match(best, distance);
+      i += best;
+    } else
+      symbol(_raw[i++]);
+  }
+}
+
+void PNGWriter::chunk (const char *type, const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> bytes;
+  putU32(bytes, data.size());
+  bytes.insert(bytes.end(), type, type + 4);
+  bytes.insert(bytes.end(), data.begin(), data.end());
+  putU32(bytes, ~crc32(bytes.data() + 4, bytes.size() - 4));
+  _ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+} // end of namespace render
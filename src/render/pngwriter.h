@@ -0,0 +1,105 @@
+#ifndef KGD_PNG_WRITER_H
+#define KGD_PNG_WRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/*!
+ * \file pngwriter.h
+ *
+ * Streaming PNG encoder for 8-bit RGB(A) images
+ */
+
+namespace render {
+
+/// Writes a PNG file row by row so that images larger than the available
+/// memory can be produced (e.g. band by band).
+///
+/// Compression is a single fixed-huffman deflate stream which only looks for
+/// repetitions of the previous pixel or row: fast and very effective on the
+/// large uniform areas of tree renderings.
+class PNGWriter {
+public:
+  /// Opens \p filename for an image of \p width x \p height pixels, with
+  /// an \p alpha channel or not
+  PNGWriter (const std::string &filename, uint width, uint height,
+             bool alpha = false);
+
+  /// Closes the file, if still open
+  ~PNGWriter (void);
+
+  /// \returns whether no error has occurred so far
+  bool good (void) const {
+    return bool(_ofs);
+  }
+
+  /// Appends \p rows rows of channels() * width() bytes
+  void writeRows (const uint8_t *pixels, uint rows);
+
+  /// Finalizes the file (which must have received exactly height() rows)
+  /// \returns whether writing succeeded
+  bool close (void);
+
+  /// \returns the image width
+  uint width (void) const {   return _width;  }
+
+  /// \returns the image height
+  uint height (void) const {  return _height; }
+
+  /// \returns the number of bytes per pixel (3 for RGB, 4 for RGBA)
+  uint channels (void) const {  return _channels; }
+
+private:
+  /// Destination
+  std::ofstream _ofs;
+
+  const uint _width;  ///< Image width
+  const uint _height; ///< Image height
+  const uint _channels; ///< Bytes per pixel
+
+  /// Number of rows written so far
+  uint _rows;
+
+  /// Whether close() has been called
+  bool _closed;
+
+  /// Compressed bytes not yet written
+  std::vector<uint8_t> _out;
+
+  /// Uncompressed bytes (last row of the previous call and current rows)
+  std::vector<uint8_t> _raw;
+
+  /// Pending bits (less than a byte)
+  uint32_t _bitBuffer;
+
+  /// Number of pending bits
+  int _bitCount;
+
+  /// Running adler32 checksum of the uncompressed stream
+  uint32_t _adlerA, _adlerB;
+
+  /// Appends the \p n lowest bits of \p v
+  void bits (uint32_t v, int n);
+
+  /// Appends the \p n bits huffman code \p code (most significant first)
+  void code (uint32_t code, int n);
+
+  /// Writes literal/length symbol \p s with the fixed huffman codes
+  void symbol (uint s);
+
+  /// Writes a back-reference of \p length bytes \p distance bytes behind
+  void match (uint length, uint distance);
+
+  /// Compresses _raw from index \p begin
+  void compress (size_t begin);
+
+  /// Writes a chunk of type \p type with contents \p data
+  void chunk (const char *type, const std::vector<uint8_t> &data);
+};
+
+} // end of namespace render
+
+#endif // KGD_PNG_WRITER_H
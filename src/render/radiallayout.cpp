@@ -0,0 +1,37 @@
+#include <cstdio>
+
+#include "radiallayout.h"
+
+namespace render {
+
+/// Splits \p n into its integral (\p n) and first decimal (\p d) parts in
+/// units of \p e
+static void format (float &n, float &d, float e) {
+  float n_ = std::floor(n / e);
+  d = 10 * (n - e * n_) / e;
+  n = n_;
+}
+
+/// \returns \p v formatted with printf format \p f
+static std::string number (const char *f, double v) {
+  char buffer [32];
+  snprintf(buffer, sizeof(buffer), f, v);
+  return buffer;
+}
+
+std::string prettyNumber (float n) {
+  if (n < 1e3)        return number("%g", n);
+  else if (n > 1e12)  return number("%.3e", n);
+
+  float d = 0;
+  std::string u = "";
+  if (n < 1e6)        format(n, d, 1e3), u = "K";
+  else if (n < 1e9)   format(n, d, 1e6), u = "M";
+  else if (n < 1e12)  format(n, d, 1e9), u = "G";
+
+  std::string res = number("%g", n) + u;
+  if (d > 0)  res += " " + number("%g", d);
+  return res;
+}
+
+} // end of namespace render
@@ -0,0 +1,91 @@
+#ifndef KGD_RADIAL_LAYOUT_H
+#define KGD_RADIAL_LAYOUT_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <sys/types.h>
+
+/*!
+ * \file radiallayout.h
+ *
+ * Qt-free geometry shared by the graphical viewer and the headless renderer:
+ * radial slots, legend placement and the radius-dependent drawing sizes
+ */
+
+namespace render {
+
+// == Legend ========================================================
+
+///< Note that the coordinate system is inverted (y points downward)
+static constexpr float LEGEND_PHASE = -M_PI / 2;
+static constexpr float LEGEND_SPACE = M_PI / 12;
+static constexpr uint LEGEND_TICKS = 4;
+
+// == Nodes style ===================================================
+
+static constexpr float NODE_RADIUS = 10;
+static constexpr float NODE_MARGIN = 2;
+static constexpr float NODE_SIZE = 2 * (NODE_RADIUS + NODE_MARGIN);
+
+// == Paint style ===================================================
+
+static constexpr float AXIS_WIDTH = 1;
+static constexpr float PATH_WIDTH = 1.5;
+static constexpr float CONN_WIDTH = 2 * PATH_WIDTH;
+
+/// Maps layout slots to angles. Slot 0 sits right after the legend axis and
+/// the others follow at constant angular intervals
+struct RadialCoordinates {
+
+  /// The angular phase used in coordinate computation.
+  /// Inverted to cope with Qt coordinate system.
+  static constexpr float phase = LEGEND_PHASE + LEGEND_SPACE/2.;
+
+  const double slotAngle; ///< Angular width of a single slot
+
+  /// Creates a polar coordinates object spreading \p slots slots over the
+  /// graph (legend excluded)
+  RadialCoordinates (uint slots)
+    : slotAngle(slots > 0 ? (2 * M_PI - LEGEND_SPACE) / slots : 0) {}
+
+  /// \returns The angle of slot \p slot
+  double angle (uint slot) const {
+    return phase + slot * slotAngle;
+  }
+
+  /// \returns The angle for \p in the range [phase,2&pi;+phase]
+  static double primaryAngle (double a) {
+    while (a < phase) a += 2 * M_PI;
+    while (a > 2 * M_PI + phase) a -= 2 * M_PI;
+    return a;
+  }
+};
+
+/// \returns the width of a line of base width \p baseWidth in a tree of
+/// radius \p radius
+inline float pathWidth (float baseWidth, float radius) {
+  return baseWidth * radius / 400.;
+}
+
+/// \returns the radius of the disk drawn at the extremities of paths
+inline float plopRadius (float baseWidth, float radius) {
+  return .5 * CONN_WIDTH * pathWidth(baseWidth, radius);
+}
+
+/// \returns the scale of a full node in a tree of radius \p radius
+inline float nodeWidth (float radius) {
+  return radius / (NODE_SIZE * 20);
+}
+
+/// \returns the legend font size in a tree of radius \p radius
+inline float fontSize (float radius) {
+  return std::max(1.f, radius / 50);
+}
+
+/// \returns a compact, human-readable, representation of \p n (e.g. 12K 5)
+std::string prettyNumber (float n);
+
+} // end of namespace render
+
+#endif // KGD_RADIAL_LAYOUT_H
@@ -0,0 +1,300 @@
+#include <cmath>
+
+#include "rasterimage.h"
+#include "pngwriter.h"
+
+namespace render {
+
+// ============================================================================
+// == Colors
+// ============================================================================
+
+Color Color::mix (const Color &lhs, const Color &rhs, double r) {
+  return Color::rgb(
+    r * lhs.r + (1-r) * rhs.r,
+    r * lhs.g + (1-r) * rhs.g,
+    r * lhs.b + (1-r) * rhs.b
+  );
+}
+
+std::string Color::hex (void) const {
+  static constexpr char digits [] = "0123456789abcdef";
+  std::string s = "#";
+  for (uint8_t c: {r, g, b}) s += digits[c >> 4], s += digits[c & 15];
+  return s;
+}
+
+
+// ============================================================================
+// == Rasterization
+// ============================================================================
+
+RasterImage::RasterImage (uint width, uint height, Color background)
+  : _width(width), _height(height), _pixels(3 * width * height),
+    _scale(1), _dx(0), _dy(0) {
+
+  for (size_t i=0; i<_pixels.size(); i+=3) {
+    _pixels[i] = background.r;
+    _pixels[i+1] = background.g;
+    _pixels[i+2] = background.b;
+  }
+}
+
+void RasterImage::setTransform (double scale, double dx, double dy) {
+  _scale = scale;
+  _dx = dx;
+  _dy = dy;
+}
+
+void RasterImage::blend (int x, int y, Color c, double coverage) {
+  if (coverage <= 0) return;
+  double a = coverage * c.a / 255.;
+  uint8_t *p = &_pixels[3 * (size_t(y) * _width + x)];
+  p[0] = std::lround(p[0] + a * (c.r - p[0]));
+  p[1] = std::lround(p[1] + a * (c.g - p[1]));
+  p[2] = std::lround(p[2] + a * (c.b - p[2]));
+}
+
+bool RasterImage::clipRows (double y0, double y1, int &r0, int &r1) const {
+  r0 = std::max(0., std::floor(y0));
+  r1 = std::min(double(_height) - 1, std::ceil(y1));
+  return r0 <= r1;
+}
+
+bool RasterImage::clipColumns (double x0, double x1, int &c0, int &c1) const {
+  c0 = std::max(0., std::floor(x0));
+  c1 = std::min(double(_width) - 1, std::ceil(x1));
+  return c0 <= c1;
+}
+
+/// \returns the coverage of a pixel whose center lies at distance \p d from
+/// the medial axis of a shape with half-width \p h
+static double coverage (double d, double h) {
+  return std::min(1., std::max(0., h + .5 - d));
+}
+
+/// \returns the half-width, in pixels, of a line of (scene) width \p w so that
+/// even very thin lines remain visible
+static double halfWidth (double w, double scale) {
+  return std::max(.35, .5 * w * scale);
+}
+
+void RasterImage::fillDisk (double x, double y, double r, Color c) {
+  double cx = _scale * x + _dx, cy = _scale * y + _dy, R = _scale * r;
+
+  int r0, r1;
+  if (!clipRows(cy - R - 1, cy + R + 1, r0, r1)) return;
+  for (int j=r0; j<=r1; j++) {
+    double dy = j + .5 - cy, e = (R + 1) * (R + 1) - dy * dy;
+    if (e < 0)  continue;
+
+    int c0, c1;
+    double half = std::sqrt(e);
+    if (!clipColumns(cx - half, cx + half, c0, c1)) continue;
+    for (int i=c0; i<=c1; i++) {
+      double dx = i + .5 - cx;
+      blend(i, j, c, coverage(std::sqrt(dx*dx + dy*dy), R));
+    }
+  }
+}
+
+void RasterImage::drawLine (double x0, double y0, double x1, double y1,
+                            double w, Color c) {
+  x0 = _scale * x0 + _dx, y0 = _scale * y0 + _dy;
+  x1 = _scale * x1 + _dx, y1 = _scale * y1 + _dy;
+  double h = halfWidth(w, _scale), m = h + 1;
+
+  double vx = x1 - x0, vy = y1 - y0, l2 = vx * vx + vy * vy;
+
+  int r0, r1;
+  if (!clipRows(std::min(y0, y1) - m, std::max(y0, y1) + m, r0, r1)) return;
+  for (int j=r0; j<=r1; j++) {
+    double yc = j + .5;
+
+    // Points closer than m to the segment project onto its part whose
+    // ordinates are in [yc-m, yc+m]
+    double ta = 0, tb = 1;
+    if (std::fabs(vy) > 1e-9) {
+      ta = (yc - m - y0) / vy, tb = (yc + m - y0) / vy;
+      if (ta > tb)  std::swap(ta, tb);
+      ta = std::max(0., ta), tb = std::min(1., tb);
+      if (ta > tb)  continue;
+    }
+    double xa = x0 + ta * vx, xb = x0 + tb * vx;
+
+    int c0, c1;
+    if (!clipColumns(std::min(xa, xb) - m, std::max(xa, xb) + m, c0, c1))
+      continue;
+
+    for (int i=c0; i<=c1; i++) {
+      double px = i + .5 - x0, py = yc - y0;
+      double t = l2 > 0 ? std::min(1., std::max(0., (px*vx + py*vy) / l2)) : 0;
+      double dx = px - t * vx, dy = py - t * vy;
+      blend(i, j, c, coverage(std::sqrt(dx*dx + dy*dy), h));
+    }
+  }
+}
+
+void RasterImage::drawArc (double r, double a0, double a1, double w, Color c) {
+  if (a1 < a0)  std::swap(a0, a1);
+  drawArc(r, a0, a1, w, c, a1 - a0 >= 2 * M_PI);
+}
+
+void RasterImage::drawCircle (double r, double w, Color c) {
+  drawArc(r, 0, 2 * M_PI, w, c, true);
+}
+
+void RasterImage::drawArc (double r, double a0, double a1, double w, Color c,
+                           bool full) {
+  double R = _scale * r, h = halfWidth(w, _scale), m = h + 1;
+  double span = a1 - a0;
+
+  // Bounding box of the arc
+  double ex0 = R * std::cos(a0), ey0 = R * std::sin(a0),
+         ex1 = R * std::cos(a1), ey1 = R * std::sin(a1);
+  double xmin = -R, xmax = R, ymin = -R, ymax = R;
+  if (!full) {
+    xmin = std::min(ex0, ex1), xmax = std::max(ex0, ex1);
+    ymin = std::min(ey0, ey1), ymax = std::max(ey0, ey1);
+    for (int k=-4; k<=4; k++) {
+      double a = k * M_PI / 2;
+      if (a < a0 || a1 < a) continue;
+      double x = R * std::cos(a), y = R * std::sin(a);
+      xmin = std::min(xmin, x), xmax = std::max(xmax, x);
+      ymin = std::min(ymin, y), ymax = std::max(ymax, y);
+    }
+  }
+
+  int r0, r1;
+  if (!clipRows(_dy + ymin - m, _dy + ymax + m, r0, r1)) return;
+  for (int j=r0; j<=r1; j++) {
+    double dy = j + .5 - _dy;
+    double outer = (R + m) * (R + m) - dy * dy;
+    if (outer < 0)  continue;
+    outer = std::sqrt(outer);
+
+    double inner = R - m > std::fabs(dy) ? std::sqrt((R-m)*(R-m) - dy*dy) : 0;
+
+    // Left and right parts of the annulus on this row (which may touch)
+    int last = -1;
+    for (int side: {-1, 1}) {
+      double xa = side * inner, xb = side * outer;
+      if (xa > xb)  std::swap(xa, xb);
+      xa = std::max(xa, xmin - m), xb = std::min(xb, xmax + m);
+
+      int c0, c1;
+      if (!clipColumns(_dx + xa, _dx + xb, c0, c1))  continue;
+      c0 = std::max(c0, last + 1);
+      last = c1;
+
+      for (int i=c0; i<=c1; i++) {
+        double dx = i + .5 - _dx, d;
+        double rho = std::sqrt(dx*dx + dy*dy);
+
+        double da = full ? 0 : std::atan2(dy, dx) - a0;
+        while (da < 0) da += 2 * M_PI;
+        while (da >= 2 * M_PI) da -= 2 * M_PI;
+
+        if (full || da <= span)
+          d = std::fabs(rho - R);
+        else {
+          double d0x = dx - ex0, d0y = dy - ey0,
+                 d1x = dx - ex1, d1y = dy - ey1;
+          d = std::sqrt(std::min(d0x*d0x + d0y*d0y, d1x*d1x + d1y*d1y));
+        }
+        blend(i, j, c, coverage(d, h));
+      }
+    }
+  }
+}
+
+/// 5x7 bitmap glyph (one byte per row, most significant of 5 bits on the left)
+struct Glyph {
+  char c;           ///< The character
+  uint8_t rows [7]; ///< The bitmap
+};
+
+/// The characters needed to write numbers (see prettyNumber)
+static constexpr Glyph GLYPHS [] = {
+  { '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+  { '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+  { '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+  { '3', { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E } },
+  { '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+  { '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+  { '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+  { '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+  { '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+  { '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+  { '.', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C } },
+  { '-', { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 } },
+  { '+', { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 } },
+  { 'e', { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E } },
+  { 'K', { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 } },
+  { 'M', { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 } },
+  { 'G', { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F } },
+};
+
+/// Glyph dimensions and advance, in font units (a font size is 10 units)
+static constexpr int GLYPH_W = 5, GLYPH_H = 7, GLYPH_ADVANCE = 6;
+
+/// Number of samples per pixel side when computing text coverage
+static constexpr int TEXT_SAMPLES = 4;
+
+/// \returns the bitmap for \p c (nullptr if it has none, e.g. a space)
+static const Glyph* glyph (char c) {
+  for (const Glyph &g: GLYPHS)  if (g.c == c) return &g;
+  return nullptr;
+}
+
+void RasterImage::drawText (double x, double y, const std::string &text,
+                            double size, Color c, double grow) {
+  const double u = .1 * size * _scale, g = grow * _scale / u;
+  if (text.empty() || GLYPH_H * u < 3)  return;
+
+  std::vector<const Glyph*> glyphs;
+  for (char ch: text) glyphs.push_back(glyph(ch));
+
+  // Top-left corner of the text, in pixels
+  const double w = (GLYPH_ADVANCE * glyphs.size() - 1) * u, h = GLYPH_H * u;
+  const double x0 = _scale * x + _dx - .5 * w, y0 = _scale * y + _dy - .5 * h;
+
+  // Whether point (gx,gy), in font units, is within g of a lit glyph cell
+  const auto lit = [&glyphs, g] (double gx, double gy) {
+    for (int j = std::floor(gy - g); j <= std::floor(gy + g); j++) {
+      if (j < 0 || GLYPH_H <= j)  continue;
+      for (int i = std::floor(gx - g); i <= std::floor(gx + g); i++) {
+        if (i < 0 || size_t(i / GLYPH_ADVANCE) >= glyphs.size()) continue;
+        const Glyph *gl = glyphs[i / GLYPH_ADVANCE];
+        int col = i - GLYPH_ADVANCE * (i / GLYPH_ADVANCE);
+        if (gl && col < GLYPH_W && (gl->rows[j] >> (GLYPH_W - 1 - col)) & 1)
+          return true;
+      }
+    }
+    return false;
+  };
+
+  const double m = g * u;
+  int r0, r1, c0, c1;
+  if (!clipRows(y0 - m, y0 + h + m, r0, r1)
+      || !clipColumns(x0 - m, x0 + w + m, c0, c1)) return;
+  for (int j=r0; j<=r1; j++) {
+    for (int i=c0; i<=c1; i++) {
+      int n = 0;
+      for (int sj=0; sj<TEXT_SAMPLES; sj++)
+        for (int si=0; si<TEXT_SAMPLES; si++)
+          n += lit((i + (si + .5) / TEXT_SAMPLES - x0) / u,
+                   (j + (sj + .5) / TEXT_SAMPLES - y0) / u);
+      blend(i, j, c, double(n) / (TEXT_SAMPLES * TEXT_SAMPLES));
+    }
+  }
+}
+
+
+bool RasterImage::savePNG (const std::string &filename) const {
+  PNGWriter writer (filename, _width, _height);
+  writer.writeRows(_pixels.data(), _height);
+  return writer.close();
+}
+
+} // end of namespace render
@@ -0,0 +1,116 @@
+#ifndef KGD_RASTER_IMAGE_H
+#define KGD_RASTER_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/*!
+ * \file rasterimage.h
+ *
+ * Minimal anti-aliased software rasterizer with PNG output
+ */
+
+namespace render {
+
+/// 8-bit RGBA color
+struct Color {
+  uint8_t r, g, b, a; ///< Components
+
+  /// \returns an opaque color
+  static constexpr Color rgb (uint8_t r, uint8_t g, uint8_t b) {
+    return Color { r, g, b, 255 };
+  }
+
+  /// \returns \p lhs * r + \p rhs * (1-r) (opaque)
+  static Color mix (const Color &lhs, const Color &rhs, double r);
+
+  /// \returns the color as a #rrggbb string
+  std::string hex (void) const;
+
+  /// \returns the color packed in a single integer (for use as a key)
+  uint32_t key (void) const {
+    return uint32_t(r) << 24 | uint32_t(g) << 16 | uint32_t(b) << 8 | a;
+  }
+
+  /// Compares two colors
+  friend bool operator== (const Color &lhs, const Color &rhs) {
+    return lhs.key() == rhs.key();
+  }
+};
+
+/// Software RGB image on which primitives are drawn, anti-aliased, in scene
+/// coordinates (see setTransform).
+///
+/// Every primitive only visits the pixels in a thin band around its outline so
+/// that drawing cost is proportional to the covered area, not to its bounding
+/// box.
+class RasterImage {
+public:
+  /// Creates a \p width x \p height image filled with \p background
+  RasterImage (uint width, uint height, Color background);
+
+  /// \returns the image width (in pixels)
+  uint width (void) const {   return _width;  }
+
+  /// \returns the image height (in pixels)
+  uint height (void) const {  return _height; }
+
+  /// Scene point (x,y) will be drawn at pixel (\p scale * x + \p dx,
+  /// \p scale * y + \p dy)
+  void setTransform (double scale, double dx, double dy);
+
+  /// Fills the disk centered on (\p x, \p y) with radius \p r
+  void fillDisk (double x, double y, double r, Color c);
+
+  /// Draws a round-capped segment of width \p w from (\p x0, \p y0) to
+  /// (\p x1, \p y1)
+  void drawLine (double x0, double y0, double x1, double y1, double w, Color c);
+
+  /// Draws a round-capped arc of radius \p r, centered on the origin and of
+  /// width \p w from angle \p a0 to angle \p a1 (clockwise on screen)
+  void drawArc (double r, double a0, double a1, double w, Color c);
+
+  /// Draws the outline of the circle centered on the origin with radius \p r
+  void drawCircle (double r, double w, Color c);
+
+  /// Draws \p text centered on (\p x, \p y) with a font of height \p size,
+  /// each stroke being thickened by \p grow (e.g. to draw a halo)
+  /// \note Uses a built-in bitmap font that only covers numbers (digits,
+  /// sign, decimal point, exponent and K/M/G units). Other characters are
+  /// left blank and texts smaller than a few pixels are not drawn at all
+  void drawText (double x, double y, const std::string &text, double size,
+                 Color c, double grow = 0);
+
+  /// Writes the image to \p filename in the PNG format
+  /// \returns whether writing succeeded
+  bool savePNG (const std::string &filename) const;
+
+private:
+  const uint _width;  ///< Image width
+  const uint _height; ///< Image height
+
+  /// RGB bytes, row by row
+  std::vector<uint8_t> _pixels;
+
+  double _scale;  ///< Scene to pixel scale
+  double _dx;     ///< Scene origin abscissa in pixels
+  double _dy;     ///< Scene origin ordinate in pixels
+
+  /// Blends \p c over pixel (\p x, \p y) with opacity \p coverage
+  void blend (int x, int y, Color c, double coverage);
+
+  /// Clips the [\p y0, \p y1] row range to the image
+  bool clipRows (double y0, double y1, int &r0, int &r1) const;
+
+  /// Clips the [\p x0, \p x1] column range to the image
+  bool clipColumns (double x0, double x1, int &c0, int &c1) const;
+
+  /// Draws an arc (or full circle if \p full) in pixel coordinates
+  void drawArc (double r, double a0, double a1, double w, Color c, bool full);
+};
+
+} // end of namespace render
+
+#endif // KGD_RASTER_IMAGE_H
@@ -0,0 +1,304 @@
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "renderserver.h"
+
+namespace render {
+
+using json = nlohmann::json;
+
+// ============================================================================
+// == Jobs parsing
+// ============================================================================
+
+namespace {
+
+/// Parses a #rrggbb string \p s into \p c
+/// \returns whether \p s was a valid color
+bool parseColor (const std::string &s, Color &c) {
+  if (s.size() != 7 || s[0] != '#') return false;
+
+  char *end;
+  unsigned long v = strtoul(s.c_str() + 1, &end, 16);
+  if (*end != '\0') return false;
+
+  c = Color::rgb((v >> 16) & 255, (v >> 8) & 255, v & 255);
+  return true;
+}
+
+/// \returns the modification date of \p filename (0 if unavailable)
+time_t modificationTime (const std::string &filename) {
+  struct stat s;
+  if (stat(filename.c_str(), &s) != 0)  return 0;
+  return s.st_mtime;
+}
+
+} // end of anonymous namespace
+
+bool RenderJob::fromJson (const json &j, RenderJob &job, std::string &error) {
+  if (!j.is_object()) {
+    error = "Not a json object";
+    return false;
+  }
+
+  try {
+    if (j.count("id"))  job.id = j["id"].is_string() ? j["id"].get<std::string>()
+                                                     : j["id"].dump();
+    job.tree = j.value("tree", "");
+    job.output = j.value("output", "");
+    if (job.tree.empty() || job.output.empty()) {
+      error = "Missing mandatory field 'tree' or 'output'";
+      return false;
+    }
+
+    std::string ext = job.output.substr(job.output.find_last_of('.') + 1);
+    for (char &c: ext)  c = std::tolower(c);
+    if (ext != "svg" && ext != "png") {
+      error = "Unsupported output format '" + ext + "' (svg or png only)";
+      return false;
+    }
+
+    RenderConfig &c = job.config;
+    c.minSurvival = j.value("minSurvival", c.minSurvival);
+    c.minEnveloppe = j.value("minEnveloppe", c.minEnveloppe);
+    c.clippingRange = j.value("clippingRange", c.clippingRange);
+    c.survivorsOnly = j.value("survivorsOnly", c.survivorsOnly);
+    c.showNames = j.value("showNames", c.showNames);
+    c.rasterRadius = j.value("radius", c.rasterRadius);
+
+    if (j.count("colorSpecs")) {
+      c.color = RenderConfig::CUSTOM;
+      const json &specs = j["colorSpecs"];
+      for (auto it = specs.begin(); it != specs.end(); ++it) {
+        Color color;
+        if (!it->is_string() || !parseColor(it->get<std::string>(), color)) {
+          error = "Invalid color " + it->dump() + " for species " + it.key();
+          return false;
+        }
+        c.colorSpecs[phylogeny::SID(std::stoul(it.key()))] = color;
+      }
+    }
+
+    if (j.count("colors")) {
+      static const std::map<std::string, RenderConfig::Colors> colors {
+        { "none", RenderConfig::NONE },
+        { "survivors", RenderConfig::SURVIVORS },
+        { "custom", RenderConfig::CUSTOM }
+      };
+      auto it = colors.find(j["colors"].get<std::string>());
+      if (it == colors.end()) {
+        error = "Unknown color mode " + j["colors"].dump();
+        return false;
+      }
+      c.color = it->second;
+    }
+
+  } catch (const std::exception &e) {
+    error = e.what();
+    return false;
+  }
+
+  return true;
+}
+
+
+// ============================================================================
+// == Server
+// ============================================================================
+
+RenderServer::RenderServer (Loader loader, uint threads, uint cacheSize,
+                            std::ostream &replies)
+  : _loader(loader), _cacheSize(std::max(1u, cacheSize)), _replies(replies),
+    _cacheUses(0), _submitted(0), _running(0), _stopping(false) {
+
+  for (uint i=0; i<std::max(1u, threads); i++)
+    _workers.emplace_back(&RenderServer::work, this);
+}
+
+RenderServer::~RenderServer (void) {
+  {
+    std::unique_lock<std::mutex> lock (_queueMutex);
+    _stopping = true;
+  }
+  _queueChanged.notify_all();
+  for (std::thread &t: _workers)  t.join();
+}
+
+void RenderServer::serve (std::istream &is) {
+  std::string line;
+  while (std::getline(is, line))
+    if (!process(line)) break;
+  wait();
+}
+
+bool RenderServer::process (const std::string &line) {
+  // Blank lines and comments (job files)
+  size_t start = line.find_first_not_of(" \t\r");
+  if (start == std::string::npos || line[start] == '#')  return true;
+
+  json j;
+  try {
+    j = json::parse(line);
+  } catch (const std::exception &e) {
+    reply({ {"status", "failed"}, {"error", e.what()} });
+    return true;
+  }
+
+  if (j.is_object() && j.count("command")) {
+    const std::string command = j.value("command", "");
+    if (command == "quit")  return false;
+
+    else if (command == "wait")
+      wait();
+
+    else if (command == "drop")
+      drop(j.value("tree", ""));
+
+    else {
+      reply({ {"command", command}, {"status", "failed"},
+              {"error", "Unknown command"} });
+      return true;
+    }
+
+    reply({ {"command", command}, {"status", "done"} });
+    return true;
+  }
+
+  RenderJob job;
+  std::string error;
+  if (RenderJob::fromJson(j, job, error))
+    submit(std::move(job));
+  else
+    reply({ {"id", j.is_object() ? j.value("id", json()) : json()},
+            {"status", "failed"},
+            {"error", error} });
+
+  return true;
+}
+
+void RenderServer::submit (RenderJob job) {
+  {
+    std::unique_lock<std::mutex> lock (_queueMutex);
+    if (job.id.empty()) job.id = std::to_string(_submitted);
+    _submitted++;
+    _queue.push_back(std::move(job));
+  }
+  _queueChanged.notify_one();
+}
+
+void RenderServer::wait (void) {
+  std::unique_lock<std::mutex> lock (_queueMutex);
+  _jobDone.wait(lock, [this] { return _queue.empty() && _running == 0; });
+}
+
+void RenderServer::drop (const std::string &filename) {
+  std::unique_lock<std::mutex> lock (_cacheMutex);
+  if (filename.empty())
+    _cache.clear();
+  else
+    _cache.erase(filename);
+}
+
+void RenderServer::work (void) {
+  while (true) {
+    RenderJob job;
+    {
+      std::unique_lock<std::mutex> lock (_queueMutex);
+      _queueChanged.wait(lock, [this] { return _stopping || !_queue.empty(); });
+      if (_queue.empty()) return; // Stopping with nothing left to do
+
+      job = std::move(_queue.front());
+      _queue.pop_front();
+      _running++;
+    }
+
+    execute(job);
+
+    {
+      std::unique_lock<std::mutex> lock (_queueMutex);
+      _running--;
+    }
+    _jobDone.notify_all();
+  }
+}
+
+void RenderServer::execute (const RenderJob &job) {
+  using clock = std::chrono::steady_clock;
+  auto start = clock::now();
+
+  json r { {"id", job.id}, {"output", job.output} };
+  try {
+    auto tree = snapshot(job.tree);
+    HeadlessRenderer renderer (*tree, job.config);
+    bool ok = renderer.renderTo(job.output);
+
+    r["status"] = ok ? "done" : "failed";
+    r["species"] = renderer.visibleSpecies();
+    if (!ok)  r["error"] = "Failed to write '" + job.output + "'";
+
+  } catch (const std::exception &e) {
+    r["status"] = "failed";
+    r["error"] = e.what();
+  }
+
+  r["time"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                clock::now() - start).count();
+  reply(r);
+}
+
+std::shared_ptr<const TreeSnapshot>
+RenderServer::snapshot (const std::string &filename) {
+  using Tree = std::shared_ptr<const TreeSnapshot>;
+  const time_t mtime = modificationTime(filename);
+
+  std::promise<Tree> loading;
+  std::shared_future<Tree> tree;
+  {
+    std::unique_lock<std::mutex> lock (_cacheMutex);
+    auto it = _cache.find(filename);
+    if (it != _cache.end() && it->second.mtime == mtime) {
+      it->second.lastUse = ++_cacheUses;
+      tree = it->second.tree;
+
+    } else {
+      // Evict the least recently used tree (those still used by a job are
+      // only released afterwards)
+      if (it != _cache.end()) _cache.erase(it);
+      if (_cache.size() >= _cacheSize) {
+        auto lru = _cache.begin();
+        for (auto c = _cache.begin(); c != _cache.end(); ++c)
+          if (c->second.lastUse < lru->second.lastUse) lru = c;
+        _cache.erase(lru);
+      }
+
+      _cache[filename] = { loading.get_future().share(), mtime, ++_cacheUses };
+    }
+  }
+
+  // Already loaded (or being loaded by another worker)
+  if (tree.valid())  return tree.get();
+
+  try {
+    Tree t = std::make_shared<const TreeSnapshot>(_loader(filename));
+    loading.set_value(t);
+    return t;
+
+  } catch (...) {
+    loading.set_exception(std::current_exception());
+
+    // Give the next job a chance to read it again
+    std::unique_lock<std::mutex> lock (_cacheMutex);
+    auto it = _cache.find(filename);
+    if (it != _cache.end() && it->second.mtime == mtime)  _cache.erase(it);
+    throw;
+  }
+}
+
+void RenderServer::reply (const json &reply) {
+  std::unique_lock<std::mutex> lock (_repliesMutex);
+  _replies << reply.dump() << std::endl;
+}
+
+} // end of namespace render
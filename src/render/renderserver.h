@@ -0,0 +1,188 @@
+#ifndef KGD_RENDER_SERVER_H
+#define KGD_RENDER_SERVER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "headlessrenderer.h"
+
+/*!
+ * \file renderserver.h
+ *
+ * Long-lived batch renderer of phylogenetic trees
+ */
+
+namespace render {
+
+/// A rendering request: which tree to draw, how and where
+struct RenderJob {
+  /// Identifier repeated in the reply (the job's number if not provided)
+  std::string id;
+
+  /// File containing the phylogenetic tree
+  std::string tree;
+
+  /// Output file. Its extension (svg or png) selects the format
+  std::string output;
+
+  /// Rendering options
+  RenderConfig config;
+
+  /// Reads a job from \p j. Every field but 'tree' and 'output' is optional:
+  /// \code{.json}
+  /// { "id": "fig1", "tree": "ptree.json", "output": "fig1.png",
+  ///   "minSurvival": 10, "minEnveloppe": 0.5, "clippingRange": 1000,
+  ///   "survivorsOnly": true, "showNames": false, "radius": 2000,
+  ///   "colors": "custom", "colorSpecs": { "12": "#ff0000" } }
+  /// \endcode
+  /// Providing color specifications implies the 'custom' color mode.
+  /// Outputs other than svg or png are refused.
+  /// \returns whether parsing succeeded (\p error explaining why otherwise)
+  static bool fromJson (const nlohmann::json &j, RenderJob &job,
+                        std::string &error);
+};
+
+/// Renders many views of (cached) trees in parallel, without any graphical
+/// stack.
+///
+/// Requests are read, one JSON object per line, from a job file or any stream
+/// (e.g. the standard input or a named pipe). Each line is either a RenderJob
+/// or a command:
+///  - {"command": "wait"} waits for all previous jobs to complete
+///  - {"command": "drop", "tree": "file"} forgets a cached tree (all of them
+///    if no file is given)
+///  - {"command": "quit"} stops reading (queued jobs are still processed)
+///
+/// Jobs are processed by a pool of worker threads. Parsed trees are kept (as
+/// TreeSnapshot) for the next jobs, up to a given number, and reloaded when
+/// their file changed. A reply is written, as a single JSON line, for every
+/// job and command.
+///
+/// \note Figures are drawn by the HeadlessRenderer, not by the viewer's scene.
+/// They hold the species (filtered and colored as requested), their names and
+/// the time legend, in SVG or PNG only. Tracking wedges (custom colors only
+/// color the paths), levels of detail, contributors and PDF outputs are
+/// left to the graphical viewer (apt-basicviewer -p), which this server does
+/// not replace for such figures.
+class RenderServer {
+public:
+  /// Function extracting the rendering data of the tree stored in a file
+  /// \attention Called concurrently by the worker threads
+  using Loader = std::function<TreeSnapshot(const std::string&)>;
+
+  /// \returns a loader for trees of type PhylogeneticTree<GENOME,UDATA>
+  template <typename GENOME, typename UDATA>
+  static Loader loader (void) {
+    return [] (const std::string &filename) {
+      using PTree = phylogeny::PhylogeneticTree<GENOME, UDATA>;
+      return TreeSnapshot::from(PTree::readFrom(filename));
+    };
+  }
+
+  /// Creates a server reading trees through \p loader with \p threads
+  /// workers, keeping at most \p cacheSize trees and writing its replies to
+  /// \p replies
+  RenderServer (Loader loader, uint threads, uint cacheSize,
+                std::ostream &replies);
+
+  /// Processes the remaining jobs and stops the workers
+  ~RenderServer (void);
+
+  /// Processes the requests read from \p is until it is exhausted or a quit
+  /// command is received, then waits for all jobs to complete
+  void serve (std::istream &is);
+
+  /// Processes a single request \p line
+  /// \returns false if it was a quit command
+  bool process (const std::string &line);
+
+  /// Queues \p job for rendering
+  void submit (RenderJob job);
+
+  /// Waits until all submitted jobs are complete
+  void wait (void);
+
+  /// Forgets the cached tree read from \p filename (all of them if empty)
+  void drop (const std::string &filename = "");
+
+private:
+  /// A cached tree
+  struct CacheEntry {
+    /// The tree (available once loaded)
+    std::shared_future<std::shared_ptr<const TreeSnapshot>> tree;
+
+    /// Modification date of the file when it was read
+    time_t mtime;
+
+    /// Last access (for least recently used eviction)
+    uint64_t lastUse;
+  };
+
+  /// Reads the trees
+  const Loader _loader;
+
+  /// Maximal number of cached trees
+  const uint _cacheSize;
+
+  /// Where to write the replies
+  std::ostream &_replies;
+
+  /// The cached trees, by file name
+  std::map<std::string, CacheEntry> _cache;
+
+  /// Number of cache accesses so far
+  uint64_t _cacheUses;
+
+  /// Protects the cache
+  std::mutex _cacheMutex;
+
+  /// Pending jobs
+  std::deque<RenderJob> _queue;
+
+  /// Number of submitted jobs (for default identifiers)
+  uint _submitted;
+
+  /// Number of jobs being processed
+  uint _running;
+
+  /// Whether the workers should stop once the queue is empty
+  bool _stopping;
+
+  /// Protects the queue and the counters
+  std::mutex _queueMutex;
+
+  /// Signals new jobs (or stopping) to the workers
+  std::condition_variable _queueChanged;
+
+  /// Signals the completion of a job
+  std::condition_variable _jobDone;
+
+  /// Serializes the replies
+  std::mutex _repliesMutex;
+
+  /// The worker threads
+  std::vector<std::thread> _workers;
+
+  /// Worker threads main loop
+  void work (void);
+
+  /// Renders \p job and replies
+  void execute (const RenderJob &job);
+
+  /// \returns the tree stored in \p filename, from the cache if it is still
+  /// valid or freshly loaded otherwise
+  /// \throws std::exception if the file could not be read
+  std::shared_ptr<const TreeSnapshot> snapshot (const std::string &filename);
+
+  /// Writes \p reply as a single line
+  void reply (const nlohmann::json &reply);
+};
+
+} // end of namespace render
+
+#endif // KGD_RENDER_SERVER_H
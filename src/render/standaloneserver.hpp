@@ -0,0 +1,74 @@
+#include <fstream>
+#include <iostream>
+
+#include "kgd/external/cxxopts.hpp"
+#include "kgd/utils/utils.h"
+
+#include "renderserver.h"
+
+/*!
+ * \file standaloneserver.hpp
+ *
+ * Contains the command line front-end of the render server
+ */
+
+/// Reads rendering jobs for trees of \p GENOME (with \p UDATA) from a file or
+/// the standard input and processes them with a render::RenderServer
+template <typename GENOME, typename UDATA>
+int runRenderServer (int argc, char *argv[]) {
+  using Verbosity = config::Verbosity;
+
+  std::string configFile, jobsFile = "-";
+  Verbosity verbosity = Verbosity::SHOW;
+  uint threads = std::max(1u, std::thread::hardware_concurrency());
+  uint cacheSize = 16;
+
+  cxxopts::Options options("PTreeRenderServer",
+                           "Renders batches of phenotypic trees for \""
+                           + utils::className<GENOME>() + "\" genomes.\n"
+                           "Jobs are read one json object per line, e.g.:\n"
+                           "  {\"tree\": \"ptree.json\", \"output\": \"a.png\","
+                           " \"minSurvival\": 10, \"radius\": 2000}\n"
+                           "and one json reply per job is written to the"
+                           " standard output. A named pipe (mkfifo) kept open"
+                           " by its writer makes for a long-lived server");
+  options.add_options()
+    ("h,help", "Display help")
+    ("c,config", "File containing configuration data",
+     cxxopts::value(configFile))
+    ("v,verbosity", "Verbosity level. " + config::verbosityValues(),
+     cxxopts::value(verbosity))
+    ("j,jobs", "File containing the jobs ('-' for the standard input)",
+     cxxopts::value(jobsFile))
+    ("t,threads", "Number of rendering threads", cxxopts::value(threads))
+    ("cache", "Maximal number of trees kept in memory",
+     cxxopts::value(cacheSize))
+    ;
+
+  options.parse_positional("jobs");
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  config::PTree::setupConfig(configFile, verbosity);
+
+  render::RenderServer server (render::RenderServer::loader<GENOME, UDATA>(),
+                               threads, cacheSize, std::cout);
+
+  if (jobsFile == "-")
+    server.serve(std::cin);
+
+  else {
+    std::ifstream ifs (jobsFile);
+    if (!ifs) {
+      std::cerr << "Unable to open jobs file '" << jobsFile << "'" << std::endl;
+      return 1;
+    }
+    server.serve(ifs);
+  }
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+// Compare against the generic EDNA implementations
+#define APT_GENERIC_BOCDATA
+#include "../core/crossover.h"
+
+/*!
+ * \file bockernels.cpp
+ *
+ * Contains the &nbsp; \copydoc main
+ */
+
+using namespace genotype;
+
+/// \returns whether \p lhs and \p rhs hold the same values (bit for bit)
+bool identical (const BOCData &lhs, const BOCData &rhs) {
+  const auto same = [] (float a, float b) {
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+  };
+  return same(lhs.getOptimalDistance(), rhs.getOptimalDistance())
+      && same(lhs.getInbreedTolerance(), rhs.getInbreedTolerance())
+      && same(lhs.getOutbreedTolerance(), rhs.getOutbreedTolerance())
+      && lhs.sex == rhs.sex;
+}
+
+/// Checks that BOCKernels produces the same distances, mutations and crossings
+/// as the generic EDNA path, for fixed seeds
+int main(int argc, char *argv[]) {
+  uint seeds = (argc > 1) ? std::stoul(argv[1]) : 10000;
+
+  config::EDNAConfigFile<BOCData>::setupConfig("", config::Verbosity::QUIET);
+
+  uint failures = 0;
+  const auto fail = [&failures] (const std::string &what, uint seed,
+                                 const BOCData &lhs, const BOCData &rhs) {
+    std::cerr << what << " mismatch for seed " << seed << ":\n\t" << lhs
+              << "\n\t" << rhs << std::endl;
+    failures++;
+  };
+
+  for (uint seed=0; seed<seeds; seed++) {
+    rng::FastDice dice (seed);
+    BOCData lhs = BOCData::random(dice), rhs = BOCData::random(dice);
+    for (uint i=0; i<seed%10; i++) lhs.EDNA<BOCData>::mutate(dice);
+
+    // Distance
+    double kd = BOCKernels::distance(lhs, rhs), gd = distance(lhs, rhs);
+    if (std::memcmp(&kd, &gd, sizeof(double)) != 0) {
+      std::cerr << "(" << kd << " != " << gd << ") ";
+      fail("Distance", seed, lhs, rhs);
+    }
+
+    // Mutation
+    BOCData km = lhs, gm = lhs;
+    rng::FastDice kdice (seed), gdice (seed);
+    BOCKernels::mutate(km, kdice);
+    gm.EDNA<BOCData>::mutate(gdice);
+    if (!identical(km, gm)) fail("Mutation", seed, km, gm);
+
+    // Crossing
+    rng::FastDice kcdice (seed), gcdice (seed);
+    BOCData kc = BOCKernels::cross(lhs, rhs, kcdice),
+            gc = cross(lhs, rhs, gcdice);
+    if (!identical(kc, gc)) fail("Crossing", seed, kc, gc);
+  }
+
+  std::cout << failures << " mismatch(es) over " << seeds << " seeds"
+            << std::endl;
+  return failures > 0;
+}
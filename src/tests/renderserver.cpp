@@ -0,0 +1,25 @@
+#include "../render/standaloneserver.hpp"
+
+/*!
+ * \file renderserver.cpp
+ *
+ * Contains the &nbsp; \copydoc main
+ */
+
+/// Decoy genome with no internal structure
+struct Genome {
+  /// Aggregates emptiness
+  static void aggregate (std::ostream&, const std::vector<Genome>&, uint) {}
+
+  /// Should convert the genome to json but, in fact, does nothing
+  friend void to_json (nlohmann::json&, const Genome&) {}
+
+  /// Should convert the json into the genome but, in fact, does nothing
+  friend void from_json (const nlohmann::json&, Genome&) {}
+};
+
+/// main for a render server that can draw any PTree by throwing genetic
+/// information away
+int main(int argc, char *argv[]) {
+  return runRenderServer<Genome, phylogeny::NoUserData>(argc, argv);
+}
@@ -0,0 +1,171 @@
+#ifndef KGD_COMPARISONVIEWER_HPP
+#define KGD_COMPARISONVIEWER_HPP
+
+/*!
+ * \file comparisonviewer.hpp
+ *
+ * Contains the definition of a side-by-side viewer for several trees
+ */
+
+#include <cmath>
+
+#include <QGridLayout>
+#include <QLabel>
+
+#include "../core/tree/treediff.h"
+
+#include "phylogenyviewer.h"
+#include "speciestracking.h"
+
+namespace gui {
+
+/// Shows several trees side by side. All of them are drawn at the scale of
+/// the longest one (common time radii) with the same pens, and the species
+/// that differ from one tree to the others are highlighted (see
+/// phylogeny::TreeDiff and PhylogenyViewer_base::setHighlights).
+///
+/// Batches and static tiles depend on the contents of each tree and are thus
+/// not shared. The viewers split a single static tiles budget instead
+template <typename GENOME, typename UDATA>
+class ComparisonViewer : public QWidget {
+public:
+  /// Helper alias to the compared trees
+  using PTree = phylogeny::PhylogeneticTree<GENOME, UDATA>;
+
+  /// Helper alias to the viewer of a single tree
+  using PViewer = PhylogenyViewer<GENOME, UDATA>;
+
+  /// Helper alias to a collection of species highlights
+  using Highlights = QMap<phylogeny::SID, QColor>;
+
+  /// Loads the trees stored in \p files, in parallel
+  static std::vector<std::unique_ptr<PTree>>
+  load (const std::vector<std::string> &files) {
+    std::vector<std::future<std::unique_ptr<PTree>>> loading;
+    for (const std::string &f: files)
+      loading.push_back(std::async(std::launch::async, [f] {
+        return std::unique_ptr<PTree>(new PTree(PTree::readFrom(f)));
+      }));
+
+    std::vector<std::unique_ptr<PTree>> trees;
+    for (auto &l: loading)  trees.push_back(l.get());
+    return trees;
+  }
+
+  /// Color of the species absent from at least one of the other trees
+  static QColor missingColor (void) {
+    return species_tracking::ColorDelegate::nextColor(0);
+  }
+
+  /// Color of the species with a different parent in another tree
+  static QColor reparentedColor (void) {
+    return species_tracking::ColorDelegate::nextColor(1);
+  }
+
+  /// Creates a comparison view of \p trees (titled by \p names) with
+  /// \p config as the initial configuration of every viewer
+  ComparisonViewer (const std::vector<PTree*> &trees, const QStringList &names,
+                    ViewerConfig config, QWidget *parent = nullptr)
+    : QWidget(parent) {
+
+    // Hierarchies, then differences, are extracted in parallel
+    const size_t N = trees.size();
+    std::vector<std::future<phylogeny::TreeDiff::Hierarchy>> extracting;
+    for (const PTree *t: trees)
+      extracting.push_back(std::async(std::launch::async, [t] {
+        return phylogeny::TreeDiff::hierarchy(*t);
+      }));
+
+    std::vector<phylogeny::TreeDiff::Hierarchy> hierarchies;
+    for (auto &e: extracting) hierarchies.push_back(e.get());
+
+    // Matching species is symmetric (and costly): done once per pair
+    std::vector<std::shared_future<Matches>> matching (N*N);
+    for (size_t i=0; i<N; i++)
+      for (size_t j=i+1; j<N; j++)
+        matching[i*N+j] = std::async(std::launch::async,
+                                     [&trees, &hierarchies, i, j] {
+          return phylogeny::TreeDiff::matches(*trees[i], hierarchies[i],
+                                              *trees[j], hierarchies[j]);
+        }).share();
+
+    std::vector<std::future<Highlights>> diffing;
+    for (size_t i=0; i<N; i++)
+      diffing.push_back(std::async(std::launch::async,
+                                   [&hierarchies, &matching, i] {
+        return highlights(hierarchies, matching, i);
+      }));
+
+    // Common time radii and pens
+    uint radius = 0;
+    for (const PTree *t: trees)  radius = std::max(radius, t->step());
+    PTGraphBuilder::PenSet pens = PTGraphBuilder::buildPenSet();
+    PTGraphBuilder::updatePenSet(radius, pens);
+
+    if (config.staticTilesBudget > 0)
+      config.staticTilesBudget =
+          std::max(1u, uint(config.staticTilesBudget / N));
+
+    auto *layout = new QGridLayout;
+    const int columns = std::ceil(std::sqrt(N));
+    for (size_t i=0; i<N; i++) {
+      auto *label = new QLabel(names.value(i));
+      label->setAlignment(Qt::AlignCenter);
+
+      auto *viewer = new PViewer(nullptr, *trees[i],
+                                 QBoxLayout::TopToBottom, config);
+      viewer->alignRadius(radius, pens);
+      viewer->setHighlights(diffing[i].get());
+      _viewers.push_back(viewer);
+
+      auto *cell = new QVBoxLayout;
+      cell->addWidget(label);
+      cell->addWidget(viewer, 1);
+      layout->addLayout(cell, i / columns, i % columns);
+    }
+    setLayout(layout);
+
+    setWindowTitle("Phylogenetic trees comparison");
+  }
+
+  /// \returns the viewer of the \p i-th tree
+  PViewer* viewer (size_t i) {
+    return _viewers[i];
+  }
+
+private:
+  /// The individual viewers
+  std::vector<PViewer*> _viewers;
+
+  /// Helper alias to the species matched in a pair of trees
+  using Matches = std::vector<phylogeny::SID>;
+
+  /// \returns the highlights for the species of the \p i-th tree (of
+  /// hierarchies \p h) that differ in any other tree. The species matched in
+  /// trees a < b are in \p matches[a*N+b]
+  static Highlights
+  highlights (const std::vector<phylogeny::TreeDiff::Hierarchy> &h,
+              const std::vector<std::shared_future<Matches>> &matches,
+              size_t i) {
+    const size_t N = h.size();
+    std::set<phylogeny::SID> missing, reparented;
+    for (size_t j=0; j<N; j++) {
+      if (i == j) continue;
+      const Matches &m = matches[std::min(i, j)*N + std::max(i, j)].get();
+      phylogeny::TreeDiff d = phylogeny::TreeDiff::compute(h[i], h[j], m);
+      missing.insert(d.missing.begin(), d.missing.end());
+      reparented.insert(d.reparented.begin(), d.reparented.end());
+    }
+
+    Highlights highlights;
+    for (phylogeny::SID sid: reparented)
+      highlights.insert(sid, reparentedColor());
+    for (phylogeny::SID sid: missing) // Takes precedence
+      highlights.insert(sid, missingColor());
+    return highlights;
+  }
+};
+
+} // end of namespace gui
+
+#endif // KGD_COMPARISONVIEWER_HPP
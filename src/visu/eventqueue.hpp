@@ -0,0 +1,148 @@
+#ifndef KGD_EVENT_QUEUE_HPP
+#define KGD_EVENT_QUEUE_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/*!
+ * \file eventqueue.hpp
+ *
+ * Definition of a single-producer/single-consumer queue used to decouple the
+ * simulation thread from the graphical user interface
+ */
+
+namespace gui {
+
+/// Fixed-capacity lock-free ring buffer for exactly one producer thread and
+/// one consumer thread
+///
+/// \tparam T The type of the stored values (must be default constructible)
+template <typename T>
+class SPSCRingBuffer {
+public:
+  /// Create a ring buffer with room for at least \p capacity values
+  explicit SPSCRingBuffer (size_t capacity)
+    : _buffer(roundUp(capacity)), _mask(_buffer.size()-1), _head(0), _tail(0) {}
+
+  /// \returns the number of values the buffer can hold
+  size_t capacity (void) const {
+    return _buffer.size();
+  }
+
+  /// Producer side. Moves \p v into the buffer if there is room left
+  /// \returns whether \p v was inserted (untouched otherwise)
+  bool tryPush (T &v) {
+    size_t t = _tail.load(std::memory_order_relaxed);
+    if (t - _head.load(std::memory_order_acquire) == _buffer.size())
+      return false;
+    _buffer[t & _mask] = std::move(v);
+    _tail.store(t+1, std::memory_order_release);
+    return true;
+  }
+
+  /// Consumer side. Moves the oldest value into \p v if any
+  /// \returns whether a value was extracted
+  bool tryPop (T &v) {
+    size_t h = _head.load(std::memory_order_relaxed);
+    if (h == _tail.load(std::memory_order_acquire))
+      return false;
+    v = std::move(_buffer[h & _mask]);
+    _buffer[h & _mask] = T{};
+    _head.store(h+1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  /// \returns the smallest power of two greater or equal to \p n (min 2)
+  static size_t roundUp (size_t n) {
+    size_t p = 2;
+    while (p < n) p <<= 1;
+    return p;
+  }
+
+  /// The storage
+  std::vector<T> _buffer;
+
+  /// Helper value for fast modulo
+  const size_t _mask;
+
+  /// Index of the next value to read (only written by the consumer)
+  alignas(64) std::atomic<size_t> _head;
+
+  /// Index of the next value to write (only written by the producer)
+  alignas(64) std::atomic<size_t> _tail;
+};
+
+/// Unbounded, order preserving, event queue for one producer and one consumer.
+///
+/// Values go through a lock-free SPSCRingBuffer. Should the consumer lag behind
+/// and the ring fill up, the producer switches to a mutex-protected overflow
+/// vector (and keeps using it until the consumer has emptied it) so that it
+/// never blocks on the consumer nor loses any event.
+template <typename T>
+class EventQueue {
+public:
+  /// Create a queue whose lock-free part holds at least \p capacity values
+  explicit EventQueue (size_t capacity = 1024)
+    : _ring(capacity), _overflowing(false) {}
+
+  /// Producer side. Appends \p v to the queue
+  void push (T v) {
+    if (_overflowing.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock (_overflowMutex);
+      if (_overflowing.load(std::memory_order_relaxed)) {
+        _overflow.push_back(std::move(v));
+        return;
+      }
+    }
+
+    if (!_ring.tryPush(v)) {
+      std::lock_guard<std::mutex> lock (_overflowMutex);
+      _overflow.push_back(std::move(v));
+      _overflowing.store(true, std::memory_order_release);
+    }
+  }
+
+  /// Consumer side. Calls \p f on every pending value, in order
+  /// \returns the number of processed values
+  template <typename F>
+  size_t consume (F f) {
+    size_t n = 0;
+    bool overflowed = _overflowing.load(std::memory_order_acquire);
+
+    T v;
+    while (_ring.tryPop(v)) f(std::move(v)), n++;
+
+    // The producer does not touch the ring while overflowing: everything
+    // in the overflow is more recent than what was just read
+    if (overflowed) {
+      std::vector<T> values;
+      {
+        std::lock_guard<std::mutex> lock (_overflowMutex);
+        values.swap(_overflow);
+        _overflowing.store(false, std::memory_order_release);
+      }
+      for (T &v_: values) f(std::move(v_)), n++;
+    }
+
+    return n;
+  }
+
+private:
+  /// The lock-free part
+  SPSCRingBuffer<T> _ring;
+
+  /// Whether the producer currently writes into the overflow
+  std::atomic<bool> _overflowing;
+
+  /// Protects the overflow
+  std::mutex _overflowMutex;
+
+  /// Values that did not fit into the ring
+  std::vector<T> _overflow;
+};
+
+} // end of namespace gui
+
+#endif // KGD_EVENT_QUEUE_HPP
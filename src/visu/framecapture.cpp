@@ -0,0 +1,212 @@
+#include <iostream>
+
+#include <QPainter>
+#include <QProcess>
+#include <QDir>
+
+#include "framecapture.h"
+#include "ptgraphbuilder.h"
+#include "graphicutils.h"
+
+namespace gui {
+
+/// Side of the video frames when ViewerConfig::rasterRadius is not set
+static constexpr int DEFAULT_VIDEO_SIZE = 1024;
+
+/// Rasterizes a recorded frame and hands it back to the capture object
+class FrameCapture::Job : public QRunnable {
+public:
+  /// Creates a job for the \p index-th accepted frame
+  Job (FrameCapture &capture, QPicture &&picture, QSize size,
+       uint index, uint step)
+    : _capture(capture), _picture(std::move(picture)), _size(size),
+      _index(index), _step(step) {}
+
+  /// Plays the drawing commands back into an image
+  void run (void) override {
+    QImage image (_size, QImage::Format_RGB32);
+    image.fill(Qt::white);
+
+    QPainter painter (&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.drawPicture(0, 0, _picture);
+    painter.end();
+
+    _capture.frameReady(_index, _step, std::move(image));
+  }
+
+private:
+  FrameCapture &_capture; ///< The owner
+  QPicture _picture;      ///< The recorded frame
+  const QSize _size;      ///< The output size
+  const uint _index;      ///< Index among the accepted frames
+  const uint _step;       ///< Simulation step
+};
+
+/// Runs a function on the encoder thread
+class FrameCapture::EncoderJob : public QRunnable {
+public:
+  /// Creates a job running \p f
+  EncoderJob (std::function<void(void)> f) : _f(std::move(f)) {}
+
+  /// Runs the function
+  void run (void) override {
+    _f();
+  }
+
+private:
+  std::function<void(void)> _f; ///< The function to run
+};
+
+FrameCapture::FrameCapture (const ViewerConfig &config)
+  : _video(QString::fromStdString(config.captureVideo)),
+    _fps(std::max(1u, config.captureFps)),
+    _backlog(std::max(1u, config.captureBacklog)),
+    _rasterRadius(config.rasterRadius),
+    _pending(0), _failed(false), _accepted(0), _dropped(0),
+    _encoder(nullptr), _videoStarted(false), _nextFrame(0) {
+
+  if (_video.isEmpty())  QDir().mkpath("snapshots");
+
+  // The process must be used by the thread that created it: never let that
+  // thread expire
+  _encoderThread.setMaxThreadCount(1);
+  _encoderThread.setExpiryTimeout(-1);
+}
+
+FrameCapture::~FrameCapture (void) {
+  waitForDone();
+  toEncoder([this] {
+    if (!_encoder)  return;
+    _encoder->closeWriteChannel();
+    _encoder->waitForFinished(-1);
+    delete _encoder;
+  });
+  _encoderThread.waitForDone();
+
+  if (_dropped > 0)
+    std::cout << "Frame capture: dropped " << _dropped << " out of "
+              << _accepted + _dropped << " frames" << std::endl;
+}
+
+void FrameCapture::waitForDone (void) {
+  _pool.waitForDone();  // Queues the last frames to the encoder
+  _encoderThread.waitForDone();
+}
+
+double FrameCapture::scale (const QRectF &source) {
+  if (!_video.isEmpty() && !_videoStarted)  openVideo();
+  if (source.isEmpty()) return 1;
+
+  QSize size = outputSize(source);
+  return std::min(size.width() / source.width(),
+                  size.height() / source.height());
+}
+
+QSize FrameCapture::rasterSize (const QRectF &source, float rasterRadius) {
+  QSize size = source.size().toSize();
+  if (rasterRadius > 0 && size.width() > 0)
+    size = size * rasterRadius / size.width();
+  return size;
+}
+
+QSize FrameCapture::outputSize (const QRectF &source) {
+  if (!_video.isEmpty())  return _frameSize;
+  return rasterSize(source, _rasterRadius);
+}
+
+bool FrameCapture::capture (QGraphicsScene *scene, const QRectF &source,
+                            uint step) {
+  if (_pending >= _backlog || _failed) {
+    _dropped++;
+    return false;
+  }
+
+  if (!_video.isEmpty() && !_videoStarted)  openVideo();
+
+  QSize size = outputSize(source);
+
+  QPicture picture;
+  QPainter painter (&picture);
+  painter.setRenderHint(QPainter::Antialiasing);
+  scene->render(&painter, centeredInto(QRectF({0,0}, size), source), source);
+  painter.end();
+
+  _pending++;
+  _pool.start(new Job(*this, std::move(picture), size, _accepted++, step));
+  return true;
+}
+
+void FrameCapture::openVideo (void) {
+  // Video encoders want constant and even dimensions
+  int size = _rasterRadius > 0 ? _rasterRadius : DEFAULT_VIDEO_SIZE;
+  _frameSize = QSize(size & ~1, size & ~1).expandedTo({2, 2});
+  _videoStarted = true;
+
+  // Arguments are passed as is (no shell): any file name is safe
+  QStringList args {
+    "-y", "-loglevel", "error", "-f", "rawvideo", "-pixel_format", "bgra",
+    "-video_size", QString("%1x%2").arg(_frameSize.width())
+                                   .arg(_frameSize.height()),
+    "-framerate", QString::number(_fps), "-i", "-",
+    "-c:v", "libx264", "-pix_fmt", "yuv420p", _video
+  };
+
+  toEncoder([this, args] {
+    _encoder = new QProcess;
+    _encoder->setProcessChannelMode(QProcess::ForwardedChannels);
+    _encoder->start("ffmpeg", args);
+    if (_encoder->waitForStarted(-1)) return;
+
+    std::cerr << "Failed to start video encoder for "
+              << _video.toStdString() << ": "
+              << _encoder->errorString().toStdString()
+              << ". Disabling capture" << std::endl;
+    _failed = true;
+  });
+}
+
+void FrameCapture::toEncoder (std::function<void(void)> f) {
+  _encoderThread.start(new EncoderJob(std::move(f)));
+}
+
+void FrameCapture::encode (uint index, const QImage &i) {
+  // A missing or crashed encoder is reported as a write error (QProcess does
+  // not let SIGPIPE through)
+  const qint64 bytes = qint64(i.bytesPerLine()) * i.height();
+  bool ok = !_failed
+         && _encoder->write((const char*)i.constBits(), bytes) == bytes;
+  while (ok && _encoder->bytesToWrite() > 0)
+    ok = _encoder->waitForBytesWritten(-1);
+
+  if (!ok && !_failed) {
+    std::cerr << "Failed to write frame " << index << " to video "
+              << _video.toStdString() << ". Disabling capture" << std::endl;
+    _failed = true;
+  }
+
+  _pending--;
+}
+
+void FrameCapture::frameReady (uint index, uint step, QImage &&image) {
+  if (_video.isEmpty()) {
+    QString filename = QString("snapshots/ptree_step%1.png").arg(step);
+    if (!image.save(filename))
+      std::cerr << "Failed to save " << filename.toStdString() << std::endl;
+    _pending--;
+    return;
+  }
+
+  // Frames are rasterized in any order but must be encoded in sequence (the
+  // encoder thread processes them in submission order)
+  std::lock_guard<std::mutex> lock (_mutex);
+  _ready.emplace(index, std::move(image));
+  for (auto it = _ready.begin();
+       it != _ready.end() && it->first == _nextFrame;
+       it = _ready.erase(it), _nextFrame++) {
+    QImage i = it->second;
+    toEncoder([this, index = it->first, i] { encode(index, i); });
+  }
+}
+
+} // end of namespace gui
@@ -0,0 +1,139 @@
+#ifndef KGD_FRAME_CAPTURE_H
+#define KGD_FRAME_CAPTURE_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include <QGraphicsScene>
+#include <QThreadPool>
+#include <QPicture>
+#include <QImage>
+
+class QProcess;
+
+/*!
+ * \file framecapture.h
+ *
+ * Definition of the asynchronous per-step capture of the phylogeny viewer
+ */
+
+namespace gui {
+
+struct ViewerConfig;
+
+/// Records the scene, once per step, without stalling the caller.
+///
+/// The GUI thread only records the drawing commands (into a QPicture) which
+/// is much cheaper than rasterizing them. Playback, rasterization and encoding
+/// are performed by a pool of worker threads, either into an image sequence
+/// (one png per step) or into a single video file (through an ffmpeg process).
+/// The encoding process is owned and fed by a single, dedicated, thread.
+///
+/// When workers lag behind by more than ViewerConfig::captureBacklog frames,
+/// new frames are dropped so that capture never slows the simulation down.
+class FrameCapture {
+public:
+  /// Creates a capture object using the output settings of \p config
+  FrameCapture (const ViewerConfig &config);
+
+  /// Waits for all pending frames and closes the video file (if any)
+  ~FrameCapture (void);
+
+  /// Records the \p source part of \p scene for step \p step
+  /// \returns whether the frame was accepted (false if dropped)
+  bool capture (QGraphicsScene *scene, const QRectF &source, uint step);
+
+  /// Blocks until all accepted frames are written
+  void waitForDone (void);
+
+  /// \returns the scale at which the \p source part of the scene is drawn
+  /// into the frames
+  double scale (const QRectF &source);
+
+  /// \returns the size of a raster rendering of \p source: its own size
+  /// scaled, up or down, to a width of \p rasterRadius (if positive). Shared
+  /// by the per-step frames and the viewer's exports
+  static QSize rasterSize (const QRectF &source, float rasterRadius);
+
+  /// \returns the number of frames dropped so far
+  uint dropped (void) const {
+    return _dropped;
+  }
+
+private:
+  /// Task for a single frame
+  class Job;
+
+  /// Task for the encoder thread
+  class EncoderJob;
+
+  /// Output video file (empty for an image sequence)
+  const QString _video;
+
+  /// Frames per second of the output video
+  const uint _fps;
+
+  /// Maximal number of frames being processed before dropping new ones
+  const uint _backlog;
+
+  /// Size of the output images (-1 means the scene's own size)
+  const float _rasterRadius;
+
+  /// The worker threads
+  QThreadPool _pool;
+
+  /// Number of accepted frames not yet written
+  std::atomic<uint> _pending;
+
+  /// Whether the output could not be opened or written to
+  std::atomic<bool> _failed;
+
+  /// Number of accepted frames
+  uint _accepted;
+
+  /// Number of dropped frames
+  uint _dropped;
+
+  /// Fixed size of the video frames
+  QSize _frameSize;
+
+  /// Single thread owning the encoding process (video mode only)
+  QThreadPool _encoderThread;
+
+  /// The encoding process. Only accessed by #_encoderThread
+  QProcess *_encoder;
+
+  /// Whether the encoding process was requested
+  bool _videoStarted;
+
+  /// Protects the reordering buffer
+  std::mutex _mutex;
+
+  /// Frames rasterized ahead of their turn (video mode only)
+  std::map<uint, QImage> _ready;
+
+  /// Index of the next frame to send to the encoder
+  uint _nextFrame;
+
+  /// \returns the size of the output image for \p source
+  QSize outputSize (const QRectF &source);
+
+  /// Fixes the frames size and starts the encoding process
+  void openVideo (void);
+
+  /// Runs \p f on the encoder thread
+  void toEncoder (std::function<void(void)> f);
+
+  /// Sends \p image, the \p index-th frame, to the encoding process
+  /// \attention Only called by the encoder thread
+  void encode (uint index, const QImage &image);
+
+  /// Called by workers once frame \p index is rasterized
+  void frameReady (uint index, uint step, QImage &&image);
+};
+
+} // end of namespace gui
+
+#endif // KGD_FRAME_CAPTURE_H
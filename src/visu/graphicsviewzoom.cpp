@@ -9,7 +9,7 @@
 /// \cond third_party
 
 Graphics_view_zoom::Graphics_view_zoom(QGraphicsView* view)
-  : QObject(view), _view(view) {
+  : QObject(view), _view(view), _animation(nullptr) {
   _view->viewport()->installEventFilter(this);
   _view->setMouseTracking(true);
   _modifiers = Qt::ControlModifier;
@@ -35,6 +35,36 @@ void Graphics_view_zoom::set_zoom_factor_base(double value) {
   _zoom_factor_base = value;
 }
 
+void Graphics_view_zoom::focus_on(const QPointF &scene_pos, double scale,
+                                  int duration) {
+  if (!_animation) {
+    _animation = new QVariantAnimation(this);
+    _animation->setStartValue(0.);
+    _animation->setEndValue(1.);
+    _animation->setEasingCurve(QEasingCurve::InOutCubic);
+    connect(_animation, &QVariantAnimation::valueChanged,
+            [this] (const QVariant &t) { focus_step(t.toDouble()); });
+    connect(_animation, &QVariantAnimation::finished,
+            this, &Graphics_view_zoom::focused);
+  }
+
+  _animation->stop();
+  _focus_start_pos = _view->mapToScene(_view->viewport()->rect().center());
+  _focus_end_pos = scene_pos;
+  _focus_start_scale = _view->transform().m11();
+  _focus_end_scale = scale;
+  _animation->setDuration(duration);
+  _animation->start();
+}
+
+void Graphics_view_zoom::focus_step(double t) {
+  // Geometric interpolation of the scale so that zooming looks uniform
+  double scale = _focus_start_scale * qPow(_focus_end_scale / _focus_start_scale, t);
+  _view->setTransform(QTransform::fromScale(scale, scale));
+  _view->centerOn(_focus_start_pos + t * (_focus_end_pos - _focus_start_pos));
+  emit zoomed();
+}
+
 bool Graphics_view_zoom::eventFilter(QObject *object, QEvent *event) {
   if (event->type() == QEvent::MouseMove) {
     QMouseEvent* mouse_event = static_cast<QMouseEvent*>(event);
@@ -49,6 +79,7 @@ bool Graphics_view_zoom::eventFilter(QObject *object, QEvent *event) {
       if (wheel_event->angleDelta().y() != 0) {
         double angle = wheel_event->angleDelta().y();
         double factor = qPow(_zoom_factor_base, angle);
+        if (_animation) _animation->stop();
         gentle_zoom(factor);
         return true;
       }
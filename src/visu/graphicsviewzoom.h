@@ -2,6 +2,7 @@
 #define KGD_GRAPHICSVIEWZOOM_H
 
 #include <QGraphicsView>
+#include <QVariantAnimation>
 
 /*!
  * Credit goes to: Pavel Strakhov (https://stackoverflow.com/a/19114517)
@@ -34,6 +35,9 @@
  * Zoom coefficient is calculated as zoom_factor_base^angle_delta
  * (see QWheelEvent::angleDelta).
  * The default zoom factor base is 1.0015.
+ *
+ * focus_on() smoothly moves (and zooms) the view to a given scene position. The
+ * zoomed() signal is emitted at every frame and focused() at the end.
  */
 class Graphics_view_zoom : public QObject {
   /// \cond third_party
@@ -44,16 +48,22 @@ public:
   void gentle_zoom(double factor);
   void set_modifiers(Qt::KeyboardModifiers modifiers);
   void set_zoom_factor_base(double value);
+  void focus_on(const QPointF &scene_pos, double scale, int duration = 500);
 
 private:
   QGraphicsView* _view;
   Qt::KeyboardModifiers _modifiers;
   double _zoom_factor_base;
   QPointF target_scene_pos, target_viewport_pos;
+  QVariantAnimation* _animation;
+  QPointF _focus_start_pos, _focus_end_pos;
+  double _focus_start_scale, _focus_end_scale;
+  void focus_step(double t);
   bool eventFilter(QObject* object, QEvent* event);
 
 signals:
   void zoomed();
+  void focused();
 
   /// \endcond
 };
@@ -22,6 +22,7 @@
 #include <QToolTip>
 
 #include <QContextMenuEvent>
+#include <QTimer>
 
 #include <QPixmap>
 #include <QFileDialog>
@@ -41,6 +42,7 @@
 #include "graphicutils.h"
 #include "graphicsviewzoom.h"
 #include "speciestracking.h"
+#include "tiledrenderer.h"
 
 /*!
  * \file phylogenyviewer.cpp
@@ -50,6 +52,24 @@
 
 namespace gui {
 
+/// Delay (in ms) after the last filter change before the graph is compacted
+static constexpr int FILTERS_SETTLE_DELAY = 250;
+
+/// Maximal number of species whose details are kept in cache
+static constexpr int SPECIES_DETAILS_CACHE = 64;
+
+/// Fraction of the tree's diameter shown around a species focused on
+static constexpr float FOCUS_WINDOW = .1;
+
+/// Duration (in ms) of the move to a species focused on
+static constexpr int FOCUS_DURATION = 750;
+
+/// Period (in ms) at which the graph is laid out during a progressive build
+static constexpr int BUILD_LAYOUT_PERIOD = 1000;
+
+/// Delay (in ms) after which an unserved read of the tree is dropped
+static constexpr int TREE_REQUESTS_TIMEOUT = 2000;
+
 class OrientableLabel : public QLabel {
   Qt::Orientation _orientation;
 
@@ -167,14 +187,21 @@ auto makeSlider (Qt::Orientation orientation, const QString label,
 }
 
 void PhylogenyViewer_base::constructorDelegate(uint steps, Direction direction) {
+  _nodesScaleRadius = steps;
+  _pensRadius = -1;
+  _step = steps;
+  _speciesDetails.setMaxCost(SPECIES_DETAILS_CACHE);
+
   // Create cache
   _items = {
     false,
     new QGraphicsScene(this),
     nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr,
     nullptr, nullptr, nullptr,
     {},
-    PTGraphBuilder::buildPenSet()
+    PTGraphBuilder::buildPenSet(),
+    0
   };
 
   // Create view
@@ -184,6 +211,15 @@ void PhylogenyViewer_base::constructorDelegate(uint steps, Direction direction)
   _view->setDragMode(QGraphicsView::ScrollHandDrag);
   _view->setBackgroundBrush(Qt::white);
 
+  // Species finder
+  _finder = new SpeciesFinder;
+  _finder->hide();
+  connect(_finder, &SpeciesFinder::speciesSelected, [this] (SID sid) {
+    if (!focusOnSpecies(sid))
+      _finder->setStatus(QString("Species %1 is hidden by the current filters")
+                         .arg(uint(sid)));
+  });
+
   // Create layout
   auto *layout = new QBoxLayout(direction);
   Qt::Orientation orientation = Qt::Vertical;
@@ -242,6 +278,11 @@ void PhylogenyViewer_base::constructorDelegate(uint steps, Direction direction)
   print->setShortcut(Qt::ControlModifier + Qt::Key_P);
   connect(print, &QAction::triggered, [this] { renderTo(""); });
 
+  QAction *find = new QAction(style()->standardPixmap(QStyle::SP_FileDialogContentsView), "Find species", this);
+  find->setShortcut(Qt::ControlModifier + Qt::Key_F);
+  find->setCheckable(true);
+  connect(find, &QAction::toggled, _finder, &SpeciesFinder::setVisible);
+
   // Show names checkbox
   QCheckBox *survivorsOnly = new QCheckBox("Survivors only");
   survivorsOnly->setChecked(_config.survivorsOnly);
@@ -348,18 +389,64 @@ void PhylogenyViewer_base::constructorDelegate(uint steps, Direction direction)
   });
 
   // Simple actions
+  toolbar->addAction(find);
   toolbar->addAction(print);
 
   layout->addWidget(_view);
+  layout->addWidget(_finder);
   layout->addWidget(toolbar);
   setLayout(layout);
 
-  auto gvz = new Graphics_view_zoom(_view);
-  connect(gvz, &Graphics_view_zoom::zoomed, [autofit] {
+  _zoom = new Graphics_view_zoom(_view);
+  connect(_zoom, &Graphics_view_zoom::zoomed, [this, autofit] {
     autofit->setChecked(false);
+    updateLevelOfDetail();
   });
 
   setWindowTitle("Phylogenetic tree");
+
+  // Filters are applied incrementally while being changed and the graph
+  // compacted once they settle
+  _filtersTimer = new QTimer(this);
+  _filtersTimer->setSingleShot(true);
+  _filtersTimer->setInterval(FILTERS_SETTLE_DELAY);
+  connect(_filtersTimer, &QTimer::timeout, [this] { requestLayout(); });
+
+  if (_asynchronous) {
+    QTimer *eventsTimer = new QTimer(this);
+    connect(eventsTimer, &QTimer::timeout,
+            this, &PhylogenyViewer_base::processEvents);
+    eventsTimer->start(_config.eventsPollingPeriod);
+  }
+}
+
+void PhylogenyViewer_base::clearScene (void) {
+  _items.scene->clear();
+  _items.initialized = false;
+  _items.border = nullptr;
+  _items.root = nullptr;
+  _items.tracker = nullptr;
+  _items.contributors = nullptr;
+  _items.dimmer = nullptr;
+  _items.aggregates = nullptr;
+  _items.batchedLines = nullptr;
+  _items.batchedNodes = nullptr;
+  _items.staticTiles = nullptr;
+  _items.nodes.clear();
+  _items.layoutSlots = 0;
+
+  _living.clear();
+  _layoutRequests.clear();
+  _fullLayoutRequested = false;
+  for (auto *index: { &_bySurvival, &_byAppearance, &_byDisappearance }) {
+    index->nodes.clear();
+    index->dirty = true;
+  }
+  _byFullness.nodes.clear();
+  _byFullness.dirty = true;
+
+  _speciesDetails.clear();
+  _finder->clear();
 }
 
 void PhylogenyViewer_base::render(uint step) {
@@ -380,6 +467,16 @@ void PhylogenyViewer_base::resizeEvent(QResizeEvent*) {
 // == Config update
 // ============================================================================
 
+void PhylogenyViewer_base::setNodeVisible (Node *n, Node::Visibility v,
+                                           bool visible) {
+  bool wasVisible = n->subtreeVisible();
+  n->setVisible(v, visible);
+  if (n->subtreeVisible() == wasVisible)  return;
+
+  requestLayout(n->parent); // The whole graph for the root
+  _filtersTimer->start();
+}
+
 void PhylogenyViewer_base::toggleShowOnlySurvivors(void) {
   _config.survivorsOnly = !_config.survivorsOnly;
   updateNodes([this] (Node *n) {
@@ -390,26 +487,42 @@ void PhylogenyViewer_base::toggleShowOnlySurvivors(void) {
 }
 
 void PhylogenyViewer_base::updateMinSurvival(uint v) {
+  uint prev = _config.minSurvival;
   _config.minSurvival = v;
-  updateNodes([this] (Node *n) {
-    n->setVisible(Node::MIN_SURVIVAL, n->survival() >= _config.minSurvival);
+  _bySurvival.crossing(_items, prev, v, false, [this] (Node *n) {
+    setNodeVisible(n, Node::MIN_SURVIVAL, n->survival() >= _config.minSurvival);
   });
-  updateLayout();
 }
 
 void PhylogenyViewer_base::updateMinEnveloppe(int v) {
+  float prev = _config.minEnveloppe;
   _config.minEnveloppe = v / 100.;
-  updateNodes([this] (Node *n) {
-    n->setVisible(Node::MIN_FULLNESS, n->fullness() >= _config.minEnveloppe);
+  _byFullness.crossing(_items, prev, _config.minEnveloppe, false,
+                       [this] (Node *n) {
+    setNodeVisible(n, Node::MIN_FULLNESS, n->fullness() >= _config.minEnveloppe);
   });
-  updateLayout();
 }
 
 void PhylogenyViewer_base::updateClippingRange (uint t) {
+  uint prev = _config.clippingRange;
   _config.clippingRange = t;
-  updateNodes([this] (Node *n) {
-    n->updateNode(_config.clippingRange <= n->disappearance());
-    n->setVisible(Node::CLIP_RANGE, n->appearance() <= _config.clippingRange);
+
+  // Keep track of what is displayed as alive for the next (delta) step
+  bool aliveChanged = false;
+  _byDisappearance.crossing(_items, prev, t, false,
+                            [this, &aliveChanged] (Node *n) {
+    bool alive = (_config.clippingRange <= n->disappearance());
+    if (alive == n->alive())  return;
+
+    n->updateNode(alive);
+    if (alive)  _living.insert(n->id);
+    else        _living.erase(n->id);
+    indexSpecies(n);
+    aliveChanged = true;
+  });
+
+  _byAppearance.crossing(_items, prev, t, true, [this] (Node *n) {
+    setNodeVisible(n, Node::CLIP_RANGE, n->appearance() <= _config.clippingRange);
   });
 
   if (_items.initialized) {
@@ -420,9 +533,10 @@ void PhylogenyViewer_base::updateClippingRange (uint t) {
       dimPath.addEllipse(QPointF(0, 0), t, t);
     }
     _items.dimmer->setDimmingPath(dimPath);
-  }
 
-  updateLayout();
+    if (aliveChanged && !_items.aggregates->nodes.empty())
+      _items.aggregates->invalidate();
+  }
 }
 
 void PhylogenyViewer_base::toggleShowNames(void) {
@@ -435,7 +549,42 @@ void PhylogenyViewer_base::toggleShowNames(void) {
 
 void PhylogenyViewer_base::makeFit(bool autofit) {
   _config.autofit = autofit;
-  if (_config.autofit)  _view->fitInView(_items.scene->sceneRect(), Qt::KeepAspectRatio);
+  if (_config.autofit) {
+    _view->fitInView(_items.scene->sceneRect(), Qt::KeepAspectRatio);
+    updateLevelOfDetail();
+  }
+}
+
+void PhylogenyViewer_base::alignRadius (uint r,
+                                        const PTGraphBuilder::PenSet &pens) {
+  _items.border->setRadius(r);
+  _items.pens = pens; // Implicitly shared
+  _pensRadius = r;
+  if (_items.staticTiles) _items.staticTiles->clear();
+  updateNodesScale();
+  invalidateBatches();
+
+  _items.scene->setSceneRect(_items.border->boundingRect());
+  makeFit(_config.autofit);
+}
+
+bool PhylogenyViewer_base::focusOnSpecies (SID sid) {
+  const Node *n = _items.nodes.value(sid);
+  if (!n || !n->subtreeVisible()) return false;
+
+  // Show the neighbourhood of the species, unless already closer
+  const QSize size = _view->viewport()->size();
+  double scale = std::min(size.width(), size.height())
+               / (2 * FOCUS_WINDOW * std::max(radius(), 1.));
+  scale = std::max(scale, _view->transform().m11());
+
+  _zoom->focus_on(n->scenePos(), scale, FOCUS_DURATION);
+  return true;
+}
+
+void PhylogenyViewer_base::setHighlights (const QMap<SID, QColor> &highlights) {
+  _highlights = highlights;
+  updateNodes([] (Node *n) { n->updateColor(); });
 }
 
 void PhylogenyViewer_base::changeColorMode(int m) {
@@ -446,10 +595,13 @@ void PhylogenyViewer_base::changeColorMode(int m) {
     });
   }
 
+  if (_items.aggregates)  _items.aggregates->invalidate();
+
   if (_items.tracker) {
+    // Tracked species may not be inserted yet: wait for the build to complete
     bool visible = (_config.color == ViewerConfig::CUSTOM);
     _items.tracker->setVisible(visible);
-    if (visible)  _items.tracker->updateTracking();
+    if (visible && !_buildTimer)  _items.tracker->updateTracking();
   }
 }
 
@@ -457,32 +609,104 @@ void PhylogenyViewer_base::changeColorMode(int m) {
 // == Phylogeny update
 // ============================================================================
 
-void PhylogenyViewer_base::treeStepped (uint step, const LivingSet &living) {
-  updatePens();
+void PhylogenyViewer_base::treeStepped (uint step, const LivingSet &living,
+                                        const SpeciesDataUpdates &updates) {
+  _step = step;
+  for (const auto &u: updates)
+    if (Node *n = _items.nodes.value(u.first)) n->data = u.second;
 
-  for (Node *n: _items.nodes) n->updateNode(living.find(n->id) != living.end());
   _items.border->setRadius(step);
+  updatePens();
+  updateNodesScale();
+
+  // Living species survived one more step
+  _bySurvival.dirty = _byDisappearance.dirty = true;
+
+  // Both sets are sorted: merge them to find which species changed
+  const auto extinct = [this] (SID sid) {
+    if (Node *n = _items.nodes.value(sid)) {
+      n->updateNode(false);
+      indexSpecies(n);
+    }
+  };
+  auto prev = _living.begin();
+  for (SID sid: living) {
+    for (; prev != _living.end() && *prev < sid; ++prev)  extinct(*prev);
+
+    bool wasAlive = (prev != _living.end() && *prev == sid);
+    if (wasAlive) ++prev;
+
+    Node *n = _items.nodes.value(sid);
+    if (!n) continue;
+    if (wasAlive) n->timeline->invalidatePath();  // Only its end moved
+    else          n->updateNode(true);
+    indexSpecies(n);
+  }
+  for (; prev != _living.end(); ++prev) extinct(*prev);
+  _living = living;
+
+  if (!_items.aggregates->nodes.empty())  _items.aggregates->invalidate();
+  updateTracker();
+
+  // Lay out the species created during this step before anything is drawn
+  processLayoutRequests();
+
   _items.scene->setSceneRect(_items.border->boundingRect());
   makeFit(_config.autofit);
 
   if (_config.screenshots) {
-    QString filename;
-    QTextStream qss(&filename);
-    qss << "snapshots/ptree_step" << step << ".png";
-    renderTo(filename);
+    if (!_capture)  _capture = std::make_unique<FrameCapture>(_config);
+
+    // Frames get the level of detail of their own resolution (only
+    // recomputed when it changes noticeably)
+    const QRectF source = _items.scene->sceneRect();
+    _captureScale = _capture->scale(source);
+    updateLevelOfDetail();
+    _capture->capture(_items.scene, source, step);
   }
 }
 
+void PhylogenyViewer_base::updatePens (void) {
+  float r = radius();
+  if (_pensRadius <= r && r <= 1.05 * _pensRadius)  return;
+
+  // The static tiles were drawn with the previous widths
+  _pensRadius = r;
+  PTGraphBuilder::updatePenSet(r, _items.pens);
+  if (_items.staticTiles) _items.staticTiles->clear();
+}
+
+void PhylogenyViewer_base::updateNodesScale (void) {
+  float r = radius();
+  if (r <= 1.05 * _nodesScaleRadius)  return;
+
+  _nodesScaleRadius = r;
+  updateNodes([] (Node *n) { n->autoscale(); });
+}
+
 void PhylogenyViewer_base::genomeEntersEnveloppe (SID sid, GID) {
+  _speciesDetails.remove(uint(sid));
+
   const uint K = config::PTree::rsetSize();
   Node *n = _items.nodes.value(sid);
   n->rset = std::min(n->rset + 1, K);
   n->autoscale();
+  _byFullness.dirty = true;
+  indexSpecies(n);
 }
 
-void PhylogenyViewer_base::genomeLeavesEnveloppe (SID, GID) {}
+void PhylogenyViewer_base::genomeLeavesEnveloppe (SID sid, GID) {
+  _speciesDetails.remove(uint(sid));
+}
 
 void PhylogenyViewer_base::majorContributorChanged(SID sid, SID oldMC, SID newMC) {
+  reparent(sid, oldMC, newMC);
+
+  qDebug() << "Major contributor for species" << uint(sid)
+           << "changed from" << uint(oldMC) << "to" << uint(newMC);
+}
+
+void PhylogenyViewer_base::reparent (SID sid, SID oldMC, SID newMC) {
   Node *n = _items.nodes.value(sid),
        *oldP = _items.nodes.value(oldMC),
        *newP = _items.nodes.value(newMC);
@@ -492,7 +716,23 @@ void PhylogenyViewer_base::majorContributorChanged(SID sid, SID oldMC, SID newMC
   assert(oldP->id == oldMC);
   assert(newP->id == newMC);
 
+  bool wasVisible = n->subtreeVisible();
+
+  for (Node *a = oldP; a; a = a->parent)  a->subtreeAlive -= n->subtreeAlive;
+  for (Node *a = newP; a; a = a->parent)  a->subtreeAlive += n->subtreeAlive;
+
   n->parent = newP;
+
+  // Keep depths consistent for the common ancestor lookups
+  QStack<Node*> stack;
+  stack.push(n);
+  while (!stack.isEmpty()) {
+    Node *d = stack.pop();
+    d->depth = d->parent->depth + 1;
+    for (Node *s: d->subnodes)  stack.push(s);
+  }
+  _items.contributors->invalidate();
+
   oldP->subnodes.removeAll(n);
   newP->subnodes.append(n);
   std::sort(newP->subnodes.begin(), newP->subnodes.end(),
@@ -500,14 +740,310 @@ void PhylogenyViewer_base::majorContributorChanged(SID sid, SID oldMC, SID newMC
     return lhs->id > rhs->id;
   });
 
-  if (n->path)  n->path->start = newP;
+  if (n->path) {
+    n->path->start = newP;
+    n->path->invalidatePath();
+  }
   n->setVisible(Node::PARENT, newP->subtreeVisible());
 
-  PTGraphBuilder::updateLayout(_items);
+  n->layoutDirty = true;
+  if (n->subtreeVisible() != wasVisible)
+    requestLayout();
+  else {
+    requestLayout(oldP);
+    requestLayout(newP);
+  }
+}
+
+void PhylogenyViewer_base::removeSpecies (const std::vector<SID> &sids) {
+  if (sids.empty()) return;
+
+  // Overlays referring to the nodes are recomputed afterwards
+  _items.aggregates->setNodes({});
+  _items.contributors->hide();
+  _items.contributors->invalidate();
+  _items.tracker->clear();
+  if (_items.batchedNodes)  _items.batchedNodes->hovered = nullptr;
+
+  QSet<QGraphicsItem*> deleted;
+  for (SID sid: sids) {
+    Node *n = _items.nodes.value(sid);
+    if (!n) continue;
+    assert(n->subnodes.empty());
+
+    if (n->alive()) n->updateNode(false);
+    _living.erase(sid);
+    _layoutRequests.remove(n);
+
+    if (Node *p = n->parent) {
+      p->subnodes.removeAll(n);
+      requestLayout(p);
+    } else
+      _items.root = nullptr;
+
+    if (n->path) {
+      invalidateStaticTiles(n, n->path);
+      deleted.insert(n->path);
+    }
+    invalidateStaticTiles(n, n->timeline);
+    deleted.insert(n->timeline);
+    deleted.insert(n);
+
+    _items.nodes.remove(sid);
+    _speciesDetails.remove(uint(sid));
+    _finder->remove(sid);
+  }
+
+  if (BatchedNodes *b = _items.batchedNodes)
+    b->owned.erase(std::remove_if(b->owned.begin(), b->owned.end(),
+                                  [&deleted] (QGraphicsItem *i) {
+      return deleted.contains(i);
+    }), b->owned.end());
+  qDeleteAll(deleted);
+
+  for (auto *index: { &_bySurvival, &_byAppearance, &_byDisappearance })
+    index->dirty = true;
+  _byFullness.dirty = true;
+  invalidateBatches();
+  _items.border->setEmpty(!_items.root);
+}
+
+void PhylogenyViewer_base::restoreSpecies (SID sid, const Node::Data &data,
+                                           uint rset) {
+  Node *n = _items.nodes.value(sid);
+  if (!n) return;
+
+  const uint K = config::PTree::rsetSize();
+  _speciesDetails.remove(uint(sid));
+  n->data = data;
+  n->rset = std::min(rset, K);
+  n->updateNode(n->alive());  // Survival itself is updated with the step
+
+  // Its subtree may end earlier
+  n->layoutDirty = true;
+  requestLayout(n);
+
+  for (auto *index: { &_bySurvival, &_byAppearance, &_byDisappearance })
+    index->dirty = true;
+  _byFullness.dirty = true;
+  indexSpecies(n);
+}
+
+void PhylogenyViewer_base::indexSpecies (const Node *n, uint contributors) {
+  SpeciesFinder::Entry e;
+  e.sid = n->id;
+  e.appearance = n->appearance();
+  e.disappearance = n->disappearance();
+  e.count = n->data.count;
+  e.fullness = n->fullness();
+  e.alive = n->alive();
+
+  if (contributors != uint(-1))
+    e.contributors = contributors;
+  else if (const SpeciesFinder::Entry *prev = _finder->entry(n->id))
+    e.contributors = prev->contributors;
+
+  _finder->setEntry(e);
+}
+
+void PhylogenyViewer_base::addQueuedSpecies (const TreeEvent &e) {
+  PTreeBuildingCache cache { this, _config, e.step, _items };
+  PTGraphBuilder::insertSpecies({e.species, false}, cache);
+  registerSpecies(e.sid);
+  updateContributors(e.sid, e.species.contributors);
+  requestLayout(_items.nodes.value(e.pid));
+  _items.border->setEmpty(false);
+}
+
+void PhylogenyViewer_base::readTree (std::function<void(void)> f,
+                                     std::function<void(void)> dropped) {
+  if (!_asynchronous) {
+    f();
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock (_treeRequestsMutex);
+  _treeRequests.push_back({ std::move(f), std::move(dropped),
+                            std::chrono::steady_clock::now() });
+}
+
+void PhylogenyViewer_base::serveTreeRequests (void) {
+  std::vector<TreeRequest> requests;
+  {
+    std::lock_guard<std::mutex> lock (_treeRequestsMutex);
+    if (_treeRequests.empty())  return;
+    requests.swap(_treeRequests);
+  }
+  for (const auto &r: requests) r.read();
+}
+
+void PhylogenyViewer_base::serveIdleTreeRequests (void) {
+  if (_treeLockUsed) {
+    std::unique_lock<std::mutex> lock (_treeMutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+      serveTreeRequests();
+      return;
+    }
+  }
+
+  // Requests are queued in chronological order
+  std::vector<std::function<void(void)>> dropped;
+  {
+    std::lock_guard<std::mutex> lock (_treeRequestsMutex);
+    auto expiry = std::chrono::steady_clock::now()
+                - std::chrono::milliseconds(TREE_REQUESTS_TIMEOUT);
+    auto end = std::find_if(_treeRequests.begin(), _treeRequests.end(),
+                            [expiry] (const TreeRequest &r) {
+      return r.date > expiry;
+    });
+    for (auto it = _treeRequests.begin(); it != end; ++it)
+      if (it->dropped)  dropped.push_back(std::move(it->dropped));
+    _treeRequests.erase(_treeRequests.begin(), end);
+  }
+  for (const auto &f: dropped)  f();
+}
+
+void PhylogenyViewer_base::requestLayout (Node *n) {
+  if (n)  _layoutRequests.insert(n);
+  else    _fullLayoutRequested = true;
+
+  if (!_layoutScheduled) {
+    _layoutScheduled = true;
+    QTimer::singleShot(0, this, &PhylogenyViewer_base::processLayoutRequests);
+  }
+}
+
+void PhylogenyViewer_base::startProgressiveBuild (void) {
+  _buildTimer = new QTimer(this);
+  connect(_buildTimer, &QTimer::timeout,
+          this, &PhylogenyViewer_base::continueBuild);
+  _buildTimer->start(0);
+  _buildLayoutClock.start();
+}
+
+void PhylogenyViewer_base::progressiveBuildStep (uint inserted, uint total) {
+  emit onBuildProgress(inserted, total);
+
+  bool complete = (inserted == total);
+  if (complete || _buildLayoutClock.elapsed() > BUILD_LAYOUT_PERIOD) {
+    requestLayout();
+    _buildLayoutClock.restart();
+  }
+
+  if (complete) {
+    _buildTimer->stop();
+    _buildTimer->deleteLater();
+    _buildTimer = nullptr;
+    changeColorMode(_config.color);
+    emit onBuildFinished();
+  }
+}
+
+void PhylogenyViewer_base::processLayoutRequests (void) {
+  if (!_layoutScheduled)  return; // Already processed
+
+  if (_fullLayoutRequested)
+    updateLayout();
+  else {
+    PTGraphBuilder::updateLayout(_items, _layoutRequests);
+    updateTracker();
+  }
+
+  _layoutRequests.clear();
+  _fullLayoutRequested = false;
+  _layoutScheduled = false;
+  updateLevelOfDetail(true);
   _view->update();
+}
 
-  qDebug() << "Major contributor for species" << uint(sid)
-           << "changed from" << uint(oldMC) << "to" << uint(newMC);
+void PhylogenyViewer_base::updateLevelOfDetail (bool force) {
+  if (!_items.initialized)  return;
+
+  double scale = _view->transform().m11();
+  if (_capture) scale = std::max(scale, _captureScale);
+  if (!force && std::fabs(scale - _lodScale) <= .05 * _lodScale)  return;
+
+  _lodScale = scale;
+  setLevelOfDetail(scale);
+}
+
+void PhylogenyViewer_base::setLevelOfDetail (double scale) {
+  if (!_items.root) return;
+
+  const float threshold = _config.lodThreshold;
+  const auto footprint = [this, scale] (const Node *n) {
+    double r = n->subtreeAlive > 0 ? radius() : n->subtreeEnd;
+    return (n->subtreeArc[1] - n->subtreeArc[0]) * r * scale;
+  };
+
+  QVector<const Node*> aggregated;
+  QStack<QPair<Node*, bool>> stack;
+  stack.push({_items.root, false});
+  while (!stack.isEmpty()) {
+    auto top = stack.pop();
+    Node *n = top.first;
+    bool collapsed = top.second;
+    if (!n->subtreeVisible()) continue;
+
+    n->setCollapsed(collapsed);
+    bool aggregate = !collapsed && scale > 0 && n->subtreeSize > 1
+                  && footprint(n) < threshold;
+    n->setAggregated(aggregate);
+    if (aggregate)  aggregated.append(n);
+
+    for (Node *c: n->subnodes)  stack.push({c, collapsed || aggregate});
+  }
+
+  _items.aggregates->setNodes(aggregated);
+}
+
+void PhylogenyViewer_base::processEvents (void) {
+  bool stepped = false;
+  uint step = 0;
+  std::shared_ptr<const LivingSet> living;
+  SpeciesDataUpdates updates;
+
+  _events.consume([&] (TreeEvent e) {
+    switch (e.type) {
+    case TreeEvent::STEPPED:
+      stepped = true;
+      step = e.step;
+      living = e.living;
+      updates.insert(updates.end(), e.updates->begin(), e.updates->end());
+      emit onTreeStepped(e.step, *e.living);
+      break;
+
+    case TreeEvent::NEW_SPECIES:
+      addQueuedSpecies(e);
+      emit onNewSpecies(e.pid, e.sid);
+      break;
+
+    case TreeEvent::ENTERS_ENVELOPPE:
+      genomeEntersEnveloppe(e.sid, e.gid);
+      updateContributors(e.sid, e.contributors);
+      emit onGenomeEntersEnveloppe(e.sid, e.gid);
+      break;
+
+    case TreeEvent::LEAVES_ENVELOPPE:
+      genomeLeavesEnveloppe(e.sid, e.gid);
+      emit onGenomeLeavesEnveloppe(e.sid, e.gid);
+      break;
+
+    case TreeEvent::MC_CHANGED:
+      reparent(e.sid, e.pid, e.newMC);
+      updateContributors(e.sid, e.contributors);
+      emit onMajorContributorChanged(e.sid, e.pid, e.newMC);
+      break;
+    }
+  });
+
+  processLayoutRequests();
+  if (stepped) {
+    treeStepped(step, *living, updates);
+    _view->update();
+  }
+
+  serveIdleTreeRequests();
 }
 
 
@@ -523,7 +1059,7 @@ void PhylogenyViewer_base::contextMenuEvent(const Node &n,
   bool modified;
 
   QMenu menu (this);
-  menu.addSection(QString("Species ") + n.sid);
+  menu.addSection(QString("Species ") + n.sidString());
   QWidgetAction color (this);
   QLabel colorLabel;
   QAction start ("Start");
@@ -615,16 +1151,17 @@ void PhylogenyViewer_base::contextMenuEvent(const Node &n,
   if (modified) changeColorMode();
 }
 
-void PhylogenyViewer_base::speciesDetailPopup (SID id, QStringList data,
-                                               const QString &summary,
-                                               QGraphicsSceneMouseEvent *e) {
+void PhylogenyViewer_base::speciesDetailPopup (SID id,
+                                               const SpeciesDetails &details,
+                                               const QPoint &pos) {
+  QStringList data = details.data;
   QDialog *dialog = new QDialog (this);
     QVBoxLayout *vlayout = new QVBoxLayout;
       QLabel *generalLabel = new QLabel (data.takeFirst());
       QHBoxLayout *hlayout = new QHBoxLayout;
         QListWidget *listLabel = new QListWidget;
         QScrollArea *sumupScroller = new QScrollArea;
-          QLabel *sumupLabel = new QLabel (summary);
+          QLabel *sumupLabel = new QLabel (details.summary);
 
     vlayout->addWidget(generalLabel);
     vlayout->addLayout(hlayout);
@@ -638,21 +1175,84 @@ void PhylogenyViewer_base::speciesDetailPopup (SID id, QStringList data,
 
   dialog->setWindowTitle(QString("Details of species ")
                        + QString::number(std::underlying_type<SID>::type(id)));
-  dialog->move(e->screenPos());
+  dialog->move(pos);
   dialog->show();
 }
 
+/// Generates the details of a species and hands them back to the GUI thread
+class PhylogenyViewer_base::DetailsJob : public QRunnable {
+public:
+  /// Creates a job generating the details of \p sid at timestamp \p step
+  DetailsJob (PhylogenyViewer_base &viewer, SID sid, uint step,
+              DetailsGenerator generator, const QPoint &pos)
+    : _viewer(viewer), _sid(sid), _step(step), _generator(generator),
+      _pos(pos) {}
+
+  /// Generates the details and queues their display
+  void run (void) override {
+    SpeciesDetails details = _generator();
+    details.step = _step;
+
+    QMetaObject::invokeMethod(&_viewer,
+                              [&viewer = _viewer, sid = _sid, pos = _pos,
+                               details] {
+      viewer.speciesDetailsReady(sid, details, pos);
+    }, Qt::QueuedConnection);
+  }
+
+private:
+  PhylogenyViewer_base &_viewer;  ///< The owner
+  const SID _sid;                 ///< The species
+  const uint _step;               ///< Timestamp of the generation
+  DetailsGenerator _generator;    ///< The generating function
+  const QPoint _pos;              ///< Where to show the details
+};
+
+bool PhylogenyViewer_base::showCachedSpeciesDetails (SID sid, uint step,
+                                                     const QPoint &pos) {
+  const SpeciesDetails *details = _speciesDetails.object(uint(sid));
+  if (details && details->step == step) {
+    speciesDetailPopup(sid, *details, pos);
+    return true;
+  }
+
+  // Shown once ready
+  return _pendingDetails.contains(uint(sid));
+}
+
+void PhylogenyViewer_base::generateSpeciesDetails (SID sid, uint step,
+                                                   DetailsGenerator generator,
+                                                   const QPoint &pos) {
+  _pendingDetails.insert(uint(sid));
+  _detailsPool.start(new DetailsJob(*this, sid, step, generator, pos));
+}
+
+void PhylogenyViewer_base::speciesDetailsReady (SID sid,
+                                                const SpeciesDetails &details,
+                                                const QPoint &pos) {
+  _pendingDetails.remove(uint(sid));
+  _speciesDetails.insert(uint(sid), new SpeciesDetails(details));
+  speciesDetailPopup(sid, details, pos);
+}
+
 void PhylogenyViewer_base::renderTo (QString filename) {
   Node *hovered = nullptr;
   if (filename.isEmpty()) {
     hovered = _items.contributors->species;
     filename = QFileDialog::getSaveFileName(this, "Save to", ".",
-                                            "PDF (*.pdf);; Images (*svg,*.png)");
+                                            "PDF (*.pdf);; Images (*svg,*.png);;"
+                                            " Deep zoom (*.dzi)");
     if (hovered)  hovered->hoverEnterEvent(nullptr);
   }
 
   if (filename.isEmpty()) return;
 
+  // Do not render a layout lagging behind the last structural changes
+  processLayoutRequests();
+
+  // Files are not bound by frame times: show every species
+  setLevelOfDetail(0);
+
   bool failed = false;
   QString ext = filename.mid(filename.lastIndexOf('.')+1);
   if (ext == "pdf")
@@ -661,15 +1261,29 @@ void PhylogenyViewer_base::renderTo (QString filename) {
   else if (ext == "svg")
     renderToSVG(filename);
 
+  else if (ext == "dzi")
+    failed = !TiledRenderer(_items.scene, _items.scene->sceneRect(),
+                            outputSize()).renderDZI(filename);
+
   else {
     if (ext != "png")
       std::cout << "Unkown extension type '" << ext.toStdString()
                 << "'. Defaulting to png" << std::endl;
-    QPixmap pixmap = renderToPixmap(QSize());
-    failed = pixmap.isNull();
-    if (!failed)  pixmap.save(filename);
+
+    QSize size = outputSize();
+    if (std::max(size.width(), size.height()) > TiledRenderer::MAX_SINGLE_IMAGE)
+      failed = !TiledRenderer(_items.scene, _items.scene->sceneRect(), size)
+                  .renderPNG(filename);
+
+    else {
+      QPixmap pixmap = renderToPixmap(size);
+      failed = pixmap.isNull();
+      if (!failed)  pixmap.save(filename);
+    }
   }
 
+  updateLevelOfDetail(true);
+
   if (hovered)  hovered->hoverLeaveEvent(nullptr);
   if (failed)
     std::cerr << "Failed to save " << filename.toStdString() << std::endl;
@@ -677,14 +1291,14 @@ void PhylogenyViewer_base::renderTo (QString filename) {
     std::cout << "Saved to " << filename.toStdString() << std::endl;
 }
 
+QSize PhylogenyViewer_base::outputSize (void) const {
+  // Scaled both ways: large values are meant for posters (see TiledRenderer)
+  return FrameCapture::rasterSize(_items.scene->sceneRect(),
+                                  _config.rasterRadius);
+}
+
 QPixmap PhylogenyViewer_base::renderToPixmap (QSize requestedSize) const {
-  if (!requestedSize.isValid()) {
-    requestedSize = _items.scene->sceneRect().size().toSize();
-    if (_config.rasterRadius > 0
-        && requestedSize.width() > _config.rasterRadius)
-      requestedSize = requestedSize * _config.rasterRadius
-                                    / requestedSize.width();
-  }
+  if (!requestedSize.isValid()) requestedSize = outputSize();
 
   QPixmap pixmap (requestedSize);
   pixmap.fill(Qt::transparent);
@@ -1,15 +1,30 @@
 #ifndef KGD_PHYLOGENYVIEWER_H
 #define KGD_PHYLOGENYVIEWER_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include <QDialog>
 #include <QGraphicsView>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QBoxLayout>
+#include <QThreadPool>
+#include <QCache>
 
 #include "../core/tree/treetypes.h"
 
 #include "pviewerconfig.h"
 #include "ptgraphbuilder.h"
 #include "layer.hpp"
+#include "eventqueue.hpp"
+#include "framecapture.h"
+#include "speciesfinder.h"
 
 /*!
  * \file phylogenyviewer.h
@@ -17,6 +32,8 @@
  * Contains definition for the phylogeny top-level viewer
  */
 
+class Graphics_view_zoom;
+
 namespace gui {
 
 /// Base class for the phylogeny viewer. No template just the common functions,
@@ -36,14 +53,84 @@ protected:
   /// Configuration data controlling what to draw and how
   using Config = gui::ViewerConfig;
 
+  /// Copies of the data of the species that (may have) changed since the
+  /// previous step
+  using SpeciesDataUpdates = std::vector<std::pair<SID, phylogeny::SpeciesData>>;
+
 public:
   /// The direction in which to layout components
   using Direction = QBoxLayout::Direction;
 
+  /// Compact record of a PTree event, as queued in asynchronous mode
+  struct TreeEvent {
+    /// The type of event
+    enum Type {
+      STEPPED,          ///< \see phylogeny::Callbacks_t::onStepped
+      NEW_SPECIES,      ///< \see phylogeny::Callbacks_t::onNewSpecies
+      ENTERS_ENVELOPPE, ///< \see phylogeny::Callbacks_t::onGenomeEntersEnveloppe
+      LEAVES_ENVELOPPE, ///< \see phylogeny::Callbacks_t::onGenomeLeavesEnveloppe
+      MC_CHANGED        ///< \see phylogeny::Callbacks_t::onMajorContributorChanged
+    } type; ///< This event's type
+
+    /// Timestamp (STEPPED, NEW_SPECIES)
+    uint step = 0;
+
+    /// Species concerned
+    SID sid = SID::INVALID;
+
+    /// Parent species (NEW_SPECIES) or previous major contributor (MC_CHANGED)
+    SID pid = SID::INVALID;
+
+    /// New major contributor (MC_CHANGED)
+    SID newMC = SID::INVALID;
+
+    /// Genome concerned (ENTERS_ENVELOPPE, LEAVES_ENVELOPPE)
+    GID gid = GID::INVALID;
+
+    /// Copy of the still-alive species (STEPPED)
+    std::shared_ptr<const LivingSet> living = nullptr;
+
+    /// Copy of the data of the species that changed (STEPPED)
+    std::shared_ptr<const SpeciesDataUpdates> updates = nullptr;
+
+    /// Copy of the new species (NEW_SPECIES)
+    SpeciesSnapshot species;
+
+    /// Number of species contributing to sid (ENTERS_ENVELOPPE, MC_CHANGED)
+    uint contributors = 0;
+  };
+
+  /// Formatted contents of a species, as shown by speciesDetailPopup()
+  struct SpeciesDetails {
+    uint step;          ///< Timestamp at which they were generated
+    QStringList data;   ///< General data then one entry per enveloppe point
+    QString summary;    ///< Aggregated description of the enveloppe
+  };
+
   /// Create a phylogeny viewer with given \p parent and using \p config as
   /// its initial configuration
   PhylogenyViewer_base (QWidget *parent, Config config)
-    : QDialog(parent), _config(config) {}
+    : QDialog(parent), _config(config), _asynchronous(config.asynchronous),
+      _treeLockUsed(false), _fullLayoutRequested(false),
+      _layoutScheduled(false), _lodScale(0), _captureScale(0),
+      _bySurvival(&Node::survival), _byFullness(&Node::fullness),
+      _byAppearance(&Node::appearance), _byDisappearance(&Node::disappearance),
+      _filtersTimer(nullptr), _buildTimer(nullptr) {}
+
+  /// \returns whether tree events are queued instead of being processed
+  /// immediately
+  bool asynchronous (void) const {
+    return _asynchronous;
+  }
+
+  /// \returns exclusive access to the tree (asynchronous mode). A simulation
+  /// holding it while modifying the tree (e.g. around each step) lets the
+  /// viewer also read the tree between steps, such as when paused. Otherwise
+  /// the tree is only read when stepped, and unserved reads expire
+  std::unique_lock<std::mutex> lockTree (void) {
+    _treeLockUsed = true;
+    return std::unique_lock<std::mutex>(_treeMutex);
+  }
 
   /// Render the tree to file
   void render (uint step);
@@ -56,6 +143,34 @@ public:
     return _items.border->radius;
   }
 
+  /// Draws the tree inside a border of radius \p r with \p pens (built for
+  /// that radius), so that several trees can be aligned on common time radii
+  /// while sharing their pens
+  void alignRadius (uint r, const PTGraphBuilder::PenSet &pens);
+
+  /// Draws the species in \p highlights with their associated color, whatever
+  /// the color mode. Unlike color specifications, they get no tracking wedge
+  /// and may refer to species not (yet) in the graph
+  void setHighlights (const QMap<SID, QColor> &highlights);
+
+  /// \returns the highlight color of species \p sid (invalid if it has none)
+  QColor highlight (SID sid) const {
+    return _highlights.value(sid);
+  }
+
+  /// \returns the radius used to compute the nodes scale
+  /// \see updateNodesScale
+  float nodesScaleRadius (void) const {
+    return _nodesScaleRadius;
+  }
+
+  /// \returns the radius used to compute the pens widths (and the size of the
+  /// paths' extremities)
+  /// \see updatePens
+  float pensRadius (void) const {
+    return _pensRadius;
+  }
+
   /// \returns the tree bounding rectangle
   auto boundingRect (void) const {
     return _items.border->boundingRect();
@@ -76,6 +191,21 @@ public:
     return _items;
   }
 
+  /// Notifies the batch drawers (if any) that species items changed
+  void invalidateBatches (void) {
+    if (!_items.batchedNodes) return;
+    _items.batchedLines->invalidate();
+    _items.batchedNodes->invalidate();
+  }
+
+  /// Notifies the static tiles (if any) that item \p i of species \p n is
+  /// about to change or has just changed
+  void invalidateStaticTiles (const Node *n, const QGraphicsItem *i) {
+    StaticTiles *t = _items.staticTiles;
+    if (t && !t->tiles.isEmpty() && n->isStatic())
+      t->invalidate(i->sceneBoundingRect());
+  }
+
   /// \return the default configuration
   static auto defaultConfig (void) {
     return Config{};
@@ -111,13 +241,25 @@ signals:
   /// \copydetails phylogeny::Callbacks_t::onMajorContributorChanged
   void onMajorContributorChanged (SID sid, SID oldMC, SID newMC);
 
+  /// Emitted regularly while the graph is built in the background (see
+  /// ViewerConfig::progressiveBuild) with the number of species \p inserted
+  /// so far out of \p total
+  void onBuildProgress (uint inserted, uint total);
+
+  /// Emitted once the graph built in the background is complete
+  void onBuildFinished (void);
 
 protected slots:
   // ===========================================================================
   // Callbacks from PTree
 
   /// Process a step event (new timestamp/living species)
-  void treeStepped (uint step, const LivingSet &living);
+  ///
+  /// The nodes' copies of the species data are refreshed with \p updates.
+  /// Only the species whose state changed (newly extinct or revived) are
+  /// updated, along with the timelines of the living ones.
+  void treeStepped (uint step, const LivingSet &living,
+                    const SpeciesDataUpdates &updates);
 
   /// Process a enveloppe change event
   void genomeEntersEnveloppe (SID sid, GID gid);
@@ -128,6 +270,15 @@ protected slots:
   /// Process a rooting change event
   void majorContributorChanged(SID sid, SID oldMC, SID newMC);
 
+  /// Process all queued tree events (asynchronous mode).
+  ///
+  /// Signals are emitted, in order, for every event. Stepping is only applied
+  /// for the last step and the layout is computed at most once.
+  void processEvents (void);
+
+  /// Process all pending layout requests at once (see requestLayout)
+  void processLayoutRequests (void);
+
   // ===========================================================================
   // Config update
 
@@ -154,13 +305,23 @@ public slots:
   /// Requests the scale of the view to be adapted to the size of the scene
   void makeFit (bool autofit);
 
-  /// Pops a detailed view a species node contents up
-  void speciesDetailPopup (SID id, QStringList data, const QString &summary,
-                           QGraphicsSceneMouseEvent *e);
+  /// Smoothly moves the view to species \p sid (zooming in if needed)
+  /// \returns false if the species is not currently shown
+  bool focusOnSpecies (SID sid);
+
+  /// Pops a detailed view of species \p id contents up at screen position
+  /// \p pos
+  void speciesDetailPopup (SID id, const SpeciesDetails &details,
+                           const QPoint &pos);
 
   /// Prints the current scene to the image file \p filename
   void renderTo (QString filename = "");
 
+  /// \returns the size of raster outputs: the scene's, scaled up or down to
+  /// ViewerConfig::rasterRadius (if set), as for the per-step frames
+  /// \see FrameCapture::rasterSize
+  QSize outputSize (void) const;
+
   /// Prints the current scene into a pixmap of size \p requestedSize
   QPixmap renderToPixmap (QSize requestedSize) const;
 
@@ -194,13 +355,291 @@ protected:
   /// The view in which the graphics items reside
   QGraphicsView *_view;
 
+  /// Wheel zooming and animated moves of the view
+  Graphics_view_zoom *_zoom;
+
+  /// Search panel over the species (hidden by default)
+  SpeciesFinder *_finder;
+
+  /// Whether tree events are queued (see ViewerConfig::asynchronous)
+  const bool _asynchronous;
+
+  /// Tree events waiting to be processed by the GUI thread
+  EventQueue<TreeEvent> _events;
+
+  /// Species displayed as alive (as of the last step)
+  LivingSet _living;
+
+  /// Species drawn with a dedicated color (see setHighlights)
+  QMap<SID, QColor> _highlights;
+
+  /// Timestamp of the last step processed by the GUI
+  uint _step;
+
+  /// A read of the tree waiting for the tree to be available
+  struct TreeRequest {
+    std::function<void(void)> read;     ///< The read itself
+    std::function<void(void)> dropped;  ///< Called (GUI thread) if it expired
+    std::chrono::steady_clock::time_point date; ///< When it was requested
+  };
+
+  /// Reads of the tree waiting for the tree's thread (asynchronous mode)
+  std::vector<TreeRequest> _treeRequests;
+
+  /// Protects #_treeRequests
+  std::mutex _treeRequestsMutex;
+
+  /// Held while the tree is modified or read (see lockTree)
+  std::mutex _treeMutex;
+
+  /// Whether the simulation uses lockTree()
+  std::atomic<bool> _treeLockUsed;
+
+  /// Runs \p f where the tree can safely be read: immediately in synchronous
+  /// mode or, in asynchronous mode, on the tree's thread when its next step is
+  /// notified or, if the simulation uses lockTree(), on the GUI thread while
+  /// the tree is idle. \p f must hand its results back through postToGUI().
+  /// Should the request expire instead, \p dropped is called (GUI thread)
+  void readTree (std::function<void(void)> f,
+                 std::function<void(void)> dropped = nullptr);
+
+  /// Runs the pending readTree() requests (on the tree's thread)
+  void serveTreeRequests (void);
+
+  /// Runs the pending readTree() requests if the tree is idle or drops those
+  /// that waited for too long (on the GUI thread)
+  void serveIdleTreeRequests (void);
+
+  /// Runs \p f on the GUI thread (immediately if already there)
+  void postToGUI (std::function<void(void)> f) {
+    QMetaObject::invokeMethod(this, f, Qt::AutoConnection);
+  }
+
+  /// Radius for which the nodes scale was last computed
+  float _nodesScaleRadius;
+
+  /// Radius for which the pens were last computed
+  float _pensRadius;
+
+  /// Background encoder for per-step screenshots (see ViewerConfig::screenshots)
+  std::unique_ptr<FrameCapture> _capture;
+
+  /// Nodes whose subnodes changed since the last layout
+  QSet<Node*> _layoutRequests;
+
+  /// Whether a full layout was requested since the last layout
+  bool _fullLayoutRequested;
+
+  /// Whether processLayoutRequests() is already scheduled
+  bool _layoutScheduled;
+
+  /// Request a layout update for the subnodes of \p n (the whole graph if
+  /// null). Requests are merged and processed once, on the next iteration of
+  /// the event loop
+  void requestLayout (Node *n = nullptr);
+
+  /// View scale for which the level of detail was last computed
+  double _lodScale;
+
+  /// Scale at which the screenshots are drawn. While capturing, the level of
+  /// detail is computed for the largest of this and the view scale so that a
+  /// single state serves both
+  double _captureScale;
+
+  /// Recomputes which subtrees are aggregated if the view (or capture) scale
+  /// changed by more than 5% since the last time (or if \p force is set)
+  void updateLevelOfDetail (bool force = false);
+
+  /// Aggregates every subtree narrower than ViewerConfig::lodThreshold pixels
+  /// when drawn at \p scale. A null scale shows every species
+  void setLevelOfDetail (double scale);
+
+  /// Nodes sorted on one of their values so that moving a threshold on that
+  /// value only visits the nodes crossing it
+  template <typename T>
+  struct ThresholdIndex {
+    /// Helper alias for the accessor to the indexed value
+    using Value = T (Node::*) (void) const;
+
+    const Value value;    ///< The indexed value
+    QVector<Node*> nodes; ///< The nodes, by increasing value
+    bool dirty;           ///< Whether values changed since the last sort
+
+    /// Creates an index on \p value (sorted on first use)
+    ThresholdIndex (Value value) : value(value), dirty(true) {}
+
+    /// Applies \p f to every node on which a threshold moving from \p from to
+    /// \p to may change something: those with a value in [from,to) or, if
+    /// \p upper, in (from,to] (bounds in either order).
+    /// If values changed (or species were added) since the last call, every
+    /// node is visited (and the index sorted again)
+    template <typename F>
+    void crossing (const GUIItems &items, T from, T to, bool upper, F f) {
+      const auto get = [this] (const Node *n) { return (n->*value)(); };
+
+      if (dirty || nodes.size() != items.nodes.size()) {
+        nodes.clear();
+        nodes.reserve(items.nodes.size());
+        for (Node *n: items.nodes)  nodes.append(n);
+        std::sort(nodes.begin(), nodes.end(),
+                  [get] (const Node *lhs, const Node *rhs) {
+          return get(lhs) < get(rhs);
+        });
+        dirty = false;
+
+        for (Node *n: nodes)  f(n);
+        return;
+      }
+
+      const auto bound = [this, get, upper] (T t) {
+        if (upper)
+          return std::upper_bound(nodes.begin(), nodes.end(), t,
+                                  [get] (T t, const Node *n) {
+            return t < get(n);
+          });
+        else
+          return std::lower_bound(nodes.begin(), nodes.end(), t,
+                                  [get] (const Node *n, T t) {
+            return get(n) < t;
+          });
+      };
+
+      auto end = bound(std::max(from, to));
+      for (auto it = bound(std::min(from, to)); it != end; ++it)  f(*it);
+    }
+  };
+
+  ThresholdIndex<uint> _bySurvival;       ///< For ViewerConfig::minSurvival
+  ThresholdIndex<float> _byFullness;      ///< For ViewerConfig::minEnveloppe
+  ThresholdIndex<uint> _byAppearance;     ///< For ViewerConfig::clippingRange
+  ThresholdIndex<uint> _byDisappearance;  ///< For ViewerConfig::clippingRange
+
+  /// Restarted by every filter change that altered the visible graph. A full
+  /// (compacting) layout is performed once it expires
+  QTimer *_filtersTimer;
+
+  /// Sets visibility value \p v of \p n to \p visible and requests an
+  /// (incremental) layout if that shows or hides its subtree
+  void setNodeVisible (Node *n, Node::Visibility v, bool visible);
+
+  /// Maximal duration (in ms) of a chunk of species insertions during a
+  /// progressive build. The event loop runs between two chunks
+  static constexpr int BUILD_CHUNK_DURATION = 30;
+
+  /// Calls continueBuild() on every iteration of the event loop while the
+  /// graph is built in the background
+  QTimer *_buildTimer;
+
+  /// Time since the graph was last laid out during a progressive build
+  QElapsedTimer _buildLayoutClock;
+
+  /// Starts calling continueBuild() until the graph is complete
+  void startProgressiveBuild (void);
+
+  /// Inserts the next chunk of species (progressive build)
+  virtual void continueBuild (void) = 0;
+
+  /// Notifies that \p inserted species out of \p total are in the graph
+  /// (progressive build). The graph is laid out periodically and, once
+  /// complete, the build is stopped
+  void progressiveBuildStep (uint inserted, uint total);
+
+  /// Helper alias for a function generating the details of a species
+  /// \attention Called on a worker thread: it must only use its own data
+  using DetailsGenerator = std::function<SpeciesDetails(void)>;
+
+  /// Task generating the details of a species
+  class DetailsJob;
+
+  /// Recently generated species details (by species identificator)
+  QCache<uint, SpeciesDetails> _speciesDetails;
+
+  /// Species whose details are being generated
+  QSet<uint> _pendingDetails;
+
+  /// Worker threads generating species details
+  QThreadPool _detailsPool;
+
+  /// Shows the details of species \p sid at \p pos if those in cache are
+  /// still valid at timestamp \p step
+  /// \returns whether nothing more is needed (details shown or being
+  /// generated)
+  bool showCachedSpeciesDetails (SID sid, uint step, const QPoint &pos);
+
+  /// Marks the details of \p sid as being generated (they are shown once
+  /// ready, see showCachedSpeciesDetails)
+  void requestSpeciesDetails (SID sid) {
+    _pendingDetails.insert(uint(sid));
+  }
+
+  /// Forgets that the details of \p sid were requested (e.g. when the tree
+  /// could not be read) so that they can be requested anew
+  void cancelSpeciesDetails (SID sid) {
+    _pendingDetails.remove(uint(sid));
+  }
+
+  /// Runs \p generator on a worker thread and shows its results at \p pos
+  /// (and caches them) once ready
+  void generateSpeciesDetails (SID sid, uint step, DetailsGenerator generator,
+                               const QPoint &pos);
+
+  /// Receives, on the GUI thread, the newly generated \p details of \p sid
+  void speciesDetailsReady (SID sid, const SpeciesDetails &details,
+                            const QPoint &pos);
+
+  /// Registers species \p sid, if it is displayed as alive, so that it is
+  /// properly updated on the next step
+  void registerSpecies (SID sid) {
+    Node *n = _items.nodes.value(sid);
+    if (!n) return;
+    if (n->alive())  _living.insert(sid);
+    indexSpecies(n);
+  }
+
+  /// Stores the current values of species \p n in the finder. Its number of
+  /// contributors is only changed if \p contributors is provided
+  void indexSpecies (const Node *n, uint contributors = uint(-1));
+
+  /// Stores the number of \p contributors of species \p sid in the finder
+  void updateContributors (SID sid, uint contributors) {
+    if (const Node *n = _items.nodes.value(sid))  indexSpecies(n, contributors);
+  }
+
+  /// Rescales all nodes if the tree radius grew by more than 5% since the
+  /// last time
+  void updateNodesScale (void);
+
+  /// Attach node \p sid to \p newP instead of \p oldP (layout is deferred)
+  void reparent (SID sid, SID oldMC, SID newMC);
+
+  /// Deletes the nodes of species \p sids, which must be leaves by the time
+  /// they are reached (e.g. most recent first), and the data referring to
+  /// them (layout is deferred)
+  void removeSpecies (const std::vector<SID> &sids);
+
+  /// Replaces the \p data and enveloppe size \p rset of species \p sid after
+  /// the tree went back in time (layout is deferred)
+  void restoreSpecies (SID sid, const Node::Data &data, uint rset);
+
+  /// Append a node for the newly created species described in \p e
+  void addQueuedSpecies (const TreeEvent &e);
+
+  /// Deletes all the graphics items (and the data referring to them) so
+  /// that the graph can be built anew
+  void clearScene (void);
+
   /// Constructor delegate called by template instantiations
   void constructorDelegate (uint steps,
                             Direction direction = Direction::LeftToRight);
 
-  /// Ensure pens are consistent with the current state of the ptree
-  void updatePens (void) {
-    PTGraphBuilder::updatePenSet(radius(), _items.pens);
+  /// Ensure pens are consistent with the current state of the ptree. Only
+  /// done (and the static tiles redrawn) when the radius changed noticeably
+  void updatePens (void);
+
+  /// Moves the tracked species wedges along with the layout (when shown)
+  void updateTracker (void) {
+    if (_items.tracker && _items.tracker->isVisible())
+      _items.tracker->updateGeometry();
   }
 
   /// Apply function \p f to all of the scene's current nodes
@@ -258,31 +697,102 @@ public:
     uint step = _ptree.step();
     constructorDelegate(step, direction);
 
-    build();
-
-    changeColorMode(_config.color);
+    // A progressive build applies the color mode once complete (see
+    // progressiveBuildStep)
+    if (_config.progressiveBuild)
+      buildProgressively();
+    else {
+      build();
+      changeColorMode(_config.color);
+    }
   }
 
   /// Helper function for getting a tree building cache
   auto cache (void) {
     return PTreeBuildingCache {
-      this, _config, _ptree.step(), _items
+      this, _config, _step, _items
     };
   }
 
   /// Request full parsing of the associated PTree for a complete graph generation
+  /// \attention Reads the tree: the tree must not be modified concurrently
   void build (void) {
     auto c = cache();
     Builder::fillScene(_ptree, c);
     Builder::updateLayout(_items);
 
+    _living.clear();
+    for (const Node *n: _items.nodes) {
+      if (n->alive()) _living.insert(n->id);
+      indexSpecies(n, contributorsCount(*_ptree.nodeAt(n->id)));
+    }
+
     updatePens();
     makeFit(_config.autofit);
   }
 
+  /// Discards the current graph and builds it anew from the associated PTree
+  /// (e.g. after it was modified without notifying the callbacks)
+  /// \attention Reads the tree: the tree must not be modified concurrently
+  void rebuild (void) {
+    clearScene();
+    callbacks.clear();
+    _step = _ptree.step();
+    build();
+    changeColorMode(_config.color);
+  }
+
+  /// Applies the differences \p r left by rewinding the associated tree (see
+  /// phylogeny::PlaybackTree::rewind) instead of building the graph anew: only
+  /// the species that changed are visited
+  /// \attention Reads the tree: the tree must not be modified concurrently
+  void rewound (const phylogeny::Rewind &r) {
+    // Species waiting for insertion may no longer exist
+    if (_buildTimer)  return rebuild();
+
+    callbacks.clear();
+    for (const auto &p: r.reparented) {
+      reparent(p.sid, p.from, p.to);
+      updateContributors(p.sid, contributorsCount(*_ptree.nodeAt(p.sid)));
+    }
+    removeSpecies(r.removed);
+
+    SpeciesDataUpdates updates;
+    updates.reserve(r.changed.size());
+    for (SID sid: r.changed) {
+      const auto &pn = *_ptree.nodeAt(sid);
+      restoreSpecies(sid, pn.data, pn.rset.size());
+      updates.emplace_back(sid, pn.data);
+    }
+
+    treeStepped(_ptree.step(), _ptree.aliveSpecies(), updates);
+  }
+
+  /// Creates the overlay items and inserts the species in the background,
+  /// by chunks small enough to keep the interface responsive. The species are
+  /// copied right away and their insertion order (see
+  /// PTGraphBuilder::insertionOrder) computed on a worker thread so that the
+  /// upper levels and the surviving lineages are shown first
+  /// \attention Reads the tree: the tree must not be modified concurrently
+  void buildProgressively (void) {
+    auto c = cache();
+    Builder::setupScene(c);
+    _items.border->setEmpty(!bool(_ptree.root()));
+    _living.clear();
+    updatePens();
+    makeFit(_config.autofit);
+
+    _buildOrder = std::async(std::launch::async,
+                             [species = Builder::snapshot(_ptree),
+                              step = _step] () mutable {
+      return Builder::insertionOrder(std::move(species), step);
+    });
+    startProgressiveBuild();
+  }
+
   /// Requests the base class to render the current view
   void render (void) {
-    PhylogenyViewer_base::render(_ptree.step());
+    PhylogenyViewer_base::render(_step);
   }
 
   /// Process a new species event (add a new node to the graph)
@@ -291,39 +801,58 @@ public:
     Node *parent = (pid != SID::INVALID) ? _items.nodes[pid] : nullptr;
     const auto &pn = *_ptree.nodeAt(sid);
     Builder::addSpecies(parent, pn, c);
-    Builder::updateLayout(_items);
+    registerSpecies(sid);
+    requestLayout(parent);
     _items.border->setEmpty(false);
-    _view->update();
   }
 
 protected:
   void hoverEvent (SID sid, bool entered) override {
-    if (entered && _config.showHybrids)
-      _items.contributors->show(sid, _items,
-                                _ptree.nodeAt(sid)->contributors);
-
-    else if (_items.contributors->isVisible())
+    _hovered = entered ? sid : SID::INVALID;
+    if (entered && _config.showHybrids) {
+      // Copied on the tree's thread, shown if still hovered
+      readTree([this, sid] {
+        if (!_ptree.contains(sid))  return; // Trimmed in the meantime
+        auto contributors = _ptree.nodeAt(sid)->contributors;
+        postToGUI([this, sid, contributors] {
+          if (_hovered == sid && _items.contributors)
+            _items.contributors->show(sid, _items, contributors);
+        });
+      });
+
+    } else if (_items.contributors->isVisible())
       _items.contributors->hide();
 
     emit onSpeciesHoverEvent(sid, entered);
   }
 
   void doubleClickEvent (const Node &gn, QGraphicsSceneMouseEvent *e) override {
-    const typename PTree::Node &n = *_ptree.nodeAt(gn.id);
-
-    QStringList data;
-    std::vector<GENOME> genomes;
-
-    data.append(gn.computeTooltip());
-    for (const auto &ep: n.rset) {
-      data.append(dumpEnveloppePoint(ep));
-      genomes.push_back(ep.genome);
-    }
-
-    std::ostringstream oss;
-    GENOME::aggregate(oss, genomes, config::PViewer::speciesDetailVerbosity());
-
-    speciesDetailPopup(gn.id, data, QString::fromStdString(oss.str()), e);
+    const QPoint pos = e->screenPos();
+    if (showCachedSpeciesDetails(gn.id, _step, pos)) return;
+    requestSpeciesDetails(gn.id);
+
+    // The tree may change while the details are generated: work on a copy
+    // (taken on the tree's thread)
+    const SID sid = gn.id;
+    QString general = gn.computeTooltip();
+    readTree([this, sid, general, pos] {
+      if (!_ptree.contains(sid)) {  // Trimmed in the meantime
+        postToGUI([this, sid] { cancelSpeciesDetails(sid); });
+        return;
+      }
+
+      const typename PTree::Node &n = *_ptree.nodeAt(sid);
+      auto points = std::make_shared<std::vector<EnveloppePoint>>();
+      points->reserve(n.rset.size());
+      for (const auto &ep: n.rset)  // Placeholders have no user data
+        if (ep.userData)
+          points->push_back({ ep.timestamp, ep.genome, *ep.userData });
+
+      uint step = _ptree.step();
+      postToGUI([this, sid, step, general, points, pos] {
+        generateDetails(sid, step, general, points, pos);
+      });
+    }, [this, sid] { cancelSpeciesDetails(sid); });
   }
 
 private:
@@ -333,20 +862,97 @@ private:
   /// The callbacks used by #_ptree
   PTCallbacks callbacks;
 
+  /// The species currently hovered (if any)
+  SID _hovered = SID::INVALID;
+
+  /// Copy of an enveloppe point, for off-thread details generation
+  struct EnveloppePoint {
+    uint timestamp; ///< Insertion date
+    GENOME genome;  ///< The representative genome
+    UDATA userData; ///< Its associated statistics
+  };
+
+  /// Generates the details of \p sid from \p general data (its tooltip) and
+  /// the copies of its enveloppe \p points taken at timestamp \p step
+  void generateDetails (SID sid, uint step, const QString &general,
+                        std::shared_ptr<const std::vector<EnveloppePoint>> points,
+                        const QPoint &pos) {
+    uint verbosity = config::PViewer::speciesDetailVerbosity();
+    generateSpeciesDetails(sid, step,
+                           [general, points, verbosity] {
+      SpeciesDetails details;
+      std::vector<GENOME> genomes;
+
+      details.data.append(general);
+      for (const EnveloppePoint &ep: *points) {
+        details.data.append(dumpEnveloppePoint(ep));
+        genomes.push_back(ep.genome);
+      }
+
+      std::ostringstream oss;
+      GENOME::aggregate(oss, genomes, verbosity);
+      details.summary = QString::fromStdString(oss.str());
+
+      return details;
+    }, pos);
+  }
+
+  /// Helper alias for a species waiting to be inserted
+  using PendingSpecies = Builder::PendingSpecies;
+
+  /// The insertion order, while being computed (progressive build)
+  std::future<std::vector<PendingSpecies>> _buildOrder;
+
+  /// The species to insert (progressive build)
+  std::vector<PendingSpecies> _pending;
+
+  /// Index of the next species to insert in #_pending
+  size_t _nextPending = 0;
+
+  void continueBuild (void) override {
+    if (_buildOrder.valid()) {
+      using namespace std::chrono_literals;
+      if (_buildOrder.wait_for(0s) != std::future_status::ready)  return;
+      _pending = _buildOrder.get();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    auto c = cache();
+    while (_nextPending < _pending.size()
+           && timer.elapsed() < BUILD_CHUNK_DURATION) {
+      const PendingSpecies &p = _pending[_nextPending++];
+      Builder::insertSpecies(p, c);
+      registerSpecies(p.species.id);
+      updateContributors(p.species.id, p.species.contributors);
+    }
+
+    progressiveBuildStep(_nextPending, _pending.size());
+    if (_nextPending == _pending.size())
+      _pending = std::vector<PendingSpecies>();
+  }
+
   void updateLayout (void) override {
     Builder::updateLayout(_items);
+    updateTracker();
+    updateLevelOfDetail(true);
     update();
   }
 
+  /// \returns the number of species contributing to \p n
+  static uint contributorsCount (const typename PTree::Node &n) {
+    return n.contributors.data().size();
+  }
+
   /// \returns a description of the data contained by this enveloppe point
-  QString dumpEnveloppePoint (const typename PTree::Node::Representative &ep) {
+  static QString dumpEnveloppePoint (const EnveloppePoint &ep) {
     QString s;
     s += "Insertion: ";
     s += QString::number(ep.timestamp);
     s += "\nGenome: ";
     s += QString::fromStdString(nlohmann::json(ep.genome).dump(2));
     s += "\nUser data: ";
-    s += QString::fromStdString(nlohmann::json(*ep.userData).dump(2));
+    s += QString::fromStdString(nlohmann::json(ep.userData).dump(2));
     s += "\n";
     return s;
   }
@@ -358,7 +964,9 @@ private:
 
 /// \brief Specialization of the callbacks for a PTree with parameter \p GENOME.
 ///
-/// Forwards events to the viewer.
+/// Forwards events to the viewer. In asynchronous mode (see
+/// gui::ViewerConfig::asynchronous) events are only queued: no GUI work is
+/// performed on the simulation thread.
 template <typename GENOME, typename UDATA>
 struct phylogeny::Callbacks_t<phylogeny::PhylogeneticTree<GENOME, UDATA>> {
   /// The PTree type at the source of these callbacks
@@ -376,15 +984,47 @@ struct phylogeny::Callbacks_t<phylogeny::PhylogeneticTree<GENOME, UDATA>> {
   /// Helper alias to a collection of still-alive species
   using LivingSet = phylogeny::LivingSet;
 
+  /// Helper alias to the queued events
+  using TreeEvent = typename PV::TreeEvent;
+
+  /// Helper alias to the copies of species data sent on every step
+  using SpeciesDataUpdates = typename PV::SpeciesDataUpdates;
+
   /// Creates a callback object associated with a specific viewer
   Callbacks_t (PV *v) : viewer(v) {}
 
+  /// Forgets the species changed since the last step (e.g. after the tree was
+  /// modified without notifications)
+  void clear (void) {
+    _touched.clear();
+  }
+
   /// Notify both the viewer and the outside world that the associated tree has
   /// been stepped
   ///
   /// \copydetails phylogeny::Callbacks_t::onStepped
   void onStepped (uint step, const LivingSet &living) {
-    viewer->treeStepped(step, living);
+    auto updates = std::make_shared<SpeciesDataUpdates>();
+    for (SID sid: living) _touched[sid] = viewer->_ptree.nodeAt(sid);
+    updates->reserve(_touched.size());
+    for (const auto &p: _touched) updates->emplace_back(p.first, p.second->data);
+
+    // Species alive now may still change before the next step
+    _touched.clear();
+    for (SID sid: living) _touched[sid] = viewer->_ptree.nodeAt(sid);
+
+    if (viewer->asynchronous()) {
+      viewer->serveTreeRequests();
+
+      TreeEvent e {TreeEvent::STEPPED};
+      e.step = step;
+      e.living = std::make_shared<const LivingSet>(living);
+      e.updates = std::move(updates);
+      viewer->_events.push(std::move(e));
+      return;
+    }
+
+    viewer->treeStepped(step, living, *updates);
     emit viewer->onTreeStepped(step, living);
   }
 
@@ -393,6 +1033,19 @@ struct phylogeny::Callbacks_t<phylogeny::PhylogeneticTree<GENOME, UDATA>> {
   ///
   /// \copydetails phylogeny::Callbacks_t::onNewSpecies
   void onNewSpecies (SID pid, SID sid) {
+    const auto &node = viewer->_ptree.nodeAt(sid);
+    _touched[sid] = node;
+
+    if (viewer->asynchronous()) {
+      TreeEvent e {TreeEvent::NEW_SPECIES};
+      e.step = viewer->_ptree.step();
+      e.sid = sid;
+      e.pid = pid;
+      e.species = gui::SpeciesSnapshot::from(*node);
+      viewer->_events.push(std::move(e));
+      return;
+    }
+
     viewer->newSpecies(pid, sid);
     emit viewer->onNewSpecies(pid, sid);
   }
@@ -402,7 +1055,19 @@ struct phylogeny::Callbacks_t<phylogeny::PhylogeneticTree<GENOME, UDATA>> {
   ///
   /// \copydetails phylogeny::Callbacks_t::onGenomeEntersEnveloppe
   void onGenomeEntersEnveloppe (SID sid, GID gid) {
+    _touched[sid] = viewer->_ptree.nodeAt(sid);
+
+    if (viewer->asynchronous()) {
+      TreeEvent e {TreeEvent::ENTERS_ENVELOPPE};
+      e.sid = sid;
+      e.gid = gid;
+      e.contributors = contributors(sid);
+      viewer->_events.push(std::move(e));
+      return;
+    }
+
     viewer->genomeEntersEnveloppe(sid, gid);
+    viewer->updateContributors(sid, contributors(sid));
     emit viewer->onGenomeEntersEnveloppe(sid, gid);
   }
 
@@ -411,6 +1076,14 @@ struct phylogeny::Callbacks_t<phylogeny::PhylogeneticTree<GENOME, UDATA>> {
   ///
   /// \copydetails phylogeny::Callbacks_t::onGenomeLeavesEnveloppe
   void onGenomeLeavesEnveloppe (SID sid, GID gid) {
+    if (viewer->asynchronous()) {
+      TreeEvent e {TreeEvent::LEAVES_ENVELOPPE};
+      e.sid = sid;
+      e.gid = gid;
+      viewer->_events.push(std::move(e));
+      return;
+    }
+
     viewer->genomeLeavesEnveloppe(sid, gid);
     emit viewer->onGenomeLeavesEnveloppe(sid, gid);
   }
@@ -420,13 +1093,34 @@ struct phylogeny::Callbacks_t<phylogeny::PhylogeneticTree<GENOME, UDATA>> {
   ///
   /// \copydetails phylogeny::Callbacks_t::onMajorContributorChanged
   void onMajorContributorChanged (SID sid, SID oldMC, SID newMC) {
+    if (viewer->asynchronous()) {
+      TreeEvent e {TreeEvent::MC_CHANGED};
+      e.sid = sid;
+      e.pid = oldMC;
+      e.newMC = newMC;
+      e.contributors = contributors(sid);
+      viewer->_events.push(std::move(e));
+      return;
+    }
+
     viewer->majorContributorChanged(sid, oldMC, newMC);
+    viewer->updateContributors(sid, contributors(sid));
     emit viewer->onMajorContributorChanged(sid, oldMC, newMC);
   }
 
 private:
   /// The associated viewer
   PV *viewer;
+
+  /// The species whose data may have changed since the last step. Held so
+  /// that those removed in the meantime (e.g. stillborns) can still be read
+  std::map<SID, typename PT::Node_ptr> _touched;
+
+  /// \returns the number of species contributing to \p sid (read on the
+  /// tree's thread)
+  uint contributors (SID sid) const {
+    return PV::contributorsCount(*viewer->_ptree.nodeAt(sid));
+  }
 };
 
 #endif // KGD_PHYLOGENYVIEWER_H
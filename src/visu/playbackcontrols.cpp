@@ -0,0 +1,93 @@
+#include <QHBoxLayout>
+
+#include "playbackcontrols.h"
+
+namespace gui {
+
+PlaybackControls::PlaybackControls (uint first, uint last,
+                                    Hook advance, Hook seek, QWidget *parent)
+  : QWidget(parent), _first(first), _last(last),
+    _advance(advance), _seek(seek), _position(first) {
+
+  _play = new QPushButton("Play");
+  _play->setCheckable(true);
+  connect(_play, &QPushButton::toggled, this, &PlaybackControls::setPlaying);
+
+  _speed = new QSpinBox;
+  _speed->setRange(1, 1000000);
+  _speed->setValue(100);
+  _speed->setSuffix(" steps/s");
+  _speed->setToolTip("Playback speed");
+
+  // Seeking may be expensive: only do it once the slider is released
+  _slider = new QSlider(Qt::Horizontal);
+  _slider->setRange(_first, _last);
+  _slider->setValue(_first);
+  _slider->setTracking(false);
+  connect(_slider, &QSlider::sliderMoved, this, &PlaybackControls::updateLabel);
+  connect(_slider, &QSlider::valueChanged, [this] (int v) {
+    _position = v;
+    _seek(v);
+    updateLabel(v);
+    emit positionChanged(v);
+  });
+
+  _label = new QLabel;
+  _label->setMinimumWidth(
+    _label->fontMetrics().boundingRect(QString::number(_last)).width() * 2);
+  updateLabel(_first);
+
+  auto *layout = new QHBoxLayout;
+  layout->addWidget(_play);
+  layout->addWidget(_speed);
+  layout->addWidget(_slider, 1);
+  layout->addWidget(_label);
+  setLayout(layout);
+
+  _timer = new QTimer(this);
+  _timer->setInterval(PLAYBACK_PERIOD);
+  connect(_timer, &QTimer::timeout, this, &PlaybackControls::tick);
+}
+
+void PlaybackControls::setPosition (uint step) {
+  _position = step;
+  QSignalBlocker blocker (_slider);
+  _slider->setValue(step);
+  updateLabel(step);
+}
+
+void PlaybackControls::setPlaying (bool p) {
+  if (_position >= _last)  p = false;
+
+  QSignalBlocker blocker (_play);
+  _play->setChecked(p);
+  _play->setText(p ? "Pause" : "Play");
+
+  if (p) {
+    _clock.start();
+    _timer->start();
+  } else
+    _timer->stop();
+}
+
+void PlaybackControls::tick (void) {
+  _position = std::min(double(_last),
+                       _position + _speed->value() * _clock.restart() / 1000.);
+
+  uint step = _position;
+  _advance(step);
+  {
+    QSignalBlocker blocker (_slider);
+    _slider->setValue(step);
+  }
+  updateLabel(step);
+  emit positionChanged(step);
+
+  if (step >= _last)  setPlaying(false);
+}
+
+void PlaybackControls::updateLabel (uint step) {
+  _label->setText(QString("%1 / %2").arg(step).arg(_last));
+}
+
+} // end of namespace gui
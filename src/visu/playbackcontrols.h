@@ -0,0 +1,95 @@
+#ifndef KGD_PLAYBACKCONTROLS_H
+#define KGD_PLAYBACKCONTROLS_H
+
+/*!
+ * \file playbackcontrols.h
+ *
+ * Contains the definition of the controls driving a journal playback
+ */
+
+#include <functional>
+
+#include <QWidget>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QSlider>
+#include <QLabel>
+#include <QTimer>
+#include <QElapsedTimer>
+
+namespace gui {
+
+/// Play/pause button, speed selector and position slider for replaying a
+/// recorded tree (see phylogeny::PlaybackTree).
+///
+/// While playing, the position moves forward at the requested speed (in steps
+/// per second) through the \p advance hook. Releasing the slider jumps to the
+/// selected step through the \p seek hook.
+class PlaybackControls : public QWidget {
+  Q_OBJECT
+public:
+  /// Function moving the playback to the provided step
+  using Hook = std::function<void(uint)>;
+
+  /// Creates the controls for a journal spanning steps [\p first,\p last]
+  PlaybackControls (uint first, uint last, Hook advance, Hook seek,
+                    QWidget *parent = nullptr);
+
+  /// \returns the current position
+  uint position (void) const {
+    return _position;
+  }
+
+  /// Sets the current position (without calling any hook)
+  void setPosition (uint step);
+
+  /// \returns whether the playback is running
+  bool playing (void) const {
+    return _timer->isActive();
+  }
+
+public slots:
+  /// Starts or stops the playback
+  void setPlaying (bool p);
+
+signals:
+  /// Emitted when the position changed
+  void positionChanged (uint step);
+
+private:
+  /// Period (in ms) at which the playback is moved forward
+  static constexpr int PLAYBACK_PERIOD = 40;
+
+  /// Timestamps of the first and last recorded steps
+  const uint _first, _last;
+
+  /// Moves the playback forward
+  const Hook _advance;
+
+  /// Moves the playback anywhere
+  const Hook _seek;
+
+  /// Current position (fractional so that low speeds progress)
+  double _position;
+
+  QPushButton *_play; ///< Play/pause button
+  QSpinBox *_speed;   ///< Playback speed, in steps per second
+  QSlider *_slider;   ///< Position selector
+  QLabel *_label;     ///< Position display
+
+  /// Triggers the playback ticks
+  QTimer *_timer;
+
+  /// Measures the time elapsed between two ticks
+  QElapsedTimer _clock;
+
+  /// Moves the playback forward by the time elapsed since the last tick
+  void tick (void);
+
+  /// Updates the position display
+  void updateLabel (uint step);
+};
+
+} // end of namespace gui
+
+#endif // KGD_PLAYBACKCONTROLS_H
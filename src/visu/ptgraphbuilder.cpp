@@ -1,17 +1,25 @@
 #include <QTextStream>
 
 #include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QGraphicsSceneEvent>
 #include <QToolTip>
 
 #include <QVector3D>
+#include <QThreadPool>
+#include <QSemaphore>
 #include <qmath.h>
 
+#include <numeric>
+#include <unordered_map>
+
 /// \todo remove
 #include <QDebug>
 
 #include "phylogenyviewer.h"
 #include "ptgraphbuilder.h"
 #include "graphicutils.h"
+#include "../render/radiallayout.h"
 
 namespace gui {
 
@@ -21,18 +29,14 @@ namespace gui {
 
 static constexpr bool debugDrawAABB = false;
 
-// == Legend ========================================================
-
-///< Note that the coordinate system is inverted (y points downward)
-static constexpr float LEGEND_PHASE = -M_PI / 2;
-static constexpr float LEGEND_SPACE = M_PI / 12;
-static constexpr uint LEGEND_TICKS = 4;
+// == Legend & nodes style (shared with the headless renderer) ======
 
-// == Nodes style ===================================================
+using render::LEGEND_PHASE;
+using render::LEGEND_SPACE;
+using render::LEGEND_TICKS;
 
-static constexpr float NODE_RADIUS = 10;
-static constexpr float NODE_MARGIN = 2;
-static constexpr float NODE_SIZE = 2 * (NODE_RADIUS + NODE_MARGIN);
+using render::NODE_RADIUS;
+using render::NODE_SIZE;
 
 // == Z-values ======================================================
 
@@ -48,15 +52,18 @@ static constexpr int TIMELINE_SURVIVOR_LEVEL = -6;
 static constexpr int PATH_EXTINCT_LEVEL = -10;
 static constexpr int TIMELINE_EXTINCT_LEVEL = -11;
 
+static constexpr int STATIC_TILES_LEVEL = -12;
+
+static constexpr int AGGREGATES_LEVEL = -15;
+
 static constexpr int STRACKING_LEVEL = -20;
 
 static constexpr int BOUNDS_LEVEL = -30;
 
 // == Paint style ===================================================
 
-static constexpr float AXIS_WIDTH = 1;
-static constexpr float PATH_WIDTH = 1.5;
-static constexpr float CONN_WIDTH = 2 * PATH_WIDTH;
+using render::AXIS_WIDTH;
+using render::PATH_WIDTH;
 
 static constexpr Qt::GlobalColor PATH_DEFAULT_COLOR = Qt::darkGray;
 static constexpr Qt::GlobalColor PATH_SURVIVOR_COLOR = Qt::red;
@@ -92,22 +99,9 @@ QPointF toCartesian (const PolarF &p) {
 }
 
 /// Generates and manages polar coordinates for the nodes/paths
-struct PolarCoordinates {
-
-  /// The angular phase used in coordinate computation.
-  /// Inverted to cope with Qt coordinate system.
-  static constexpr float phase = LEGEND_PHASE + LEGEND_SPACE/2.;
-
-  const double width; ///< Width of the graph (legend included)
+struct PolarCoordinates : public render::RadialCoordinates {
 
-  uint nextX; ///< X coordinate of the next node
-
-  /// \returns The angle for \p in the range [phase,2&pi;+phase]
-  static double primaryAngle (double a) {
-    while (a < phase) a += 2 * M_PI;
-    while (a > 2 * M_PI + phase) a -= 2 * M_PI;
-    return a;
-  }
+  using RadialCoordinates::primaryAngle;
 
   /// \returns The angle for \p in the range [phase,2&pi;+phase]
   static double primaryAngle (const QPointF &p) {
@@ -120,20 +114,13 @@ struct PolarCoordinates {
     return sqrt(p.x()*p.x() + p.y()*p.y());
   }
 
-  /// \returns the coordinate of node number \p i
-  static float xCoord (uint i) {  return i * NODE_SIZE; }
+  /// Creates a polar coordinates object spreading \p slots slots over the
+  /// graph (legend excluded)
+  PolarCoordinates (uint slots) : RadialCoordinates(slots) {}
 
-  /// Creates a polar coordinates object with the specified unscaled \p width
-  PolarCoordinates (double width)
-    : width(2 * M_PI * width / (2 * M_PI - LEGEND_SPACE)),
-      nextX(0) {}
-
-  /// \returns the position of the next point
-  QPointF operator() (uint time) {
-    double a = phase;
-    if (width > 0)  a += 2. * M_PI * xCoord(nextX++) / width;
-  //  qDebug() << "theta(" << nextX-1 << "): " << a * 180. / M_PI;
-    return toCartesian(a, time);
+  /// \returns the position of a point in slot \p slot at time \p time
+  QPointF operator() (uint slot, uint time) const {
+    return toCartesian(angle(slot), time);
   }
 };
 
@@ -185,6 +172,8 @@ void Node::invalidate(const QPointF &newPos) {
   if (path) path->invalidatePath();
   timeline->invalidatePath();
   update();
+  treeBase->invalidateBatches();
+  if (Contributors *c = treeBase->items().contributors)  c->invalidate();
 }
 
 QString Node::computeTooltip (void) const {
@@ -202,9 +191,9 @@ QString Node::computeTooltip (void) const {
 }
 
 void Node::autoscale(void) {
-  setScale(fullness() * PTGraphBuilder::nodeWidth(treeBase->radius()));
-  updateTooltip();
+  setScale(fullness() * PTGraphBuilder::nodeWidth(treeBase->nodesScaleRadius()));
   update();
+  treeBase->invalidateBatches();
 }
 
 void Node::setVisible (Visibility v, bool visible) {
@@ -212,14 +201,19 @@ void Node::setVisible (Visibility v, bool visible) {
       && treeBase->config().color == ViewerConfig::Colors::SURVIVORS)
     visible &= _onSurvivorPath;
 
+  if (visibilities.testFlag(v) == visible)  return;
+
+  bool wasVisible = subtreeVisible();
   visibilities.setFlag(v, visible);
 
   if (v != SHOW_NAME) {
     // Update own visibility as well as related paths'
     visible = subtreeVisible();
-    if (path) path->setVisible(visible);
-    timeline->setVisible(visible);
-    QGraphicsItem::setVisible(visible);
+    updateItemsVisibility();
+    if (visible == wasVisible)  return;
+
+    // Reappearing subtrees may have changed while hidden: lay them out anew
+    if (visible)  layoutCapacity = 0;
 
     // Propagate to children
     for (Node *n: subnodes)
@@ -227,21 +221,63 @@ void Node::setVisible (Visibility v, bool visible) {
   }
 }
 
+void Node::updateItemsVisibility (void) {
+  bool visible = subtreeVisible() && !_collapsed;
+  if (path) path->setVisible(visible);
+  timeline->setVisible(visible);
+  QGraphicsItem::setVisible(visible);
+  invalidateStaticTiles();
+  treeBase->invalidateBatches();
+  if (Contributors *c = treeBase->items().contributors)  c->invalidate();
+}
+
+void Node::invalidateStaticTiles (void) {
+  if (path) treeBase->invalidateStaticTiles(this, path);
+  if (timeline) treeBase->invalidateStaticTiles(this, timeline);
+}
+
+void Node::setCollapsed (bool c) {
+  if (c == _collapsed)  return;
+  _collapsed = c;
+  updateItemsVisibility();
+}
+
+void Node::updateSubtreeSummary (void) {
+  subtreeSize = 1;
+  subtreeEnd = data.lastAppearance;
+  subtreeArc[0] = subtreeArc[1] = PolarCoordinates::primaryAngle(pos());
+  for (const Node *n: subnodes) {
+    if (!n->subtreeVisible()) continue;
+    subtreeSize += n->subtreeSize;
+    subtreeEnd = std::max(subtreeEnd, n->subtreeEnd);
+    subtreeArc[0] = std::min(subtreeArc[0], n->subtreeArc[0]);
+    subtreeArc[1] = std::max(subtreeArc[1], n->subtreeArc[1]);
+  }
+}
+
 void Node::updateNode (bool alive) {
+  // Keep the subtrees summaries up to date
+  if (alive != _alive)
+    for (Node *n = this; n; n = n->parent) {
+      n->subtreeAlive += alive ? 1 : -1;
+      n->subtreeEnd = std::max(n->subtreeEnd, data.lastAppearance);
+    }
+
   _alive = alive;
 
-  // Notify hierarchy
+  // Notify hierarchy (whose survivor section of the timeline may change)
   if (_alive) {
     Node *n = this;
     do {
       n->setOnSurvivorPath(true);
       n = n->parent;
+      if (n)  n->timeline->invalidatePath();
     } while (n && !n->_onSurvivorPath);
   }
 
   if (path) path->invalidatePath();
   timeline->invalidatePath();
-  updateTooltip();
+  if (!toolTip().isEmpty()) updateTooltip(); // Only while hovered
   autoscale();
 }
 
@@ -251,10 +287,13 @@ void Node::setOnSurvivorPath (bool osp) {
     { TIMELINE_EXTINCT_LEVEL, TIMELINE_SURVIVOR_LEVEL },
     { PATH_EXTINCT_LEVEL, PATH_SURVIVOR_LEVEL },
   };
+  invalidateStaticTiles();
   bool s = _onSurvivorPath = osp;
   setZValue(levels[0][s]);
   if (timeline) timeline->setZValue(levels[1][s]);
   if (path) path->setZValue(levels[2][s]);
+  invalidateStaticTiles();
+  treeBase->invalidateBatches();
 
 //  auto q = qDebug();
 //  q << "N" << sid << ": " << s << zValue();
@@ -263,11 +302,13 @@ void Node::setOnSurvivorPath (bool osp) {
 }
 
 void Node::hoverEnterEvent(QGraphicsSceneHoverEvent*) {
+  updateTooltip();
   treeBase->hoverEvent(id, true);
 }
 
 /// Triggers a callback when this species node is no longer hovered
 void Node::hoverLeaveEvent(QGraphicsSceneHoverEvent*) {
+  setToolTip(QString());
   treeBase->hoverEvent(id, false);
 }
 
@@ -281,27 +322,26 @@ void Node::contextMenuEvent(QGraphicsSceneContextMenuEvent *e) {
 
 void Node::updateColor(void) {
   const auto &config = treeBase->config();
-  coloredPen.setColor(PATH_DEFAULT_COLOR);
-  timeline->colors[0] = PATH_DEFAULT_COLOR;
-  timeline->colors[1] = PATH_DEFAULT_COLOR;
+  color = PATH_DEFAULT_COLOR;
 
-  if (config.color == ViewerConfig::SURVIVORS && _onSurvivorPath) {
-    coloredPen.setColor(PATH_SURVIVOR_COLOR);
-    timeline->colors[0] = PATH_SURVIVOR_COLOR;
-    timeline->colors[1] = PATH_DEFAULT_COLOR;
+  if (config.color == ViewerConfig::SURVIVORS && _onSurvivorPath)
+    color = PATH_SURVIVOR_COLOR;
 
-  } else if (config.color == ViewerConfig::CUSTOM) {
+  else if (config.color == ViewerConfig::CUSTOM) {
     /// TODO could be improved. See GUIItems::nodes
     auto it = config.colorSpecs.find(id);
-    if (it != config.colorSpecs.end()) {
-      coloredPen.setColor(it->color);
-      timeline->colors[0] = it->color;
-      timeline->colors[1] = it->color;
-    }
+    if (it != config.colorSpecs.end())
+      color = it->color;
   }
+
+  QColor highlight = treeBase->highlight(id);
+  if (highlight.isValid()) color = highlight;
+
   update();
   timeline->update();
   if (path) path->update();
+  invalidateStaticTiles();
+  treeBase->invalidateBatches();
 }
 
 void Node::paint (QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*) {
@@ -319,6 +359,7 @@ void Node::paint (QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
   }
 
   if (visibilities.testFlag(SHOW_NAME)) {    
+    const QString sid = sidString();
     float pw = painter->pen().widthF();
     QRectF r (boundingRect().center() - QPoint(NODE_RADIUS, NODE_RADIUS),
               2*QSizeF(NODE_RADIUS, NODE_RADIUS));
@@ -337,7 +378,7 @@ void Node::paint (QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
       painter->drawText(r, Qt::AlignCenter, sid, &bounds);
 
       painter->setBrush(Qt::white);
-      painter->setPen(coloredPen);
+      painter->setPen(color);
       painter->drawEllipse(boundingRect().center(), NODE_RADIUS, NODE_RADIUS);
 
       // Scale and do paint
@@ -354,6 +395,22 @@ void Node::paint (QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
 }
 
 
+/// \returns the deepest common ancestor of \p a and \p b
+template <typename N>
+static N* commonAncestor (N *a, N *b) {
+  while (a->depth > b->depth) a = a->parent;
+  while (b->depth > a->depth) b = b->parent;
+  while (a != b) a = a->parent, b = b->parent;
+  return a;
+}
+
+/// \returns whether \p a is \p b or one of its ancestors
+static bool isAncestor (const Node *a, const Node *b) {
+  while (b->depth > a->depth) b = b->parent;
+  return a == b;
+}
+
+
 // ============================================================================
 // == Path between a parent and child node
 // ============================================================================
@@ -365,28 +422,54 @@ Path::Path(Node *start, Node *end) : start(start), end(end) {
 }
 
 void Path::invalidatePath(void) {
+  setBounds(computeShape(start->scenePos(), end->scenePos())
+              .boundingRect().normalized());
+}
+
+QPainterPath Path::computeShape (const QPointF &start, const QPointF &end) {
+  QPainterPath shape;
+  double sAngle = PolarCoordinates::primaryAngle(start);
+  shape.moveTo(toCartesian(sAngle, radius(end)));
+  addArc(shape, end);
+  return shape;
+}
+
+void Path::setBounds (const QRectF &bounds) {
+  end->treeBase->invalidateStaticTiles(end, this);
   prepareGeometryChange();
 
+  _bounds = bounds;
   _shape = QPainterPath();
-  double sAngle = PolarCoordinates::primaryAngle(start->scenePos());
-  _shape.moveTo(toCartesian(sAngle, radius(end->scenePos())));
-  addArc(_shape, end->scenePos());
 
   update();
+  end->treeBase->invalidateStaticTiles(end, this);
+  end->treeBase->invalidateBatches();
 }
 
 QRectF Path::boundingRect() const {
   qreal extra = (PATH_WIDTH + 20) / 2.0;
 
-  return shape().boundingRect().normalized()
-      .adjusted(-extra, -extra, extra, extra);
+  return _bounds.adjusted(-extra, -extra, extra, extra);
 }
 
-void Path::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*) {
+QPainterPath Path::shape (void) const {
+  if (_shape.isEmpty())
+    _shape = computeShape(start->scenePos(), end->scenePos());
+  return _shape;
+}
+
+void Path::paint(QPainter *painter, const QStyleOptionGraphicsItem*,
+                 QWidget *widget) {
 //  qDebug() << parentItem() << "Path(" << start->sid << ">" << end->sid
 //           << ")::paint(" << end->onSurvivorPath() << "," << zValue() << ")";
 
   painter->save();
+    const StaticTiles *tiles = end->treeBase->items().staticTiles;
+    if (tiles && tiles->covers(end, this, painter, widget)) {
+      painter->restore();
+      return;
+    }
+
     if (debugDrawAABB) {
       painter->save();
       QPen pen = painter->pen();
@@ -398,13 +481,15 @@ void Path::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*) {
     }
 
     QPen pen = end->treeBase->pathPen(details::PATH_BASE);
-    pen.setColor(end->coloredPen.color());
+    pen.setColor(end->color);
     painter->setPen(pen);
-    painter->drawPath(_shape);
+    const QPainterPath s = shape();
+    painter->drawPath(s);
 
-    auto R = PTGraphBuilder::plopRadius(PATH_WIDTH, start->treeBase->radius());
+    auto R = PTGraphBuilder::plopRadius(PATH_WIDTH,
+                                        start->treeBase->pensRadius());
     painter->setBrush(pen.color());
-    painter->drawEllipse(_shape.pointAtPercent(0), R, R);
+    painter->drawEllipse(s.pointAtPercent(0), R, R);
   painter->restore();
 }
 
@@ -418,9 +503,14 @@ Timeline::Timeline(Node *node) : node(node) {
 }
 
 void Timeline::invalidatePath(void) {
-  prepareGeometryChange();
+  QPointF p [3];
+  computePoints(node, node->scenePos(), p);
+  setPoints(p);
+}
 
-  points[0] = node->scenePos();
+void Timeline::computePoints (const Node *node, const QPointF &pos,
+                              QPointF *points) {
+  points[0] = pos;
   double a = PolarCoordinates::primaryAngle(points[0]);
 
   points[2] = node->data.lastAppearance * QPointF(cos(a), sin(a));
@@ -443,8 +533,24 @@ void Timeline::invalidatePath(void) {
 
     points[1] = l * QPointF(cos(a), sin(a));
   }
+}
+
+void Timeline::setPoints (const QPointF *p) {
+  node->treeBase->invalidateStaticTiles(node, this);
+  prepareGeometryChange();
+
+  std::copy(p, p+3, points);
 
   update();
+  node->treeBase->invalidateStaticTiles(node, this);
+  node->treeBase->invalidateBatches();
+}
+
+QColor Timeline::color (uint i) const {
+  // Only the survivor coloring differs between the two segments
+  if (i == 1 && node->treeBase->config().color == ViewerConfig::SURVIVORS)
+    return PATH_DEFAULT_COLOR;
+  return node->color;
 }
 
 QPainterPath Timeline::shape (void) const {
@@ -455,11 +561,18 @@ QPainterPath Timeline::shape (void) const {
 //  return QPainterPath();
 }
 
-void Timeline::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *) {
+void Timeline::paint(QPainter *painter, const QStyleOptionGraphicsItem *,
+                     QWidget *widget) {
 //  qDebug() << parentItem() << "Timeline(" << node->sid << ")::paint("
 //           << node->onSurvivorPath() << "," << zValue() << ")";
 
   painter->save();
+    const StaticTiles *tiles = node->treeBase->items().staticTiles;
+    if (tiles && tiles->covers(node, this, painter, widget)) {
+      painter->restore();
+      return;
+    }
+
     if (debugDrawAABB) {
       painter->save();
         QPen pen = painter->pen();
@@ -474,18 +587,19 @@ void Timeline::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidge
     painter->setPen(pen);
 
     if (points[0] != points[1]) {
-      pen.setColor(colors[0]);
+      pen.setColor(color(0));
       painter->setPen(pen);
       painter->drawLine(points[0], points[1]);
     }
 
     if (points[1] != points[2]) {
-      pen.setColor(colors[1]);
+      pen.setColor(color(1));
       painter->setPen(pen);
       painter->drawLine(points[1], points[2]);
     }
 
-    auto R = PTGraphBuilder::plopRadius(PATH_WIDTH, node->treeBase->radius());
+    auto R = PTGraphBuilder::plopRadius(PATH_WIDTH,
+                                        node->treeBase->pensRadius());
     painter->setBrush(pen.color());
     painter->drawEllipse(points[2], R, R);
   painter->restore();
@@ -500,6 +614,10 @@ Tracker::Tracker (VTree tree) : tree(tree), commonAncestor(nullptr) {
   setZValue(STRACKING_LEVEL);
 }
 
+Tracker::~Tracker (void) {
+  for (TrackedSpecies *ts: tracked) delete ts;
+}
+
 QRectF Tracker::boundingRect(void) const {
   return tree->boundingRect();
 }
@@ -512,18 +630,10 @@ struct Span {
   Span (double angle, uint radius)
     : a(PolarCoordinates::primaryAngle(angle)), r(radius) {}
 
-  Span (const Node *n) : Span(toPolar(n->pos()).a, n->disappearance()) {}
-
+  /// Uses the subtree summary maintained by the layout
   static Span extract (const Node *n) {
-    Span s (n);
-    for (const Node *c: n->subnodes)
-      if (c->isVisible())
-        s = max(s, extract(c));
-    return s;
-  }
-
-  friend Span max (const Span &lhs, const Span &rhs) {
-    return Span(std::max(lhs.a, rhs.a), std::max(lhs.r, rhs.r) );
+    return Span(n->subtreeArc[1],
+                n->subtreeAlive > 0 ? n->treeBase->radius() : n->subtreeEnd);
   }
 };
 
@@ -535,13 +645,12 @@ QColor toColor (const QVector3D &v) {
   return QColor::fromRgbF(v[0], v[1], v[2]);
 }
 
-QPainterPath buildPath (const Node *n) {
+QPainterPath buildPath (const Node *n, const Span &span) {
   QPainterPath path;
 
   QPointF startC = n->pos();
   path.moveTo(startC);
 
-  Span span = Span::extract(n);
   path.lineTo(toCartesian(angle(n->timeline->points[2]), span.r));
   addArc(path, toCartesian(span.a, span.r), 1);
   path.lineTo(toCartesian(angle(path.currentPosition()), radius(startC)));
@@ -549,87 +658,162 @@ QPainterPath buildPath (const Node *n) {
 
   return path;
 }
+} // end of namespace details
 
-struct AncestryNode {
-  const Node *node;
-
-  AncestryNode *parent = nullptr;
-  std::set<AncestryNode*> children;
+Tracker::TrackedSpecies* Tracker::create (const Node *n, bool monitored) {
+  auto *ts = new TrackedSpecies {
+    n, nullptr, {}, monitored, true, {}, {}, {}, {}, {}
+  };
+  tracked.insert(n, ts);
+  return ts;
+}
 
-  bool monitored = false;
-};
+void Tracker::link (TrackedSpecies *parent, TrackedSpecies *child) {
+  child->parent = parent;
+  parent->descendants.append(child);
+  parent->structureChanged = true;
+}
 
-template<typename SN, typename AN>
-void buildAncestries (SN &specsNodes, AN &anodes,
-                      AncestryNode **root, const Node *n) {
+void Tracker::unlink (TrackedSpecies *child) {
+  if (!child->parent) return;
+  child->parent->descendants.removeOne(child);
+  child->parent->structureChanged = true;
+  child->parent = nullptr;
+}
 
-  if (n->parent)  buildAncestries(specsNodes, anodes, root, n->parent);
-  if (anodes.find(n) == anodes.end()) {
-    AncestryNode *an = new AncestryNode;
-    an->node = n;
+void Tracker::add (const Node *n) {
+  if (TrackedSpecies *ts = tracked.value(n)) {  // Already a common ancestor
+    ts->monitored = true;
+    return;
+  }
 
-    if (n->parent) {
-      an->parent = anodes.value(n->parent, nullptr);
-      an->parent->children.insert(an);
+  TrackedSpecies *ts = create(n, true);
+  if (!commonAncestor) {
+    commonAncestor = ts;
+    return;
+  }
 
-    } else
-      *root = an;
+  // Outside of the current hierarchy: new root
+  if (!isAncestor(commonAncestor->species, n)) {
+    const Node *ca = gui::commonAncestor(commonAncestor->species, n);
+    TrackedSpecies *root = (ca == n) ? ts : create(ca, false);
+    link(root, commonAncestor);
+    if (root != ts) link(root, ts);
+    commonAncestor = root;
+    return;
+  }
 
-    auto it = specsNodes.find(n);
-    if (it != specsNodes.end()) {
-      an->monitored = true;
-      specsNodes.erase(it);
+  // Find the closest tracked ancestor
+  TrackedSpecies *p = commonAncestor;
+  for (bool descended = true; descended; ) {
+    descended = false;
+    for (TrackedSpecies *c: p->descendants) {
+      if (isAncestor(c->species, n)) {
+        p = c;
+        descended = true;
+        break;
+      }
     }
+  }
 
-    anodes[n] = an;
+  // Take over the descendants of n
+  for (TrackedSpecies *c: QList<TrackedSpecies*>(p->descendants)) {
+    if (!isAncestor(n, c->species)) continue;
+    unlink(c);
+    link(ts, c);
   }
-}
 
-/// TODO Remove
-void debugPrintAncestry (const AncestryNode *n, uint depth) {
-  {
-    auto q = qDebug().noquote().nospace();
-    q << QString(depth*2, ' ');
-    if (n->monitored)  q << "[";
-    q << n->node->sid;
-    if (n->monitored)  q << "]";
+  // Otherwise, at most one branch can share a closer ancestor with n
+  if (ts->descendants.empty()) {
+    for (TrackedSpecies *c: p->descendants) {
+      const Node *ca = gui::commonAncestor(c->species, n);
+      if (ca == p->species) continue;
+
+      TrackedSpecies *b = create(ca, false);
+      unlink(c);
+      link(p, b);
+      link(b, c);
+      link(b, ts);
+      return;
+    }
   }
-  for (const AncestryNode *c: n->children)  debugPrintAncestry(c, depth+1);
+
+  link(p, ts);
 }
 
-AncestryNode* simplify (AncestryNode *n) {
-  if (!n->monitored && n->children.size() == 1) {
-    AncestryNode *c = *n->children.begin();
-    c->parent = n->parent;
-    if (n->parent)  n->parent->children.insert(c);
-    return simplify(c);
-  } else {
-    decltype(n->children) children;
-    for (AncestryNode *c: n->children)
-      children.insert(simplify(c));
-    n->children = children;
-    return n;
+void Tracker::remove (const Node *n) {
+  TrackedSpecies *ts = tracked.value(n);
+  if (!ts || !ts->monitored)  return;
+  ts->monitored = false;
+
+  // Remove common ancestors that no longer join anything
+  while (ts && !ts->monitored && ts->descendants.size() <= 1) {
+    TrackedSpecies *parent = ts->parent,
+                   *child = ts->descendants.value(0, nullptr);
+
+    unlink(ts);
+    if (child) {
+      unlink(child);
+      if (parent) link(parent, child);
+    }
+    if (ts == commonAncestor) commonAncestor = child;
+
+    tracked.remove(ts->species);
+    delete ts;
+    ts = parent;
   }
 }
 
-Tracker::TrackedSpecies* buildRenderingTree (const AncestryNode *n,
-                                             const ViewerConfig &config) {
-  const auto &specs = config.colorSpecs;
+void Tracker::synchronize (bool verbose) {
+  const auto &specs = tree->config().colorSpecs;
+  const auto &nodes = tree->items().nodes;
+
+  // Find the visible species to track
+  QSet<const Node*> wanted;
+  for (const auto &spec: specs) {
+    if (!spec.enabled)  continue;
+
+    Node *n = nodes.value(spec.sid);
+    if (!n) {
+      if (verbose)
+        std::cerr << "Could not find a gui::Node for species " << spec.sid
+                  << ". Will be skipped." << std::endl;
+      continue;
+    }
+
+    if (!n->subtreeVisible()) {
+      if (verbose)
+        std::cerr << "Species " << spec.sid << " is hidden!" << std::endl;
+      continue;
+    }
+
+    wanted.insert(n);
+  }
+
+  if (verbose && wanted.empty()
+      && std::any_of(specs.begin(), specs.end(),
+                     [] (const auto &s) { return s.enabled; }))
+    std::cerr << "Specs pre-processing resulted in no visible, valid nodes"
+              << std::endl;
 
-  auto *ts = new Tracker::TrackedSpecies;
-  ts->species = n->node;
+  // Only apply the differences
+  QVector<const Node*> removed;
+  for (const TrackedSpecies *ts: tracked)
+    if (ts->monitored && !wanted.contains(ts->species))
+      removed.append(ts->species);
+  for (const Node *n: removed)  remove(n);
+  for (const Node *n: wanted) add(n);
+}
 
-  ts->path = buildPath(ts->species);
+void Tracker::updateColors (TrackedSpecies *ts) {
+  using namespace gui::details;
+  const auto &specs = tree->config().colorSpecs;
 
   QVector3D color;
-  QPainterPath childrenPath;
-  for (const AncestryNode *c: n->children) {
-    auto d = buildRenderingTree(c, config);
-    ts->descendants.append(d);
+  for (TrackedSpecies *d: ts->descendants) {
+    updateColors(d);
     color += toV3D(d->color);
-    childrenPath += d->path;
   }
-  ts->hollowedPath = ts->path - childrenPath;
 
   auto it = specs.find(ts->species->id);
   if (it != specs.end())  ts->color = it->color;
@@ -637,72 +821,61 @@ Tracker::TrackedSpecies* buildRenderingTree (const AncestryNode *n,
     color /= ts->descendants.size();
     ts->color = toColor(color);
   }
-
-  return ts;
 }
-} // end of namespace details
 
-void Tracker::updateTracking(void) {
+bool Tracker::updateGeometry (TrackedSpecies *ts) {
   using namespace gui::details;
 
-  const auto &config = tree->config();
-  if (config.color == ViewerConfig::CUSTOM) {
-    const auto &specs = config.colorSpecs;
-    const auto &nodes = tree->items().nodes;
-
-    // Erase tracking data
-    if (commonAncestor) delete commonAncestor;
-    commonAncestor = nullptr;
-
-    // Don't bother if it's empty
-    uint activeSpecs = 0;
-    for (const auto &spec: specs) activeSpecs += spec.enabled;
-    if (!activeSpecs)  return;
-
-    // Find common ancestries
-    std::set<const Node*> specsNodes;
-    for (const auto &spec: specs) {
-      if (!spec.enabled)  continue;
-
-      Node *n = nodes.value(spec.sid);
-      if (!n) {
-        std::cerr << "Could not find a gui::Node for species " << spec.sid
-                  << ". Will be skipped." << std::endl;
-        continue;
-      }
-
-      if (!n->isVisible()) {
-        std::cerr << "Species " << spec.sid << " is hidden!" << std::endl;
-        continue;
-      }
-
-      specsNodes.insert(n);
-    }
-
-    if (specsNodes.empty()) {
-      std::cerr << "Specs pre-processing resulted in no visible, valid nodes"
-                << std::endl;
-      return;
-    }
+  bool descendantsChanged = ts->structureChanged;
+  ts->structureChanged = false;
+  for (TrackedSpecies *d: ts->descendants)
+    descendantsChanged |= updateGeometry(d);
 
-    AncestryNode *root = nullptr;
-    QMap<const Node*, AncestryNode*> anodes;
-    while (!specsNodes.empty())
-      buildAncestries(specsNodes, anodes, &root, *specsNodes.begin());
+  const Node *n = ts->species;
+  Span span = Span::extract(n);
+  QPointF extent (span.a, span.r);
+  bool changed = (ts->path.isEmpty() || ts->anchor != n->pos()
+                  || ts->extent != extent);
+  if (changed) {
+    ts->path = buildPath(n, span);
+    ts->anchor = n->pos();
+    ts->extent = extent;
+  }
 
-    qDebug() << "Obtained ancestry:";
-    debugPrintAncestry(root, 0);
+  if (changed || descendantsChanged) {
+    QPainterPath childrenPath;
+    for (const TrackedSpecies *d: ts->descendants)  childrenPath += d->path;
+    ts->hollowedPath = ts->path - childrenPath;
+  }
 
-    root = simplify(root);
+  return changed;
+}
 
-    qDebug() << "Simplified ancestry:";
-    debugPrintAncestry(root, 0);
+void Tracker::updateTracking(void) {
+  if (tree->config().color != ViewerConfig::CUSTOM) return;
+  synchronize(true);
+  if (commonAncestor) {
+    updateColors(commonAncestor);
+    updateGeometry(commonAncestor);
+  }
+  update();
+}
 
-    commonAncestor = buildRenderingTree(root, config);
+void Tracker::clear (void) {
+  for (TrackedSpecies *ts: tracked) delete ts;
+  tracked.clear();
+  commonAncestor = nullptr;
+  update();
+}
 
-    // clean up
-    for (AncestryNode *n: anodes) delete n;
+void Tracker::updateGeometry(void) {
+  if (tree->config().color != ViewerConfig::CUSTOM) return;
+  synchronize(false);
+  if (commonAncestor) {
+    updateColors(commonAncestor);
+    updateGeometry(commonAncestor);
   }
+  update();
 }
 
 void Tracker::paint (QPainter *painter, const TrackedSpecies *ts) {
@@ -779,7 +952,7 @@ void Contributors::verticalPath(Node *n0, Node *n1, float w) {
   int m = std::min(ni0, ni1), M = std::max(ni0, ni1);
   for (int ni = m; ni <= M; ni++) {
     const auto &n = nodes[ni];
-    if (n->isVisible()) {
+    if (n->subtreeVisible()) {
       points.append(T{uint(n->id), timelineAnchor(n)});
     }
   }
@@ -805,25 +978,41 @@ void Contributors::makePath (Node *n, float w, bool vertical) {
     verticalPath(n, nullptr, w);
 }
 
+/// \returns a fingerprint of the contributions in \p contribs
+static uint signature (const phylogeny::Contributors &contribs) {
+  uint h = 0;
+  for (const auto &c: contribs)
+    h = qHash(qMakePair(uint(c.speciesID()), c.count()), h);
+  return h;
+}
+
 void Contributors::show (SID sid, const GUIItems &items,
                          const phylogeny::Contributors &contribs) {
 
-  const float R = tree->radius();
-
   // Retrieve graphic item of given species
   Node *n = species = items.nodes.value(sid);
   assert(n->id == sid);
 
-  // Retrieve all of its ancestors
-  std::vector<Node*> np;
-  {
-    Node *p = n;
-    while (p) np.push_back(p), p = p->parent;
+  uint s = signature(contribs);
+  auto it = flows.find(n);
+  if (it != flows.end() && it->signature == s) {
+    paths = it->paths;
+    labels = it->labels;
+
+  } else {
+    paths.clear();
+    labels.clear();
+    computeFlow(n, items, contribs);
+    flows.insert(n, Flow{paths, labels, s});
   }
 
-  // Clean previous drawing
-  paths.clear();
-  labels.clear();
+  QGraphicsItem::show();
+  update();
+}
+
+void Contributors::computeFlow (Node *n, const GUIItems &items,
+                                const phylogeny::Contributors &contribs) {
+  const SID sid = n->id;
 
   // Total contribution count (excluding itself and hidden/missing nodes)
   struct { float missing = 0, hidden = 0, self = 0, found = 0; } ccounts;
@@ -831,7 +1020,7 @@ void Contributors::show (SID sid, const GUIItems &items,
     const auto &nc = items.nodes.value(c.speciesID());
     if (c.speciesID() == sid)   ccounts.self = c.count();
     else if (!nc)               ccounts.missing += c.count();
-    else if (!nc->isVisible())  ccounts.hidden += c.count();
+    else if (!nc->subtreeVisible()) ccounts.hidden += c.count();
     else                        ccounts.found += c.count();
   }
 
@@ -842,52 +1031,43 @@ void Contributors::show (SID sid, const GUIItems &items,
     float w = c.count() / ccounts.found;
     Node *nc = items.nodes.value(c.speciesID());
     if (!nc)  continue;
-    if (!nc->isVisible())  continue;
+    if (!nc->subtreeVisible())  continue;
 
     // Store label
-    QPoint labelPos = nc->scenePos().toPoint();
-    labelPos.setX(labelPos.x() + .025*R);
     QString label = QString::number(100 * w, 'f', 2) + "%";
-    labels.append(QPair<QPointF, QString>(labelPos, label));
+    labels.append(QPair<QPointF, QString>(nc->scenePos(), label));
 
     Node *n_ = nullptr; // iterator
+    Node *ca = commonAncestor(n, nc);
 
     // Find path from contributor to common ancestor
     n_ = nc;
-    Node *ca = nc;
-    auto it = std::find(np.begin(), np.end(), n_);
-    while (it == np.end()) {  // Common ancestor not found
-      it = std::find(np.begin(), np.end(), n_->parent);
-      makePath(n_, w, it == np.end());
+    Node *nca = nc;
+    while (n_ != ca) {
+      makePath(n_, w, n_->parent != ca);
 
-      ca = n_;
+      nca = n_;
       n_ = n_->parent;
       assert(n_);
     }
-    assert(ca);
-
-    Node *commonAncestor = n_;
 
     // Find path from node to common ancestor
     n_ = n;
     Node *na = n;
-    while (n_ != commonAncestor) {
-      makePath(n_, w, n_->parent != commonAncestor);
+    while (n_ != ca) {
+      makePath(n_, w, n_->parent != ca);
 
       na = n_;
       n_ = n_->parent;
       assert(n_);
     }
-    assert(na);
 
     // Connect paths
-    verticalPath(ca, na, w);
+    verticalPath(nca, na, w);
   }
 
   float totalExternal = ccounts.missing + ccounts.hidden + ccounts.found;
   float total = ccounts.self + totalExternal;
-  QPoint labelPos = n->scenePos().toPoint();
-  labelPos.setX(labelPos.x() + .025*R);
   QString label;
   QTextStream qts (&label);
   qts.setRealNumberNotation(QTextStream::FixedNotation);
@@ -904,10 +1084,11 @@ void Contributors::show (SID sid, const GUIItems &items,
     qts << "-  hidden: " << PUT(ccounts.hidden / totalExternal) << "%\n";
   if (ccounts.found > 0)
     qts << "-   shown: " << PUT(ccounts.found / totalExternal) << "%\n";
-  labels.append(QPair<QPointF, QString>(labelPos, label));
+  labels.append(QPair<QPointF, QString>(n->scenePos(), label));
+}
 
-  QGraphicsItem::show();
-  update();
+void Contributors::invalidate (void) {
+  flows.clear();
 }
 
 void Contributors::hide (void) {
@@ -949,7 +1130,7 @@ void Contributors::paint (QPainter *painter,
     painter->setBackgroundMode(Qt::OpaqueMode);
     for (const auto &l: labels) {
       QFontMetrics fm = painter->fontMetrics();
-      QPointF p = l.first;
+      QPointF p = l.first + QPointF(.025 * R, 0);
       for (const QString &sl: l.second.split('\n')) {
         painter->drawText(p, sl);
         p.setY(p.y() + fm.height());
@@ -980,6 +1161,472 @@ void Dimmer::paint (QPainter *painter,
 }
 
 
+// ============================================================================
+// == Aggregated subtrees drawer
+// ============================================================================
+
+/// \returns the annular sector spanning angles [a0,a1] and radii [r0,r1]
+QPainterPath wedge (double a0, double a1, double r0, double r1) {
+  double d0 = -qRadiansToDegrees(a0), sweep = -qRadiansToDegrees(a1 - a0);
+  QPainterPath p;
+  p.moveTo(toCartesian(a0, r0));
+  p.arcTo(-r1, -r1, 2*r1, 2*r1, d0, sweep);
+  p.arcTo(-r0, -r0, 2*r0, 2*r0, d0 + sweep, -sweep);
+  p.closeSubpath();
+  return p;
+}
+
+Aggregates::Aggregates (VTree tree) : tree(tree) {
+  setZValue(AGGREGATES_LEVEL);
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+void Aggregates::invalidate (void) {
+  wedges.clear();
+  wedges.reserve(nodes.size());
+  for (const Node *n: nodes) {
+    float r0 = n->appearance(),
+          r1 = n->subtreeAlive > 0 ? tree->radius() : n->subtreeEnd;
+
+    QColor c = n->color;
+    c.setAlphaF(std::min(1., .25 + .25 * std::log10(n->subtreeSize)));
+
+    QPainterPath p = wedge(n->subtreeArc[0], n->subtreeArc[1], r0, r1);
+    wedges.append({p, p.boundingRect(), c});
+  }
+  update();
+}
+
+QRectF Aggregates::boundingRect(void) const {
+  return tree->boundingRect();
+}
+
+void Aggregates::paint (QPainter *painter,
+                        const QStyleOptionGraphicsItem *options, QWidget*) {
+  painter->save();
+    painter->setPen(Qt::NoPen);
+    for (const Wedge &w: wedges) {
+      if (!options->exposedRect.intersects(w.bounds)) continue;
+      painter->setBrush(w.color);
+      painter->drawPath(w.path);
+    }
+  painter->restore();
+}
+
+
+// ============================================================================
+// == Batched drawers
+// ============================================================================
+
+/// Maximal length (in scene units) of the segments approximating an arc
+static constexpr float ARC_STEP = 2;
+
+BatchedLines::BatchedLines (VTree tree) : tree(tree), dirty(true) {
+  setZValue(TIMELINE_EXTINCT_LEVEL);
+}
+
+void BatchedLines::rebuild (void) {
+  for (auto &b: batches)  b.clear();
+
+  QHash<QRgb, int> indices [2];
+  const auto batch = [this, &indices] (bool survivor, const QColor &c) -> Batch& {
+    auto &bs = batches[survivor];
+    auto it = indices[survivor].find(c.rgba());
+    if (it == indices[survivor].end()) {
+      it = indices[survivor].insert(c.rgba(), bs.size());
+      bs.append(Batch{c, {}, {}});
+    }
+    return bs[*it];
+  };
+
+  const QColor base = tree->pathPen(details::PATH_BASE).color();
+  for (const Node *n: tree->items().nodes) {
+    bool s = n->onSurvivorPath();
+
+    if (const Path *p = n->path; p && p->isVisible()) {
+      double a0 = PolarCoordinates::primaryAngle(p->start->scenePos()),
+             a1 = PolarCoordinates::primaryAngle(n->scenePos()),
+             r = radius(n->scenePos());
+      uint k = std::max(1., std::ceil(std::fabs(a1 - a0) * r / ARC_STEP));
+
+      Batch &b = batch(s, n->color);
+      QPointF p0 = toCartesian(a0, r);
+      b.plops.append(p0);
+      for (uint i=1; i<=k; i++) {
+        QPointF p1 = toCartesian(a0 + (a1 - a0) * i / k, r);
+        b.lines.append({p0, p1});
+        p0 = p1;
+      }
+    }
+
+    const Timeline *t = n->timeline;
+    if (t->isVisible()) {
+      QColor last = base;
+      for (uint i=0; i<2; i++) {
+        if (t->points[i] == t->points[i+1]) continue;
+        last = t->color(i);
+        batch(s, last).lines.append({t->points[i], t->points[i+1]});
+      }
+      batch(s, last).plops.append(t->points[2]);
+    }
+  }
+
+  dirty = false;
+}
+
+QRectF BatchedLines::boundingRect(void) const {
+  return tree->boundingRect();
+}
+
+void BatchedLines::paint (QPainter *painter,
+                          const QStyleOptionGraphicsItem*, QWidget*) {
+  if (dirty)  rebuild();
+
+  QPen pen = tree->pathPen(details::PATH_BASE);
+  QPen plopPen = pen;
+  plopPen.setWidthF(
+    2 * PTGraphBuilder::plopRadius(PATH_WIDTH, tree->pensRadius())
+      + pen.widthF());
+  plopPen.setCapStyle(Qt::RoundCap);
+
+  painter->save();
+    for (const auto &bs: batches) {
+      for (const Batch &b: bs) {
+        pen.setColor(b.color);
+        painter->setPen(pen);
+        painter->drawLines(b.lines);
+
+        plopPen.setColor(b.color);
+        painter->setPen(plopPen);
+        painter->drawPoints(b.plops.data(), b.plops.size());
+      }
+    }
+  painter->restore();
+}
+
+BatchedNodes::BatchedNodes (VTree tree)
+  : tree(tree), hovered(nullptr), dirty(true) {
+  setZValue(NODE_EXTINCT_LEVEL);
+  setAcceptHoverEvents(true);
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+BatchedNodes::~BatchedNodes (void) {
+  for (QGraphicsItem *i: owned) delete i;
+}
+
+void BatchedNodes::rebuild (void) {
+  for (auto &v: named)  v.clear();
+
+  QVector<Node*> visible;
+  float maxScale = 0;
+  for (Node *n: tree->items().nodes) {
+    if (!n->subtreeVisible()) continue;
+
+    // Named species are still shown over the wedge of a collapsed subtree
+    if (n->visibilities.testFlag(Node::SHOW_NAME))
+      named[n->onSurvivorPath()].append(n);
+
+    if (n->collapsed()) continue;
+    visible.append(n);
+    maxScale = std::max(maxScale, float(n->scale()));
+  }
+
+  // Counting sort of the nodes into cells at least as large as a node
+  Grid &g = grid;
+  g.bounds = tree->boundingRect();
+  g.cellSize = std::max({NODE_SIZE * maxScale, float(g.bounds.width()) / 256,
+                         float(g.bounds.height()) / 256, 1.f});
+  g.cols = std::ceil(g.bounds.width() / g.cellSize) + 1;
+  g.rows = std::ceil(g.bounds.height() / g.cellSize) + 1;
+
+  const auto cell = [&g] (const QPointF &p) {
+    int i = std::clamp(int((p.x() - g.bounds.left()) / g.cellSize), 0, g.cols-1),
+        j = std::clamp(int((p.y() - g.bounds.top()) / g.cellSize), 0, g.rows-1);
+    return j * g.cols + i;
+  };
+
+  g.offsets.fill(0, g.cols * g.rows + 1);
+  for (const Node *n: visible)  g.offsets[cell(n->scenePos())+1]++;
+  for (int i=1; i<g.offsets.size(); i++)  g.offsets[i] += g.offsets[i-1];
+
+  g.nodes.resize(visible.size());
+  QVector<uint> next = g.offsets;
+  for (Node *n: visible)  g.nodes[next[cell(n->scenePos())]++] = n;
+
+  dirty = false;
+}
+
+Node* BatchedNodes::nodeAt (const QPointF &p) {
+  if (dirty)  rebuild();
+
+  const Grid &g = grid;
+  int ci = (p.x() - g.bounds.left()) / g.cellSize,
+      cj = (p.y() - g.bounds.top()) / g.cellSize;
+
+  Node *closest = nullptr;
+  double dmin = std::numeric_limits<double>::max();
+  for (int j = std::max(0, cj-1); j <= std::min(g.rows-1, cj+1); j++) {
+    for (int i = std::max(0, ci-1); i <= std::min(g.cols-1, ci+1); i++) {
+      int c = j * g.cols + i;
+      for (uint k = g.offsets[c]; k < g.offsets[c+1]; k++) {
+        Node *n = g.nodes[k];
+        double d = radius(n->scenePos() - p);
+        if (d <= .5 * NODE_SIZE * n->scale() && d < dmin) {
+          closest = n;
+          dmin = d;
+        }
+      }
+    }
+  }
+  return closest;
+}
+
+QRectF BatchedNodes::boundingRect(void) const {
+  return tree->boundingRect();
+}
+
+void BatchedNodes::paint (QPainter *painter,
+                          const QStyleOptionGraphicsItem *options,
+                          QWidget *widget) {
+  if (dirty)  rebuild();
+
+  for (const auto &v: named) {
+    for (Node *n: v) {
+      if (!options->exposedRect.intersects(n->sceneBoundingRect()))  continue;
+      painter->save();
+        painter->setTransform(n->sceneTransform(), true);
+        n->paint(painter, options, widget);
+      painter->restore();
+    }
+  }
+}
+
+void BatchedNodes::setHovered (Node *n) {
+  if (n == hovered) return;
+  if (hovered)  hovered->hoverLeaveEvent(nullptr);
+  hovered = n;
+  if (hovered)  hovered->hoverEnterEvent(nullptr);
+  setToolTip(hovered ? hovered->toolTip() : QString()); // Built by the node
+}
+
+void BatchedNodes::hoverMoveEvent (QGraphicsSceneHoverEvent *e) {
+  setHovered(nodeAt(e->scenePos()));
+}
+
+void BatchedNodes::hoverLeaveEvent (QGraphicsSceneHoverEvent*) {
+  setHovered(nullptr);
+}
+
+void BatchedNodes::mouseDoubleClickEvent (QGraphicsSceneMouseEvent *e) {
+  if (Node *n = nodeAt(e->scenePos()))
+    n->mouseDoubleClickEvent(e);
+  else
+    e->ignore();
+}
+
+void BatchedNodes::contextMenuEvent (QGraphicsSceneContextMenuEvent *e) {
+  if (Node *n = nodeAt(e->scenePos()))
+    n->contextMenuEvent(e);
+  else
+    e->ignore();
+}
+
+
+// ============================================================================
+// == Static (extinct) regions
+// ============================================================================
+
+/// Memory used by a tile (in KB, the unit of the cache's cost)
+static constexpr int TILE_COST = StaticTiles::TILE_SIZE * StaticTiles::TILE_SIZE
+                               * 4 / 1024;
+
+StaticTiles::StaticTiles (VTree tree, uint budget) : tree(tree), level(0) {
+  setZValue(STATIC_TILES_LEVEL);
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+  tiles.setMaxCost(std::max(int(budget) * 1024, TILE_COST));
+}
+
+quint64 StaticTiles::key (int l, int x, int y) {
+  return (quint64(quint8(l)) << 48)
+       | (quint64(quint32(x) & 0xFFFFFF) << 24)
+       | quint64(quint32(y) & 0xFFFFFF);
+}
+
+double StaticTiles::tileSide (int l) {
+  return TILE_SIZE / std::ldexp(1., l);
+}
+
+QRect StaticTiles::tileRange (int l, const QRectF &r) {
+  double s = tileSide(l);
+  return QRect(QPoint(std::floor(r.left() / s), std::floor(r.top() / s)),
+               QPoint(std::floor(r.right() / s), std::floor(r.bottom() / s)));
+}
+
+double StaticTiles::margin (void) const {
+  return tree->pathPen(details::PATH_BASE).widthF()
+       + PTGraphBuilder::plopRadius(PATH_WIDTH, tree->pensRadius());
+}
+
+void StaticTiles::invalidate (QRectF r) {
+  if (tiles.isEmpty())  return;
+  if (dirty.size() >= MAX_DIRTY)  return clear();
+  dirty.append(r);
+}
+
+void StaticTiles::clear (void) {
+  prepareGeometryChange();  // Follows the tree's bounds
+  tiles.clear();
+  levels.clear();
+  dirty.clear();
+  drawn.clear();
+  update();
+}
+
+void StaticTiles::flush (void) {
+  // Sign-extends a 24 bits tile coordinate
+  const auto coord = [] (quint64 k) {
+    return int(quint32(k & 0xFFFFFF) << 8) >> 8;
+  };
+
+  const double m = margin();
+  for (const QRectF &r: dirty) {
+    for (int l: levels) {
+      QRect range = tileRange(l, r.adjusted(-m, -m, m, m));
+      if (qint64(range.width()) * range.height() <= tiles.size()) {
+        for (int y = range.top(); y <= range.bottom(); y++)
+          for (int x = range.left(); x <= range.right(); x++)
+            tiles.remove(key(l, x, y));
+
+      } else {  // Cheaper to look at the cached tiles
+        for (quint64 k: tiles.keys())
+          if (qint8(k >> 48) == l
+              && range.contains(coord(k >> 24), coord(k)))
+            tiles.remove(k);
+      }
+    }
+  }
+  dirty.clear();
+}
+
+bool StaticTiles::covers (const Node *n, const QGraphicsItem *item,
+                          QPainter *painter, const QWidget *widget) const {
+  if (!widget || drawn.isEmpty() || !n->isStatic())  return false;
+
+  const double s = tileSide(level), m = margin();
+  QRectF bounds = item->sceneBoundingRect().adjusted(-m, -m, m, m);
+  QRect range = tileRange(level, bounds);
+
+  bool all = true;
+  QPainterPath covered;
+  for (int y = range.top(); y <= range.bottom(); y++) {
+    for (int x = range.left(); x <= range.right(); x++) {
+      if (drawn.contains(key(level, x, y)))
+        covered.addRect(x * s, y * s, s, s);
+      else
+        all = false;
+    }
+  }
+  if (all)  return true;
+
+  // Partially drawn: only paint what is outside the tiles
+  if (!covered.isEmpty()) {
+    QPainterPath rest;
+    rest.addRect(bounds);
+    rest = item->sceneTransform().inverted().map(rest.subtracted(covered));
+    painter->setClipPath(rest, Qt::IntersectClip);
+  }
+  return false;
+}
+
+QRectF StaticTiles::boundingRect(void) const {
+  return tree->boundingRect();
+}
+
+QImage* StaticTiles::rasterize (int l, int x, int y) const {
+  const double s = tileSide(l), m = margin();
+  QRectF rect (x * s, y * s, s, s);
+
+  QList<QGraphicsItem*> items;
+  for (QGraphicsItem *i: scene()->items(rect.adjusted(-m, -m, m, m),
+                                        Qt::IntersectsItemBoundingRect,
+                                        Qt::AscendingOrder)) {
+    const Node *n = nullptr;
+    if (const Path *p = dynamic_cast<const Path*>(i))
+      n = p->end;
+    else if (const Timeline *t = dynamic_cast<const Timeline*>(i))
+      n = t->node;
+    if (n && n->isStatic()) items.append(i);
+  }
+
+  // Nothing to draw: a null image costs next to nothing
+  if (items.isEmpty())  return new QImage;
+
+  QImage *image = new QImage(TILE_SIZE, TILE_SIZE,
+                             QImage::Format_ARGB32_Premultiplied);
+  image->fill(Qt::transparent);
+
+  QPainter painter (image);
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.scale(TILE_SIZE / s, TILE_SIZE / s);
+  painter.translate(-rect.topLeft());
+
+  QStyleOptionGraphicsItem option;
+  for (QGraphicsItem *i: items) {
+    option.exposedRect = i->boundingRect();
+    painter.save();
+      painter.setTransform(i->sceneTransform(), true);
+      i->paint(&painter, &option, nullptr);
+    painter.restore();
+
+    // Kept in the tile from now on
+    if (const Path *p = dynamic_cast<const Path*>(i))  p->dropShape();
+  }
+
+  return image;
+}
+
+void StaticTiles::paint (QPainter *painter,
+                         const QStyleOptionGraphicsItem *options,
+                         QWidget *widget) {
+  drawn.clear();
+  if (!widget)  return; // Exports are drawn by the items themselves
+
+  flush();
+
+  // Use the first level at least as detailed as the screen
+  double lod = widget->devicePixelRatioF()
+             * QStyleOptionGraphicsItem::levelOfDetailFromTransform(
+                 painter->worldTransform());
+  level = qBound(-16, int(std::ceil(std::log2(lod))), 16);
+  const double s = tileSide(level);
+
+  QRectF exposed = options->exposedRect & boundingRect();
+  if (exposed.isEmpty())  return;
+
+  QRect range = tileRange(level, exposed);
+  painter->save();
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    for (int y = range.top(); y <= range.bottom(); y++) {
+      for (int x = range.left(); x <= range.right(); x++) {
+        quint64 k = key(level, x, y);
+        QImage *image = tiles.object(k);
+        if (!image) {
+          image = rasterize(level, x, y);
+          if (!tiles.insert(k, image, image->isNull() ? 1 : TILE_COST))
+            continue;
+          levels.insert(level);
+        }
+
+        if (!image->isNull())
+          painter->drawImage(QRectF(x * s, y * s, s, s), *image);
+        drawn.insert(k);
+      }
+    }
+  painter->restore();
+}
+
+
 // ============================================================================
 // == Graph borders and legends
 // ============================================================================
@@ -1021,25 +1668,8 @@ void Border::updateShape(void) {
   }
 }
 
-void format (float &n, float &d, float e) {
-  float n_ = std::floor(n / e);
-  d = 10 * (n - e * n_) / e;
-  n = n_;
-}
-
 QString prettyNumber (float n) {
-  if (n < 1e3)        return QString::number(n);
-  else if (n > 1e12)  return QString::number(n, 'e', 3);
-
-  float d = 0;
-  QString u = "";
-  if (n < 1e6)        format(n, d, 1e3), u = "K";
-  else if (n < 1e9)   format(n, d, 1e6), u = "M";
-  else if (n < 1e12)  format(n, d, 1e9), u = "G";
-
-  QString res = QString::number(n) + u;
-  if (d > 0)  res += " " + QString::number(d);
-  return res;
+  return QString::fromStdString(render::prettyNumber(n));
 }
 
 /// \todo Stops working above 2'000'000
@@ -1134,38 +1764,402 @@ void PTGraphBuilder::updatePenSet(float radius, PenSet &pens) {
 }
 
 float PTGraphBuilder::nodeWidth(float radius) {
-  return radius / (NODE_SIZE * 20);
+  return render::nodeWidth(radius);
 }
 
 float PTGraphBuilder::pathWidth(float baseWidth, float radius) {
-  return baseWidth * radius / 400.;
+  return render::pathWidth(baseWidth, radius);
 }
 
 float PTGraphBuilder::plopRadius(float baseWidth, float radius) {
-  return .5 * CONN_WIDTH * pathWidth(baseWidth, radius);
+  return render::plopRadius(baseWidth, radius);
 }
 
 float PTGraphBuilder::fontSize(float radius) {
-  return std::max(1.f, radius / 50);
+  return render::fontSize(radius);
 }
 
-void PTGraphBuilder::updateLayout (Node *localRoot, PolarCoordinates &pc) {
-  if (localRoot->subtreeVisible()) {
-    localRoot->invalidate(pc(localRoot->data.firstAppearance));
+void PTGraphBuilder::addItem (QGraphicsItem *i, Cache &cache) {
+  if (BatchedNodes *b = cache.items.batchedNodes) {
+    b->owned.append(i);
+    cache.tree->invalidateBatches();
+  } else
+    cache.items.scene->addItem(i);
+}
+
+void PTGraphBuilder::setupScene (Cache &cache) {
+  cache.items.border = new Border(cache.tree, cache.time);
+  cache.items.scene->addItem(cache.items.border);
+
+  if (cache.config.batchedRendering) {
+    cache.items.batchedLines = new BatchedLines(cache.tree);
+    cache.items.scene->addItem(cache.items.batchedLines);
 
-    for (gui::Node *n: localRoot->subnodes)
-      updateLayout(n, pc);
+    cache.items.batchedNodes = new BatchedNodes(cache.tree);
+    cache.items.scene->addItem(cache.items.batchedNodes);
   }
+
+  cache.items.tracker = new Tracker (cache.tree);
+  cache.items.scene->addItem(cache.items.tracker);
+
+  cache.items.contributors = new Contributors(cache.tree);
+  cache.items.scene->addItem(cache.items.contributors);
+
+  cache.items.dimmer = new Dimmer(cache.tree);
+  cache.items.scene->addItem(cache.items.dimmer);
+
+  cache.items.aggregates = new Aggregates(cache.tree);
+  cache.items.scene->addItem(cache.items.aggregates);
+
+  if (!cache.config.batchedRendering && cache.config.staticTilesBudget > 0) {
+    cache.items.staticTiles =
+        new StaticTiles(cache.tree, cache.config.staticTilesBudget);
+    cache.items.scene->addItem(cache.items.staticTiles);
+  }
+
+  cache.items.scene->setSceneRect(cache.items.border->boundingRect());
+
+  cache.items.initialized = true;
+}
+
+std::vector<PTGraphBuilder::PendingSpecies>
+PTGraphBuilder::insertionOrder (std::vector<SpeciesSnapshot> species,
+                                uint time) {
+  std::vector<PendingSpecies> order;
+  order.reserve(species.size());
+
+  // Snapshots list parents before their subspecies
+  std::vector<uint> depths, parents;
+  depths.reserve(species.size());
+  parents.reserve(species.size());
+  std::unordered_map<SID, uint> indices;
+  for (SpeciesSnapshot &s: species) {
+    uint i = order.size(), p = 0;
+    auto it = indices.find(s.parent);
+    if (it != indices.end())  p = it->second;
+    indices[s.id] = i;
+    depths.push_back(i > 0 ? depths[p] + 1 : 0);
+    parents.push_back(p);
+    bool alive = s.data.lastAppearance >= time;
+    order.push_back({ std::move(s), alive });
+  }
+
+  // Propagate survival upwards
+  for (uint i = order.size(); i > 1; i--)
+    order[parents[i-1]].survivor |= order[i-1].survivor;
+
+  const auto rank = [&order, &depths] (uint i) {
+    return std::make_pair(
+      depths[i] <= PROGRESSIVE_TOP_LEVELS ? 0 : order[i].survivor ? 1 : 2,
+      depths[i]);
+  };
+  std::vector<uint> sorted (order.size());
+  std::iota(sorted.begin(), sorted.end(), 0);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [&rank] (uint lhs, uint rhs) {
+    return rank(lhs) < rank(rhs);
+  });
+
+  std::vector<PendingSpecies> result;
+  result.reserve(order.size());
+  for (uint i: sorted)  result.push_back(std::move(order[i]));
+  return result;
+}
+
+void PTGraphBuilder::insertSpecies (const PendingSpecies &p, Cache &cache) {
+  const SpeciesSnapshot &s = p.species;
+  Node *parent = (s.parent != SID::INVALID) ? cache.items.nodes.value(s.parent)
+                                            : nullptr;
+  Node *gn = createSpecies(parent, s, cache);
+
+  // Keep the same order as reparenting (by decreasing identificator)
+  if (parent) {
+    auto &n = parent->subnodes;
+    n.insert(std::lower_bound(n.begin(), n.end(), gn,
+                              [] (const Node *lhs, const Node *rhs) {
+      return lhs->id > rhs->id;
+    }), gn);
+  } else
+    cache.items.root = gn;
+
+  initSpecies(gn, p.survivor, cache);
+}
+
+Node* PTGraphBuilder::createSpecies (Node *parent, const SpeciesSnapshot &s,
+                                     Cache &cache) {
+  Node *gn = new Node (cache.tree, parent, s);
+  cache.items.nodes[gn->id] = gn;
+  addItem(gn, cache);
+
+  // Generate path to parent if needed
+  if (parent) {
+    auto gp = new gui::Path(parent, gn);
+    gn->path = gp;
+    addItem(gp, cache);
+    gp->setVisible(gn->subtreeVisible());
+  }
+
+  // Create timeline object
+  auto gt = new gui::Timeline(gn);
+  gn->timeline = gt;
+  addItem(gt, cache);
+  gt->setVisible(gn->subtreeVisible());
+
+  return gn;
+}
+
+void PTGraphBuilder::initSpecies (Node *gn, bool survivor, Cache &cache) {
+  const Config &config = cache.config;
+  Node *parent = gn->parent;
+
+  // Manage visibility
+  gn->updateNode(gn->isStillAlive(cache.time));
+  survivor |= gn->onSurvivorPath();
+  gn->setVisible(Node::SHOW_NAME, config.showNames);
+  gn->setVisible(Node::SURVIVORS, !config.survivorsOnly || survivor);
+  gn->setVisible(Node::MIN_SURVIVAL, gn->survival() >= config.minSurvival);
+  gn->setVisible(Node::MIN_FULLNESS, gn->fullness() >= config.minEnveloppe);
+  gn->setVisible(Node::CLIP_RANGE, gn->appearance() <= config.clippingRange);
+  gn->setVisible(Node::PARENT, parent ? parent->subtreeVisible() : true);
+
+  // Update rendering
+  gn->updateColor();
+}
+
+uint PTGraphBuilder::capacity (const Node *n, float slack) {
+  uint c = 1, k = 0;
+  for (const Node *s: n->subnodes) {
+    if (!s->subtreeVisible()) continue;
+    c += s->layoutCapacity;
+    k++;
+  }
+
+  // Spare room grows with the number of subspecies and, sublinearly, with the
+  // subtree size so that it does not compound too much with depth
+  return c + std::floor(slack * (k + std::sqrt(c)));
+}
+
+void PTGraphBuilder::updateCapacities (Node *n, float slack) {
+  for (Node *s: n->subnodes)
+    if (s->subtreeVisible())
+      updateCapacities(s, slack);
+  n->layoutCapacity = capacity(n, slack);
+}
+
+void PTGraphBuilder::updateLayout (Node *n, uint start, bool parentMoved,
+                                   bool force, const PolarCoordinates &pc) {
+  if (!n->subtreeVisible()) return;
+
+  // Subnodes are packed at the end of the range, right after this node, so
+  // that inserting one (always in front) only moves the node itself
+  uint used = 0;
+  for (const Node *s: n->subnodes)
+    if (s->subtreeVisible())
+      used += s->layoutCapacity;
+  assert(1 + used <= n->layoutCapacity);
+
+  uint slot = start + n->layoutCapacity - used - 1;
+  QPointF p = pc(slot, n->data.firstAppearance);
+  bool moved = force || p != n->pos();
+  if (moved)
+    n->invalidate(p);
+  else if (parentMoved && n->path)
+    n->path->invalidatePath();
+
+  n->layoutStart = start;
+  n->layoutDirty = false;
+
+  for (Node *s: n->subnodes) {
+    if (!s->subtreeVisible()) continue;
+    if (force || moved || s->layoutDirty || s->layoutStart != slot+1)
+      updateLayout(s, slot+1, moved, force, pc);
+    slot += s->layoutCapacity;
+  }
+
+  n->updateSubtreeSummary();
+}
+
+/// Below this number of species, full layouts are computed serially
+static constexpr int PARALLEL_LAYOUT_THRESHOLD = 4096;
+
+/// Runs a range of a parallelFor() loop
+class ParallelJob : public QRunnable {
+public:
+  /// Helper alias to the function processing a range of indices
+  using Range = std::function<void(int, int)>;
+
+  /// Creates a job applying \p f to [\p begin,\p end[ and then releasing
+  /// \p done
+  ParallelJob (const Range &f, int begin, int end, QSemaphore &done)
+    : _f(f), _begin(begin), _end(end), _done(done) {}
+
+  /// Processes the range and signals completion
+  void run (void) override {
+    _f(_begin, _end);
+    _done.release();
+  }
+
+private:
+  const Range &_f;    ///< The processing function
+  const int _begin;   ///< First index
+  const int _end;     ///< Past-the-end index
+  QSemaphore &_done;  ///< Completion counter
+};
+
+/// Splits [0,\p n[ into ranges processed by \p f on the global thread pool
+/// (and the calling thread) and waits for all of them to complete
+static void parallelFor (int n, const ParallelJob::Range &f) {
+  if (n <= 0) return;
+
+  QThreadPool *pool = QThreadPool::globalInstance();
+  const int chunks = std::min(n, 4 * std::max(1, pool->maxThreadCount()));
+  const auto bound = [n, chunks] (int c) {
+    return int(qint64(n) * c / chunks);
+  };
+
+  QSemaphore done;
+  for (int c=1; c<chunks; c++)
+    pool->start(new ParallelJob(f, bound(c), bound(c+1), done));
+  f(0, bound(1));
+  done.acquire(chunks-1);
+}
+
+void PTGraphBuilder::updateLayoutParallel (Node *root,
+                                           const PolarCoordinates &pc) {
+  // Phase 0: flatten the visible graph in depth-first order. A subtree's
+  // range starts right after the slots of its preceding siblings (prefix sum
+  // of their capacities)
+  struct Pending {
+    Node *node;   ///< The species to place
+    int parent;   ///< Index of its parent (or -1 for the root)
+    uint start;   ///< First slot of its range
+  };
+  QVector<Node*> nodes;
+  QVector<int> parents;
+  QVector<uint> starts, slots;
+  QVector<Pending> stack { { root, -1, 0 } };
+  while (!stack.isEmpty()) {
+    Pending p = stack.takeLast();
+    Node *n = p.node;
+
+    uint used = 0;
+    for (const Node *s: n->subnodes)
+      if (s->subtreeVisible())
+        used += s->layoutCapacity;
+    assert(1 + used <= n->layoutCapacity);
+
+    uint slot = p.start + n->layoutCapacity - used - 1;
+    int i = nodes.size();
+    nodes.append(n);
+    parents.append(p.parent);
+    starts.append(p.start);
+    slots.append(slot);
+
+    // Pushed in reverse so that they are processed in order
+    uint end = slot + 1 + used;
+    for (auto it = n->subnodes.rbegin(); it != n->subnodes.rend(); ++it) {
+      if (!(*it)->subtreeVisible()) continue;
+      end -= (*it)->layoutCapacity;
+      stack.append({ *it, i, end });
+    }
+  }
+
+  const int N = nodes.size();
+
+  // Phase 1: angles and radii
+  QVector<QPointF> positions (N);
+  parallelFor(N, [&] (int begin, int end) {
+    for (int i=begin; i<end; i++)
+      positions[i] = pc(slots[i], nodes[i]->data.firstAppearance);
+  });
+
+  // Phase 2: bounds of the paths and shapes of the timelines
+  QVector<QRectF> bounds (N);
+  std::vector<QPointF> timelines (3*N);
+  parallelFor(N, [&] (int begin, int end) {
+    for (int i=begin; i<end; i++) {
+      if (parents[i] >= 0)
+        bounds[i] = Path::computeShape(positions[parents[i]], positions[i])
+                      .boundingRect().normalized();
+      Timeline::computePoints(nodes[i], positions[i], &timelines[3*i]);
+    }
+  });
+
+  // Final phase, on this thread: apply to the graphics items. Going backwards
+  // visits descendants before their ancestor (for the subtrees summaries)
+  for (int i=N-1; i>=0; i--) {
+    Node *n = nodes[i];
+    n->setPos(positions[i]);
+    if (n->path)  n->path->setBounds(bounds[i]);
+    n->timeline->setPoints(&timelines[3*i]);
+    n->update();
+
+    n->layoutStart = starts[i];
+    n->layoutDirty = false;
+    n->updateSubtreeSummary();
+  }
+
+  root->treeBase->invalidateBatches();
+  if (Contributors *c = root->treeBase->items().contributors)  c->invalidate();
 }
 
 void PTGraphBuilder::updateLayout (GUIItems &items) {
-  uint visible = 0;
-  for (const gui::Node *n: items.nodes)  visible += n->subtreeVisible();
+  Node *root = items.root;
+  if (!root || !root->subtreeVisible()) return;
+
+  float slack = root->treeBase->config().layoutSlack;
+  updateCapacities(root, slack);
+
+  // The root gets spare room proportional to the whole graph
+  uint needed = capacity(root, 0);
+  items.layoutSlots = root->layoutCapacity = std::ceil(needed * (1 + slack));
+
+  PolarCoordinates pc (items.layoutSlots);
+  if (items.nodes.size() < PARALLEL_LAYOUT_THRESHOLD)
+        updateLayout(root, 0, false, true, pc);
+  else  updateLayoutParallel(root, pc);
+}
+
+void PTGraphBuilder::updateLayout (GUIItems &items,
+                                   const QSet<Node*> &changed) {
+  Node *root = items.root;
+  if (!root || !root->subtreeVisible()) return;
+
+  float slack = root->treeBase->config().layoutSlack;
+
+  // Grow the ranges of the modified subtrees' ancestors until one has enough
+  // room for its new contents
+  QSet<Node*> dirty;
+  for (Node *n: changed) {
+    if (!n->subtreeVisible()) continue;
+    for (Node *s: n->subnodes) // New species
+      if (s->subtreeVisible() && s->layoutCapacity == 0)
+        updateCapacities(s, slack);
+
+    n->layoutDirty = true;
+    while (n != root && capacity(n, 0) > n->layoutCapacity) {
+      n->layoutCapacity = capacity(n, slack);
+      n = n->parent;
+      n->layoutDirty = true;
+    }
+
+    if (n == root && capacity(root, 0) > items.layoutSlots)
+      return updateLayout(items);
+
+    dirty.insert(n);
+  }
 
-  if (visible > 0) {
-    double width = PolarCoordinates::xCoord(visible);
-    PolarCoordinates pc (width);
-    updateLayout(items.root, pc);
+  // Place ancestors first so that the ranges of nested subtrees are known
+  QVector<Node*> sorted;
+  for (Node *n: dirty)  sorted.append(n);
+  std::sort(sorted.begin(), sorted.end(), [] (Node *lhs, Node *rhs) {
+    return lhs->depth < rhs->depth;
+  });
+
+  PolarCoordinates pc (items.layoutSlots);
+  for (Node *n: sorted) {
+    updateLayout(n, n->layoutStart, false, false, pc);
+    for (Node *a = n->parent; a; a = a->parent) a->updateSubtreeSummary();
   }
 }
 
@@ -10,6 +10,9 @@
 
 #include <QGraphicsScene>
 #include <QGraphicsItem>
+#include <QCache>
+#include <QHash>
+#include <QSet>
 
 #include "../core/tree/phylogenetictree.hpp"
 
@@ -44,9 +47,62 @@ public:
   /// Whether to keep a screenshot per step
   bool screenshots = false;
 
-  /// Tree rasterized radius when rendering to file
+  /// If not empty, screenshots are encoded into this video file (through
+  /// ffmpeg) instead of a png sequence in the snapshots folder
+  std::string captureVideo = "";
+
+  /// Frame rate of the screenshots video
+  uint captureFps = 25;
+
+  /// Maximal number of screenshots being encoded in the background. Further
+  /// screenshots are dropped until the encoders catch up
+  uint captureBacklog = 8;
+
+  /// Tree rasterized radius when rendering to file: exports and per-step
+  /// screenshots are scaled (up or down) to this width. Negative values keep
+  /// the scene's size
   float rasterRadius = -1;
 
+  /// Whether tree events are queued by the simulation thread and processed
+  /// later on by the GUI thread (see PhylogenyViewer_base::TreeEvent).
+  /// The simulation should then modify the tree under
+  /// PhylogenyViewer_base::lockTree so that it can be read between steps
+  /// \attention Only read at construction
+  bool asynchronous = false;
+
+  /// Period (in ms) at which queued tree events are processed
+  uint eventsPollingPeriod = 40;
+
+  /// Relative amount of spare angular room reserved in each subtree so that
+  /// new species can be inserted without moving the rest of the tree.
+  ///
+  /// Zero gives the most compact layout but every insertion then overflows
+  /// all the ancestors, up to the root, and the whole graph is laid out anew.
+  /// Small values leave some gaps between subtrees (and around the root) but
+  /// an insertion only moves the smallest enclosing subtree with spare room.
+  /// Only worth it for growing trees
+  float layoutSlack = .1;
+
+  /// Screen width (in pixels) under which a subtree is drawn as a single
+  /// wedge instead of species by species. Zero always draws every species
+  float lodThreshold = 3;
+
+  /// Whether species are drawn by two batched items (see BatchedLines and
+  /// BatchedNodes) instead of three graphics items each. Faster and lighter
+  /// for large trees
+  /// \attention Only read at construction
+  bool batchedRendering = false;
+
+  /// Memory (in MB) dedicated to the on-screen raster tiles of extinct
+  /// species (see StaticTiles). Zero always draws every species item
+  /// \attention Only read at construction. Unused with batched rendering
+  uint staticTilesBudget = 64;
+
+  /// Whether the graph is built in the background, by chunks, rather than
+  /// before the viewer is shown (see PhylogenyViewer::buildProgressively)
+  /// \attention Only read at construction. The tree must not change meanwhile
+  bool progressiveBuild = false;
+
   /// Values for the node/timelines color
   enum Colors {
     NONE = 0, ///< No color
@@ -120,6 +176,32 @@ struct PolarCoordinates;
 struct Path;
 struct Timeline;
 
+/// Copy of the values of a PTree node needed to create its graphics items.
+///
+/// The GUI never reads the tree's storage outside of the thread modifying it:
+/// these copies are taken there and then handed over
+struct SpeciesSnapshot {
+  SID id = SID::INVALID;      ///< The species identificator
+  SID parent = SID::INVALID;  ///< Its parent (if any)
+  phylogeny::SpeciesData data;  ///< Its data
+  uint rset = 0;          ///< Size of its R-Set
+  uint children = 0;      ///< Number of subspecies
+  uint contributors = 0;  ///< Number of species contributing to it
+
+  /// \returns the values of PTree node \p n
+  template <typename PN>
+  static SpeciesSnapshot from (const PN &n) {
+    SpeciesSnapshot s;
+    s.id = n.id();
+    if (n.parent()) s.parent = n.parent()->id();
+    s.data = n.data;
+    s.rset = n.rset.size();
+    s.children = n.children().size();
+    s.contributors = n.contributors.data().size();
+    return s;
+  }
+};
+
 /// A species node
 class Node : public QGraphicsItem {
 
@@ -130,6 +212,20 @@ class Node : public QGraphicsItem {
   /// the tree's current timestep
   bool _onSurvivorPath;
 
+  /// Whether this subtree is currently drawn as a single wedge
+  bool _aggregated;
+
+  /// Whether an ancestor is currently drawn as a single wedge
+  bool _collapsed;
+
+  /// Shows/hides this node's graphics items based on its visibility values and
+  /// aggregation state
+  void updateItemsVisibility (void);
+
+  /// Notifies the static tiles (if any) that this species' path and timeline
+  /// changed, if they are drawn through them
+  void invalidateStaticTiles (void);
+
 public:
   /// Enumeration encoding a node's visibility
   enum Visibility {
@@ -148,38 +244,65 @@ public:
   PhylogenyViewer_base *const treeBase;
 
   const SID id;  ///< The identificator of the associated species node
+  uint depth;     ///< Number of ancestors
   Node *parent;   ///< The parent node (if any)
 
-  /// Helper alias for the ptree's species data
-  using Data = phylogeny::SpeciesData;
-  const Data &data; ///< The data of the associated species
+  /// The part of the ptree's species data shown by the graph
+  struct Data {
+    uint firstAppearance; ///< \see phylogeny::SpeciesData::firstAppearance
+    uint lastAppearance;  ///< \see phylogeny::SpeciesData::lastAppearance
+    uint count;           ///< \see phylogeny::SpeciesData::count
+
+    /// Copies the relevant fields of \p d
+    Data (const phylogeny::SpeciesData &d)
+      : firstAppearance(d.firstAppearance), lastAppearance(d.lastAppearance),
+        count(d.count) {}
+  };
+
+  /// Copy of the data of the associated species. Only updated on the GUI
+  /// thread, by the tree events (see PhylogenyViewer_base::treeStepped)
+  Data data;
 
   uint rset; ///< Size of the associated species' R-Set
   uint children;  ///< Number of subspecies
 
-  const QString sid; ///< String representation of the node's identificator
   Path *path; ///< The graphic item connecting this node to its parent (if any)
   Timeline *timeline; ///< The graphic item depicting this node's lifetime
 
   /// The graphic items corresponding to the associated species 'children'
   QVector<Node*> subnodes;
 
-  /// Current border color
-  QPen coloredPen;
+  /// Current border (and path) color
+  QColor color;
 
-  /// Build a graphic node out of a potential parent and PTree data
-  template <typename PN>
-  Node (VTree tree, Node *parent, const PN &n)
-    : treeBase(tree), id(n.id()), parent(parent), data(n.data),
-      sid(QString::number(std::underlying_type<SID>::type(id))),
-      path(nullptr), timeline(nullptr) {
+  uint layoutStart;     ///< First angular slot reserved for this subtree
+  uint layoutCapacity;  ///< Number of slots reserved for this subtree (0 if unknown)
+
+  uint subtreeSize;     ///< Number of visible species in this subtree
+  uint subtreeAlive;    ///< Number of alive species in this subtree
+  uint subtreeEnd;      ///< Latest disappearance in this (visible) subtree
+  float subtreeArc [2]; ///< Angular extent of this (visible) subtree
 
-    rset = n.rset.size();
-    children = n.children().size();
+  bool layoutDirty;     ///< Whether this subtree changed since its last layout
+
+  /// Build a graphic node out of a potential parent and PTree data
+  Node (VTree tree, Node *parent, const SpeciesSnapshot &s)
+    : treeBase(tree), id(s.id), depth(parent ? parent->depth + 1 : 0),
+      parent(parent), data(s.data),
+      rset(s.rset), children(s.children), path(nullptr), timeline(nullptr),
+      layoutStart(0), layoutCapacity(0),
+      subtreeSize(1), subtreeAlive(0), subtreeEnd(s.data.lastAppearance),
+      subtreeArc{0,0}, layoutDirty(true) {
 
     _alive = false;
     setOnSurvivorPath(false);
 
+    _aggregated = false;
+    _collapsed = parent && (parent->_collapsed || parent->_aggregated);
+
+    // Shown only once its visibility values are set
+    QGraphicsItem::setVisible(false);
+
     autoscale();
     setAcceptHoverEvents(true);
   }
@@ -187,9 +310,16 @@ public:
   /// Recompute all cached data
   void invalidate (const QPointF &newPos);
 
+  /// \returns the string representation of the node's identificator
+  QString sidString (void) const {
+    return QString::number(std::underlying_type<SID>::type(id));
+  }
+
   /// Format species data for use in the tooltip
   QString computeTooltip (void) const;
 
+  /// Sets the tooltip from the current data. Only called when the node is
+  /// hovered (and cleared afterwards) so that idle nodes hold no string
   /// \see computeTooltip
   void updateTooltip(void) {
     setToolTip(computeTooltip());
@@ -214,6 +344,13 @@ public:
     return _onSurvivorPath;
   }
 
+  /// \returns Whether this species' path and timeline can no longer change
+  /// with time (i.e. no descendant is alive) and are thus drawn by the
+  /// static tiles (if any)
+  bool isStatic (void) const {
+    return !_onSurvivorPath;
+  }
+
   /// Store whether the current node is still alive and notify its hierarchy
   void updateNode (bool alive);
 
@@ -224,6 +361,28 @@ public:
   /// Update color based on the corresponding config values
   void updateColor (void);
 
+  /// Recompute the subtree size, end and angular extent from this node's
+  /// position and its subnodes' values
+  void updateSubtreeSummary (void);
+
+  /// \returns whether this subtree is currently drawn as a single wedge
+  bool aggregated (void) const {
+    return _aggregated;
+  }
+
+  /// Sets whether this subtree is drawn as a single wedge
+  void setAggregated (bool a) {
+    _aggregated = a;
+  }
+
+  /// \returns whether an ancestor is currently drawn as a single wedge
+  bool collapsed (void) const {
+    return _collapsed;
+  }
+
+  /// Sets whether an ancestor is drawn as a single wedge (hides this node)
+  void setCollapsed (bool c);
+
   /// \returns Whether this node has sufficient visiblity values
   bool subtreeVisible (void) const {
     static constexpr auto mask =
@@ -237,7 +396,8 @@ public:
     return visibilities | SHOW_NAME;
   }
 
-  /// Sets visibility value \p v to \p visible
+  /// Sets visibility value \p v to \p visible. Subnodes are only notified if
+  /// this changes whether the subtree is visible
   void setVisible (Visibility v, bool visible);
 
   /// \returns the timestep at which this species first appeared
@@ -261,10 +421,12 @@ public:
     return float(rset) / config::PTree::rsetSize();
   }
 
-  /// Triggers a callback when this species node is hovered
+  /// Builds the tooltip and triggers a callback when this species node is
+  /// hovered
   void hoverEnterEvent(QGraphicsSceneHoverEvent*) override;
 
-  /// Triggers a callback when this species node is no longer hovered
+  /// Drops the tooltip and triggers a callback when this species node is no
+  /// longer hovered
   void hoverLeaveEvent(QGraphicsSceneHoverEvent*) override;
 
   /// Requests display of the species details
@@ -289,8 +451,14 @@ struct Path : public QGraphicsItem {
   Node *start;  ///< The source Node (parent)
   Node *end;    ///< The target Node (child)
 
-  /// The shape used to paint this path
-  QPainterPath _shape;
+  /// Bounds of the shape. The shape itself is generated on demand from the
+  /// nodes positions
+  QRectF _bounds;
+
+  /// The shape, once generated (e.g. when painted). Dropped whenever the path
+  /// changes or is rasterized by the static tiles so that only those drawn
+  /// directly since hold one
+  mutable QPainterPath _shape;
 
   /// Create a path object between parent Node \p start and \p end
   Path(Node *start, Node *end);
@@ -298,12 +466,22 @@ struct Path : public QGraphicsItem {
   /// \copydoc Node::invalidate
   void invalidatePath (void);
 
+  /// \returns the shape of a path from a parent at \p start to a child at
+  /// \p end. Thread-safe
+  static QPainterPath computeShape (const QPointF &start, const QPointF &end);
+
+  /// Notifies that the shape changed and now lies within \p bounds
+  void setBounds (const QRectF &bounds);
+
   /// \copydoc Node::boundingRect
   QRectF boundingRect() const override;
 
   /// \returns this graphics item shape
-  QPainterPath shape (void) const override {
-    return _shape;
+  QPainterPath shape (void) const override;
+
+  /// Releases the cached shape (regenerated on demand)
+  void dropShape (void) const {
+    _shape = QPainterPath();
   }
 
   /// \copydoc Node::paint
@@ -320,8 +498,8 @@ struct Timeline : public QGraphicsItem {
   ///  - 2: end-of-life position
   QPointF points[3];
 
-  /// Colors for the segments points[0]-points[1] and points[1]-points[2]
-  QColor colors [2];
+  /// \returns the color of segment points[\p i]-points[\p i+1]
+  QColor color (uint i) const;
 
   /// Create a timeline associated with \p node
   Timeline(Node *node);
@@ -329,6 +507,14 @@ struct Timeline : public QGraphicsItem {
   /// \copydoc Path::invalidatePath
   void invalidatePath (void);
 
+  /// Computes the \p points of the timeline of \p node, were it at \p pos.
+  /// Thread-safe (as long as the graph does not change)
+  static void computePoints (const Node *node, const QPointF &pos,
+                             QPointF *points);
+
+  /// Replaces the current points with \p points
+  void setPoints (const QPointF *points);
+
   /// \copydoc Node::boundingRect
   QRectF boundingRect() const override {
     return shape().boundingRect();
@@ -342,42 +528,91 @@ struct Timeline : public QGraphicsItem {
 };
 
 /// Displays species tracking data
+///
+/// The tracked species and their branching ancestors form a (simplified)
+/// ancestry forest which is maintained incrementally as species are added to
+/// or removed from the tracking. Wedges are only rebuilt for the species whose
+/// subtree moved, grew or whose tracked descendants changed.
 struct Tracker : public QGraphicsItem {  
   VTree tree; ///< The tree whose species are tracked
 
   /// A single tracked (or ancestor of tracked) species
   struct TrackedSpecies {
     const Node *species;  ///< The species in question
+    TrackedSpecies *parent; ///< Its closest tracked ancestor (if any)
     QList<TrackedSpecies*> descendants; ///< Its (in)direct descendants
 
+    /// Whether it is tracked itself (rather than a common ancestor)
+    bool monitored;
+
+    /// Whether descendants were added/removed since the last geometry update
+    bool structureChanged;
+
     QPainterPath path; ///< The region of direct influence
     QPainterPath hollowedPath;  ///< The region of exclusive influence
 
-    QColor color; ///< The color of influence
+    QPointF anchor; ///< Position of the species when path was computed
+    QPointF extent; ///< Angle and radius of the subtree when path was computed
 
-    ~TrackedSpecies(void) {
-      for (auto *ts: descendants) delete ts;
-    }
+    QColor color; ///< The color of influence
   };
 
   /// The root of the tracked hierarchy tree
   TrackedSpecies *commonAncestor;
 
+  /// All elements of the tracked hierarchy (owned)
+  QHash<const Node*, TrackedSpecies*> tracked;
+
 public:
   /// Builds a species tracking drawer
   Tracker (VTree tree);
 
+  /// Deletes the tracking data
+  ~Tracker (void);
+
   /// \returns the same bounding rect as the graph's bounds
   QRectF boundingRect(void) const override;
 
-  /// Recomputes tracking data
+  /// Synchronizes tracking data with the color specifications
   void updateTracking (void);
 
+  /// Updates tracking data after the graph changed (layout, visibility, step)
+  void updateGeometry (void);
+
+  /// Stops tracking every species (e.g. before some nodes are deleted)
+  void clear (void);
+
   /// Paints the paths for the various tracked species
   void paint (QPainter *painter, const QStyleOptionGraphicsItem*,
               QWidget*) override;
 
 private:
+  /// Adds/removes tracked species to match the color specifications. Problems
+  /// are reported if \p verbose
+  void synchronize (bool verbose);
+
+  /// Starts tracking species \p n
+  void add (const Node *n);
+
+  /// Stops tracking species \p n
+  void remove (const Node *n);
+
+  /// Creates a hierarchy element for species \p n
+  TrackedSpecies* create (const Node *n, bool monitored);
+
+  /// Makes \p child a descendant of \p parent
+  static void link (TrackedSpecies *parent, TrackedSpecies *child);
+
+  /// Detaches \p child from its parent
+  static void unlink (TrackedSpecies *child);
+
+  /// Recomputes the colors of \p ts and its descendants
+  void updateColors (TrackedSpecies *ts);
+
+  /// Rebuilds the outdated wedges of \p ts and its descendants
+  /// \returns whether the wedge of \p ts changed
+  bool updateGeometry (TrackedSpecies *ts);
+
   /// Recursive painter for a given tracked species
   void paint (QPainter *painter, const TrackedSpecies *ts);
 };
@@ -410,20 +645,36 @@ struct Contributors : public QGraphicsItem {
   };
 
   QMap<PathID, Path> paths;  ///< The paths connecting to the contributors
-  QVector<QPair<QPointF, QString>> labels;  ///< The labels for each contributor
+
+  /// The labels for each contributor (anchored on its node)
+  QVector<QPair<QPointF, QString>> labels;
 
   Node *species;  ///< The species whose contributors are shown (or null)
 
+  /// The paths and labels computed for a species
+  struct Flow {
+    QMap<PathID, Path> paths; ///< \copydoc Contributors::paths
+    QVector<QPair<QPointF, QString>> labels;  ///< \copydoc Contributors::labels
+    uint signature; ///< Fingerprint of the contributions they were built from
+  };
+
+  /// Flows of previously shown species (see invalidate)
+  QHash<const Node*, Flow> flows;
+
   /// Builds a contributors drawer
   Contributors (VTree tree);
 
-  /// Show the drawer for the provided node
+  /// Show the drawer for the provided node. Reuses the previous flow for
+  /// this species if its contributions did not change
   void show (SID sid, const GUIItems &items,
              const phylogeny::Contributors &contribs);
 
   /// Hide the drawer
   void hide (void);
 
+  /// Drops all cached flows (e.g. after nodes moved or changed visibility)
+  void invalidate (void);
+
   /// \returns the same bounding rect as the graph's bounds
   QRectF boundingRect(void) const override;
 
@@ -438,6 +689,10 @@ private:
   /// Creates a new entry for p's id or update existing weight
   void addOrUpdate (const QPainterPath &p, float w);
 
+  /// Computes the paths and labels for the contributions to \p n
+  void computeFlow (Node *n, const GUIItems &items,
+                    const phylogeny::Contributors &contribs);
+
   /// Register a, potentially subdivided, vertical path between the two nodes
   void verticalPath (Node *n0, Node *n1, float w);
 
@@ -470,6 +725,240 @@ struct Dimmer : public QGraphicsItem {
   void paint (QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*) override;
 };
 
+/// Graphics item drawing aggregated subtrees (level of detail)
+///
+/// Subtrees too small to be distinguished on screen are drawn as a single
+/// annular wedge spanning their angular extent and lifetime. Its opacity grows
+/// with the number of species while its color and outer radius follow
+/// survival (subtrees with living species reach the present)
+struct Aggregates : public QGraphicsItem {
+  VTree tree; ///< The tree whose subtrees this draws
+
+  /// A single aggregated subtree
+  struct Wedge {
+    QPainterPath path;  ///< The annular sector
+    QRectF bounds;      ///< Its bounding box
+    QColor color;       ///< Its fill color
+  };
+
+  /// The nodes whose subtree is aggregated
+  QVector<const Node*> nodes;
+
+  /// The shapes for the aggregated nodes
+  QVector<Wedge> wedges;
+
+  /// Builds an aggregates drawer
+  Aggregates (VTree tree);
+
+  /// Sets the aggregated nodes
+  void setNodes (const QVector<const Node*> &nodes) {
+    this->nodes = nodes;
+    invalidate();
+  }
+
+  /// Recomputes the wedges (e.g. after a step or a color change)
+  void invalidate (void);
+
+  /// \returns the same bounding rect as the graph's bounds
+  QRectF boundingRect(void) const override;
+
+  /// Paints the exposed wedges
+  void paint (QPainter *painter, const QStyleOptionGraphicsItem *options,
+              QWidget*) override;
+};
+
+/// Graphics item drawing every path and timeline in batches (see
+/// ViewerConfig::batchedRendering)
+///
+/// Geometry is gathered, when needed, from the (scene-less) Path and Timeline
+/// objects into flat arrays of segments and end-of-path decorations grouped by
+/// color and depth. Arcs are tessellated.
+struct BatchedLines : public QGraphicsItem {
+  VTree tree; ///< The tree whose species this draws
+
+  /// Segments and decorations sharing a color
+  struct Batch {
+    QColor color;             ///< The pen color
+    QVector<QLineF> lines;    ///< The segments
+    QVector<QPointF> plops;   ///< The end-of-path decorations
+  };
+
+  /// Batches for extinct (0) and survivor (1) paths (drawn on top)
+  QVector<Batch> batches [2];
+
+  /// Whether the batches need to be rebuilt before the next paint
+  bool dirty;
+
+  /// Builds a batched paths/timelines drawer
+  BatchedLines (VTree tree);
+
+  /// Requests a rebuild of the batches before the next paint
+  void invalidate (void) {
+    if (dirty)  return;
+    dirty = true;
+    update();
+  }
+
+  /// Gathers the geometry of all visible paths and timelines
+  void rebuild (void);
+
+  /// \returns the same bounding rect as the graph's bounds
+  QRectF boundingRect(void) const override;
+
+  /// Paints every batch with a single call for each primitive type
+  void paint (QPainter *painter, const QStyleOptionGraphicsItem*,
+              QWidget*) override;
+};
+
+/// Graphics item drawing every (named) species node and handling all node
+/// interactions through a uniform grid (see ViewerConfig::batchedRendering)
+struct BatchedNodes : public QGraphicsItem {
+  VTree tree; ///< The tree whose species this draws
+
+  /// Visible nodes with a name tag, extinct (0) and survivors (1)
+  QVector<Node*> named [2];
+
+  /// Uniform grid over the graph's bounds used for picking
+  struct Grid {
+    QRectF bounds;  ///< The covered area
+    float cellSize; ///< Width of a (square) cell
+    int cols;       ///< Number of columns
+    int rows;       ///< Number of rows
+    QVector<uint> offsets;  ///< Index of each cell's first node in #nodes
+    QVector<Node*> nodes;   ///< Nodes sorted by cell
+  } grid;
+
+  /// The node currently under the cursor (if any)
+  Node *hovered;
+
+  /// Whether the arrays need to be rebuilt before the next paint/query
+  bool dirty;
+
+  /// Species items (nodes, paths, timelines) drawn by the batch drawers and
+  /// thus not owned by the scene
+  QVector<QGraphicsItem*> owned;
+
+  /// Builds a batched nodes drawer
+  BatchedNodes (VTree tree);
+
+  /// Deletes the species items
+  ~BatchedNodes (void);
+
+  /// \copydoc BatchedLines::invalidate
+  void invalidate (void) {
+    if (dirty)  return;
+    dirty = true;
+    update();
+  }
+
+  /// Gathers all visible nodes and fills the picking grid
+  void rebuild (void);
+
+  /// \returns the visible node under scene position \p p (if any)
+  Node* nodeAt (const QPointF &p);
+
+  /// \returns the same bounding rect as the graph's bounds
+  QRectF boundingRect(void) const override;
+
+  /// Paints the exposed named nodes
+  void paint (QPainter *painter, const QStyleOptionGraphicsItem *options,
+              QWidget *widget) override;
+
+  /// Forwards hover events to the node under the cursor
+  void hoverMoveEvent(QGraphicsSceneHoverEvent *e) override;
+
+  /// Notifies the last hovered node
+  void hoverLeaveEvent(QGraphicsSceneHoverEvent*) override;
+
+  /// Forwards the event to the node under the cursor
+  void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *e) override;
+
+  /// Forwards the event to the node under the cursor
+  void contextMenuEvent(QGraphicsSceneContextMenuEvent *e) override;
+
+private:
+  /// Notifies both the previously and newly hovered nodes
+  void setHovered (Node *n);
+};
+
+/// Graphics item drawing the paths and timelines of extinct lineages (see
+/// Node::isStatic) from cached raster tiles (see ViewerConfig::staticTilesBudget)
+///
+/// Tiles are aligned on a grid whose resolution doubles at each zoom level and
+/// only ever hold static items, so that living subtrees and overlays are still
+/// drawn as vectors on top of them. A tile is dropped whenever a static item
+/// it intersects moves, changes color or visibility, and they all are when the
+/// pens change (i.e. when the tree grows).
+///
+/// \note Only on-screen painting uses the tiles: exports are pure vectors
+struct StaticTiles : public QGraphicsItem {
+  VTree tree; ///< The tree whose extinct species this draws
+
+  /// Side (in pixels) of a tile
+  static constexpr int TILE_SIZE = 256;
+
+  /// Number of pending invalidations after which the whole cache is dropped
+  static constexpr int MAX_DIRTY = 256;
+
+  /// The rasterized tiles, indexed by zoom level and position (see key)
+  QCache<quint64, QImage> tiles;
+
+  /// Zoom levels with at least one tile
+  QSet<int> levels;
+
+  /// Scene areas whose tiles are out of date
+  QVector<QRectF> dirty;
+
+  /// Zoom level of the last on-screen paint
+  int level;
+
+  /// Tiles drawn by the last on-screen paint
+  QSet<quint64> drawn;
+
+  /// Builds a static tiles drawer holding at most \p budget MB of images
+  StaticTiles (VTree tree, uint budget);
+
+  /// Drops every tile intersecting \p r (deferred to the next paint)
+  void invalidate (QRectF r);
+
+  /// Drops every tile
+  void clear (void);
+
+  /// \returns whether \p item (of species \p n) was completely drawn by the
+  /// current on-screen paint. Otherwise clips \p painter out of the drawn
+  /// tiles, if needed. Always false when not painting on-screen (\p widget is
+  /// null)
+  bool covers (const Node *n, const QGraphicsItem *item, QPainter *painter,
+               const QWidget *widget) const;
+
+  /// \returns the same bounding rect as the graph's bounds
+  QRectF boundingRect(void) const override;
+
+  /// Paints the exposed tiles, rasterizing those that are missing
+  void paint (QPainter *painter, const QStyleOptionGraphicsItem *options,
+              QWidget *widget) override;
+
+private:
+  /// \returns the key of tile (\p x, \p y) at zoom level \p l
+  static quint64 key (int l, int x, int y);
+
+  /// \returns the scene area covered by a tile at zoom level \p l
+  static double tileSide (int l);
+
+  /// \returns the range of tiles at zoom level \p l intersecting \p r
+  static QRect tileRange (int l, const QRectF &r);
+
+  /// \returns how far static items may be drawn outside their bounding rect
+  double margin (void) const;
+
+  /// Applies pending invalidations
+  void flush (void);
+
+  /// Rasterizes the static items intersecting tile (\p x, \p y) at zoom
+  /// level \p l
+  QImage* rasterize (int l, int x, int y) const;
+};
+
 /// Graphics item managing the graph's boundaries and legend
 struct Border : public QGraphicsItem {
   VTree tree; ///< The tree whose border it is drawing
@@ -541,9 +1030,23 @@ struct GUIItems {
   /// Clipping dimmer
   Dimmer *dimmer;
 
+  /// Aggregated subtrees drawer
+  Aggregates *aggregates;
+
+  /// Batched paths/timelines drawer (if ViewerConfig::batchedRendering)
+  BatchedLines *batchedLines;
+
+  /// Batched nodes drawer (if ViewerConfig::batchedRendering)
+  BatchedNodes *batchedNodes;
+
+  /// Cached raster tiles of extinct species (if ViewerConfig::staticTilesBudget)
+  StaticTiles *staticTiles;
+
   QMap<SID, Node*> nodes;  ///< Lookup table for the graphics nodes
 
   QMap<details::PenType, QPen> pens;  ///< Collection of pens
+
+  uint layoutSlots; ///< Number of angular slots around the graph
 };
 
 /// Helper structure managing the construction of a PTree's associated graph
@@ -579,84 +1082,125 @@ struct PTGraphBuilder {
   /// \returns the appropriate font size for a tree of radius
   static float fontSize (float radius);
 
+  /// A species waiting to be inserted by a progressive build
+  struct PendingSpecies {
+    SpeciesSnapshot species;  ///< The species data
+    bool survivor;  ///< Whether it leads to a species still alive
+  };
+
+  /// Number of levels (below the root) inserted first by progressive builds
+  static constexpr uint PROGRESSIVE_TOP_LEVELS = 4;
+
+  /// Creates the items not bound to a specific species (border, overlays...)
+  static void setupScene (Cache &cache);
+
   /// Parse the \p pt PTree and build the associated graph complete with nodes,
   /// paths and legend
   template <typename GENOME, typename UDATA>
   static void fillScene (const phylogeny::PhylogeneticTree<GENOME, UDATA> &pt,
                          Cache &cache) {
-
-    cache.items.border = new Border(cache.tree, cache.time);
-    cache.items.scene->addItem(cache.items.border);
+    setupScene(cache);
 
     if (auto root = pt.root())
       addSpecies(nullptr, *root, cache);
 
     cache.items.border->setEmpty(!bool(pt.root()));
+  }
 
-    cache.items.tracker = new Tracker (cache.tree);
-    cache.items.scene->addItem(cache.items.tracker);
-
-    cache.items.contributors = new Contributors(cache.tree);
-    cache.items.scene->addItem(cache.items.contributors);
-
-    cache.items.dimmer = new Dimmer(cache.tree);
-    cache.items.scene->addItem(cache.items.dimmer);
-
-    cache.items.scene->setSceneRect(cache.items.border->boundingRect());
-
-    cache.items.initialized = true;
+  /// \returns copies of all the species of \p pt, parents before their
+  /// subspecies
+  /// \attention Reads \p pt: call it from the thread modifying the tree
+  template <typename GENOME, typename UDATA>
+  static std::vector<SpeciesSnapshot> snapshot (
+      const phylogeny::PhylogeneticTree<GENOME, UDATA> &pt) {
+    using PN = typename phylogeny::PhylogeneticTree<GENOME, UDATA>::Node;
+    std::vector<SpeciesSnapshot> species;
+    if (!pt.root()) return species;
+
+    std::vector<const PN*> stack { pt.root().get() };
+    while (!stack.empty()) {
+      const PN *n = stack.back();
+      stack.pop_back();
+      species.push_back(SpeciesSnapshot::from(*n));
+      for (const auto &c: n->children())  stack.push_back(c.get());
+    }
+    return species;
   }
 
+  /// \returns the \p species (as given by snapshot()) in the order in which a
+  /// progressive build inserts them: the top levels first, then the lineages
+  /// leading to species alive at \p time and, finally, the extinct ones.
+  /// Parents always come before their subspecies.
+  /// \note Only works on copies and can thus run on a worker thread
+  static std::vector<PendingSpecies> insertionOrder (
+      std::vector<SpeciesSnapshot> species, uint time);
+
   /// Append a new Node to the graph based on the data contained in \p n
   template <typename PN>
   static void addSpecies(Node *parent, const PN &n, Cache &cache) {
-    // Create node
-    Node *gn = new Node (cache.tree, parent, n);
+    Node *gn = createSpecies(parent, SpeciesSnapshot::from(n), cache);
 
     // Update related cache values
     if (parent)
           parent->subnodes.push_front(gn);
     else  cache.items.root = gn;
-    cache.items.nodes[gn->id] = gn;
-    cache.items.scene->addItem(gn);
-
-    // Generate path to parent if needed
-    if (parent) {
-      auto gp = new gui::Path(parent, gn);
-      gn->path = gp;
-      cache.items.scene->addItem(gp);
-      gp->setVisible(gn->subtreeVisible());
-    }
-
-    // Create timeline object
-    auto gt = new gui::Timeline(gn);
-    gn->timeline = gt;
-    cache.items.scene->addItem(gt);
-    gt->setVisible(gn->subtreeVisible());
 
     // Process subspecies
     for (const auto &n_: n.children())
       addSpecies(gn, *n_, cache);
 
-    // Manage visibility
-    gn->updateNode(gn->isStillAlive(cache.time));
-    gn->setVisible(Node::SHOW_NAME, cache.config.showNames);
-    gn->setVisible(Node::SURVIVORS, !cache.config.survivorsOnly || gn->onSurvivorPath());
-    gn->setVisible(Node::MIN_SURVIVAL, gn->survival() >= cache.config.minSurvival);
-    gn->setVisible(Node::MIN_FULLNESS, gn->fullness() >= cache.config.minEnveloppe);
-    gn->setVisible(Node::CLIP_RANGE, gn->appearance() <= cache.config.clippingRange);
-    gn->setVisible(Node::PARENT, parent ? parent->subtreeVisible() : true);
-
-    // Update rendering
-    gn->updateColor();
+    initSpecies(gn, false, cache);
   }
 
+  /// Append a new Node to the graph for species \p p whose parent (if any) is
+  /// already in the graph but whose subspecies are not
+  static void insertSpecies (const PendingSpecies &p, Cache &cache);
+
   /// Recompute all graphics items positions (nodes, paths, timelines)
   static void updateLayout (GUIItems &items);
 
+  /// Recompute the positions of the graphics items affected by a change in the
+  /// (visible) subnodes of the \p changed nodes.
+  ///
+  /// Each subtree owns a range of angular slots with some spare room (see
+  /// ViewerConfig::layoutSlack). Only the smallest enclosing subtree with
+  /// enough room is thus moved, and only the items whose position actually
+  /// changed are invalidated. Falls back to a full layout when the whole graph
+  /// is out of room (i.e. on every insertion without slack).
+  static void updateLayout (GUIItems &items, const QSet<Node*> &changed);
+
 private:
-  /// Recompute all graphics items position for the subtree rooted at \p localRoot
-  static void updateLayout (Node *localRoot, PolarCoordinates &pc);
+  /// Adds item \p i to the scene or, with batched rendering, gives it to the
+  /// batch drawers
+  static void addItem (QGraphicsItem *i, Cache &cache);
+
+  /// Creates the node, path and timeline of species \p s (without linking it
+  /// to its parent's subnodes)
+  static Node* createSpecies (Node *parent, const SpeciesSnapshot &s,
+                              Cache &cache);
+
+  /// Sets the state, visibility and color of the newly created node \p gn.
+  /// \p survivor tells whether it leads to a species still alive which is not
+  /// yet in the graph
+  static void initSpecies (Node *gn, bool survivor, Cache &cache);
+
+  /// \returns the number of slots needed by \p n and its visible subtrees
+  /// plus, depending on \p slack, some room for future subspecies
+  static uint capacity (const Node *n, float slack);
+
+  /// Recompute the slots reserved for the visible subtree rooted at \p n
+  static void updateCapacities (Node *n, float slack);
+
+  /// Place the visible subtree rooted at \p n in the range starting at slot
+  /// \p start. Unchanged subtrees are skipped unless \p force is set
+  static void updateLayout (Node *n, uint start, bool parentMoved, bool force,
+                            const PolarCoordinates &pc);
+
+  /// Place the whole visible graph rooted at \p root, in two phases. The
+  /// slots are assigned while flattening the graph, then the positions and
+  /// the shapes are computed on the thread pool. Only the final update of
+  /// the graphics items happens on the calling (GUI) thread
+  static void updateLayoutParallel (Node *root, const PolarCoordinates &pc);
 };
 
 /// \endcond
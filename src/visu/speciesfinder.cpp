@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QIntValidator>
+
+#include "speciesfinder.h"
+
+namespace gui {
+
+/// Computes the results of a query and hands them back to the GUI thread
+class SpeciesFinder::QueryJob : public QRunnable {
+public:
+  /// Creates a job searching (a snapshot of) \p entries for \p query
+  QueryJob (SpeciesFinder &finder, const QVector<Entry> &entries,
+            const Query &query, uint generation)
+    : _finder(finder), _entries(entries), _query(query),
+      _generation(generation) {}
+
+  /// Computes the results and queues their display
+  void run (void) override {
+    Results results = SpeciesFinder::run(_entries, _query, MAX_RESULTS);
+    results.generation = _generation;
+
+    QMetaObject::invokeMethod(&_finder, [&finder = _finder, results] {
+      finder.resultsReady(results);
+    }, Qt::QueuedConnection);
+  }
+
+private:
+  SpeciesFinder &_finder;       ///< The owner
+  const QVector<Entry> _entries;///< The searched species (shared copy)
+  const Query _query;           ///< The search parameters
+  const uint _generation;       ///< Identifier of the query
+};
+
+SpeciesFinder::SpeciesFinder (QWidget *parent)
+  : QWidget(parent), _size(0), _generation(0),
+    _running(false), _pending(false) {
+
+  _pool.setMaxThreadCount(1);
+
+  _sidEdit = new QLineEdit;
+  _sidEdit->setPlaceholderText("Species identificator");
+  _sidEdit->setValidator(new QIntValidator(0, std::numeric_limits<int>::max(),
+                                           _sidEdit));
+  connect(_sidEdit, &QLineEdit::returnPressed, this, &SpeciesFinder::lookup);
+
+  _keyBox = new QComboBox;
+  _keyBox->addItems({ "SID", "Lifespan", "Count", "Fullness", "Contributors" });
+  _keyBox->setCurrentIndex(Query{}.key);
+
+  _descending = new QCheckBox("Descending");
+  _descending->setChecked(Query{}.descending);
+
+  _aliveOnly = new QCheckBox("Alive only");
+  _aliveOnly->setChecked(Query{}.aliveOnly);
+
+  _minValue = new QDoubleSpinBox;
+  _minValue->setRange(0, std::numeric_limits<uint>::max());
+  _minValue->setDecimals(2);
+  _minValue->setPrefix("Min. ");
+  _minValue->setToolTip("Minimal value of the sorting key");
+
+  const auto changed = [this] { ++_generation; requery(); };
+  connect(_keyBox, QOverload<int>::of(&QComboBox::currentIndexChanged), changed);
+  connect(_descending, &QCheckBox::toggled, changed);
+  connect(_aliveOnly, &QCheckBox::toggled, changed);
+  connect(_minValue, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+          changed);
+
+  // One column per key
+  _table = new QTableWidget(0, _keyBox->count());
+  for (int i=0; i<_keyBox->count(); i++)
+    _table->setHorizontalHeaderItem(i, new QTableWidgetItem(_keyBox->itemText(i)));
+  _table->setToolTip("Alive species are shown in bold");
+  _table->verticalHeader()->hide();
+  _table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+  _table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  _table->setSelectionBehavior(QAbstractItemView::SelectRows);
+  _table->setSelectionMode(QAbstractItemView::SingleSelection);
+
+  const auto select = [this] (int row) {
+    emit speciesSelected(SID(_table->item(row, 0)->data(Qt::UserRole).toUInt()));
+  };
+  connect(_table, &QTableWidget::cellClicked, select);
+  connect(_table, &QTableWidget::cellActivated, select);
+
+  _status = new QLabel;
+
+  auto *lookupLayout = new QHBoxLayout;
+  lookupLayout->addWidget(new QLabel("Go to"));
+  lookupLayout->addWidget(_sidEdit, 1);
+
+  auto *sortLayout = new QHBoxLayout;
+  sortLayout->addWidget(new QLabel("Sort by"));
+  sortLayout->addWidget(_keyBox, 1);
+  sortLayout->addWidget(_descending);
+
+  auto *filterLayout = new QHBoxLayout;
+  filterLayout->addWidget(_aliveOnly);
+  filterLayout->addWidget(_minValue, 1);
+
+  auto *layout = new QVBoxLayout;
+  layout->addLayout(lookupLayout);
+  layout->addLayout(sortLayout);
+  layout->addLayout(filterLayout);
+  layout->addWidget(_table, 1);
+  layout->addWidget(_status);
+  setLayout(layout);
+
+  _refreshTimer = new QTimer(this);
+  _refreshTimer->setSingleShot(true);
+  _refreshTimer->setInterval(REFRESH_PERIOD);
+  connect(_refreshTimer, &QTimer::timeout, this, &SpeciesFinder::requery);
+}
+
+SpeciesFinder::~SpeciesFinder (void) {
+  _pool.waitForDone();
+}
+
+void SpeciesFinder::setEntry (const Entry &e) {
+  assert(e.sid != SID::INVALID);
+  int i = int(e.sid);
+  if (i >= _entries.size())
+    _entries.resize(std::max(i + 1, 2 * _entries.size()));
+
+  Entry &slot = _entries[i];
+  if (slot.sid == SID::INVALID) _size++;
+  slot = e;
+
+  contentsChanged();
+}
+
+void SpeciesFinder::remove (SID sid) {
+  if (!entry(sid))  return;
+  _entries[int(sid)] = Entry();
+  _size--;
+  contentsChanged();
+}
+
+void SpeciesFinder::clear (void) {
+  _entries.clear();
+  _size = 0;
+  ++_generation;
+  _table->setRowCount(0);
+  contentsChanged();
+}
+
+void SpeciesFinder::setStatus (const QString &message) {
+  _status->setText(message);
+}
+
+void SpeciesFinder::showEvent (QShowEvent *e) {
+  QWidget::showEvent(e);
+  requery();
+}
+
+SpeciesFinder::Query SpeciesFinder::currentQuery (void) const {
+  Query q;
+  q.key = Key(_keyBox->currentIndex());
+  q.descending = _descending->isChecked();
+  q.aliveOnly = _aliveOnly->isChecked();
+  q.min = _minValue->value();
+  return q;
+}
+
+SpeciesFinder::Results SpeciesFinder::run (const QVector<Entry> &entries,
+                                           const Query &query, uint limit) {
+  const auto value = [key = query.key] (const Entry &e) -> double {
+    switch (key) {
+    case BY_SID:          return uint(e.sid);
+    case BY_LIFESPAN:     return e.lifespan();
+    case BY_COUNT:        return e.count;
+    case BY_FULLNESS:     return e.fullness;
+    case BY_CONTRIBUTORS: return e.contributors;
+    }
+    return 0;
+  };
+
+  std::vector<const Entry*> matches;
+  for (const Entry &e: entries) {
+    if (e.sid == SID::INVALID)  continue;
+    if (query.aliveOnly && !e.alive)  continue;
+    if (value(e) < query.min) continue;
+    matches.push_back(&e);
+  }
+
+  // Ties are listed by increasing identificator
+  const auto order = [value, d = query.descending] (const Entry *lhs,
+                                                    const Entry *rhs) {
+    double lv = value(*lhs), rv = value(*rhs);
+    if (lv != rv) return d ? lv > rv : lv < rv;
+    return lhs->sid < rhs->sid;
+  };
+
+  auto end = matches.begin() + std::min(size_t(limit), matches.size());
+  std::partial_sort(matches.begin(), end, matches.end(), order);
+
+  Results results { 0, uint(matches.size()), {} };
+  results.entries.reserve(end - matches.begin());
+  for (auto it = matches.begin(); it != end; ++it)
+    results.entries.append(**it);
+  return results;
+}
+
+void SpeciesFinder::contentsChanged (void) {
+  if (isVisible() && !_refreshTimer->isActive())  _refreshTimer->start();
+}
+
+void SpeciesFinder::requery (void) {
+  if (!isVisible()) return;
+  if (_running) {
+    _pending = true;
+    return;
+  }
+
+  _running = true;
+  _pool.start(new QueryJob(*this, _entries, currentQuery(), _generation));
+}
+
+void SpeciesFinder::resultsReady (const Results &results) {
+  _running = false;
+
+  if (results.generation == _generation) {
+    // Keep the selected species selected if it is still listed
+    QTableWidgetItem *current = _table->item(_table->currentRow(), 0);
+    uint selected = current ? current->data(Qt::UserRole).toUInt()
+                            : uint(SID::INVALID);
+
+    QSignalBlocker blocker (_table);
+    _table->clearSelection();
+    _table->setRowCount(results.entries.size());
+    for (int r=0; r<results.entries.size(); r++) {
+      const Entry &e = results.entries[r];
+      const QVariant values [] {
+        uint(e.sid), e.lifespan(), e.count,
+        QString::number(e.fullness, 'f', 2), e.contributors
+      };
+
+      QFont font = _table->font();
+      font.setBold(e.alive);
+      for (int c=0; c<_table->columnCount(); c++) {
+        auto *item = new QTableWidgetItem;
+        item->setData(Qt::DisplayRole, values[c]);
+        item->setData(Qt::UserRole, uint(e.sid));
+        item->setFont(font);
+        _table->setItem(r, c, item);
+      }
+
+      if (uint(e.sid) == selected)  _table->selectRow(r);
+    }
+
+    QString status = QString("%1 match(es) out of %2 species")
+                      .arg(results.matches).arg(_size);
+    if (results.matches > uint(results.entries.size()))
+      status += QString(" (first %1 shown)").arg(results.entries.size());
+    setStatus(status);
+  }
+
+  if (_pending) {
+    _pending = false;
+    requery();
+  }
+}
+
+void SpeciesFinder::lookup (void) {
+  SID sid = SID(_sidEdit->text().toUInt());
+  if (entry(sid))
+    emit speciesSelected(sid);
+  else
+    setStatus(QString("Unknown species %1").arg(uint(sid)));
+}
+
+} // end of namespace gui
@@ -0,0 +1,173 @@
+#ifndef KGD_SPECIESFINDER_H
+#define KGD_SPECIESFINDER_H
+
+/*!
+ * \file speciesfinder.h
+ *
+ * Contains the definition of the species search panel
+ */
+
+#include <QWidget>
+#include <QVector>
+#include <QThreadPool>
+#include <QTimer>
+#include <QLineEdit>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QDoubleSpinBox>
+#include <QTableWidget>
+#include <QLabel>
+
+#include "../core/tree/treetypes.h"
+
+namespace gui {
+
+/// Search panel over the species of a viewer.
+///
+/// Species are indexed by identificator in a dense array that the viewer
+/// updates incrementally (see setEntry()): looking a species up is immediate.
+/// Sorted and filtered queries are computed on a worker thread, over an
+/// (implicitly shared) snapshot of that array, and only the best matches are
+/// listed.
+/// Selecting a result emits speciesSelected()
+class SpeciesFinder : public QWidget {
+  Q_OBJECT
+public:
+  /// Helper alias to the species identificator used in the phylogenic tree
+  using SID = phylogeny::SID;
+
+  /// Searchable values of a species
+  struct Entry {
+    SID sid = SID::INVALID;   ///< Identificator (invalid for unused slots)
+    uint appearance = 0;      ///< Timestep of the first appearance
+    uint disappearance = 0;   ///< Timestep of the last appearance
+    uint count = 0;           ///< Number of individuals observed
+    uint contributors = 0;    ///< Number of contributing species
+    float fullness = 0;       ///< Ratio of the enveloppe filled
+    bool alive = false;       ///< Whether the species is (displayed as) alive
+
+    /// \returns the number of timesteps the species has lived for
+    uint lifespan (void) const {
+      return disappearance - appearance;
+    }
+  };
+
+  /// Value on which results are sorted (and filtered)
+  enum Key {
+    BY_SID, BY_LIFESPAN, BY_COUNT, BY_FULLNESS, BY_CONTRIBUTORS
+  };
+
+  /// Parameters of a query
+  struct Query {
+    Key key = BY_COUNT;     ///< Sorting value
+    bool descending = true; ///< Whether the largest values come first
+    bool aliveOnly = false; ///< Whether to only list alive species
+    double min = 0;         ///< Minimal value of the sorting key
+  };
+
+  /// Results of a query
+  struct Results {
+    uint generation;        ///< Query counter (see _generation)
+    uint matches;           ///< Total number of matching species
+    QVector<Entry> entries; ///< The best matches, in order
+  };
+
+  /// Creates an empty finder
+  SpeciesFinder (QWidget *parent = nullptr);
+
+  /// Waits for the query under way (if any)
+  ~SpeciesFinder (void);
+
+  /// Stores (or replaces) the values of species \p e.sid
+  void setEntry (const Entry &e);
+
+  /// \returns the values of species \p sid or nullptr if it is unknown
+  const Entry* entry (SID sid) const {
+    uint i = uint(sid);
+    if (sid == SID::INVALID || int(i) >= _entries.size()) return nullptr;
+    const Entry &e = _entries.at(i);
+    return (e.sid == sid) ? &e : nullptr;
+  }
+
+  /// Forgets species \p sid
+  void remove (SID sid);
+
+  /// Forgets every species
+  void clear (void);
+
+  /// Displays \p message below the results
+  void setStatus (const QString &message);
+
+  /// \returns the (at most \p limit) species of \p entries matching \p query,
+  /// in order
+  static Results run (const QVector<Entry> &entries, const Query &query,
+                      uint limit);
+
+signals:
+  /// Emitted when species \p sid is picked either by identificator or from
+  /// the results
+  void speciesSelected (SID sid);
+
+protected:
+  /// Refreshes the results (they are not computed while hidden)
+  void showEvent (QShowEvent *e) override;
+
+private:
+  /// Maximal number of listed results
+  static constexpr uint MAX_RESULTS = 200;
+
+  /// Minimal delay (in ms) between two refreshes caused by the tree growing
+  static constexpr int REFRESH_PERIOD = 250;
+
+  /// Task computing the results of a query
+  class QueryJob;
+
+  /// Species values, indexed by identificator
+  QVector<Entry> _entries;
+
+  /// Number of species stored
+  uint _size;
+
+  /// Identifies the latest query. Results of previous ones are discarded
+  uint _generation;
+
+  /// Whether a query is being computed
+  bool _running;
+
+  /// Whether another query was requested in the meantime
+  bool _pending;
+
+  /// Worker thread computing the queries
+  QThreadPool _pool;
+
+  /// Delays the refreshes caused by the tree growing
+  QTimer *_refreshTimer;
+
+  QLineEdit *_sidEdit;          ///< Direct lookup by identificator
+  QComboBox *_keyBox;           ///< Sorting key
+  QCheckBox *_descending;       ///< Sorting order
+  QCheckBox *_aliveOnly;        ///< Whether to only list alive species
+  QDoubleSpinBox *_minValue;    ///< Minimal value of the sorting key
+  QTableWidget *_table;         ///< Results
+  QLabel *_status;              ///< Number of matches or lookup errors
+
+  /// \returns the query described by the controls
+  Query currentQuery (void) const;
+
+  /// Schedules a refresh of the results (at most every REFRESH_PERIOD ms)
+  void contentsChanged (void);
+
+  /// Starts computing the results of the current query (or delays it until
+  /// the one under way is done)
+  void requery (void);
+
+  /// Receives, on the GUI thread, the results of a query
+  void resultsReady (const Results &results);
+
+  /// Emits the selection of the identificator entered by the user
+  void lookup (void);
+};
+
+} // end of namespace gui
+
+#endif // KGD_SPECIESFINDER_H
@@ -127,7 +127,7 @@ void TightTableView::verticalFit (void) {
 auto Dialog::validSIDs (const PhylogenyViewer_base *viewer) const {
   std::set<SID> visible;
   viewer->observeNodes([&visible] (const Node *n) {
-    if (n->isVisible()) visible.insert(n->id);
+    if (n->subtreeVisible()) visible.insert(n->id);
   });
   return visible;
 }
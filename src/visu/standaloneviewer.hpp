@@ -1,5 +1,8 @@
+#include <future>
+
 #include <QApplication>
 #include <QMainWindow>
+#include <QProgressDialog>
 
 #include "kgd/external/cxxopts.hpp"
 #include "kgd/external/json.hpp"
@@ -7,7 +10,11 @@
 
 #include "kgd/settings/configfile.h"
 
+#include "../core/tree/playbacktree.hpp"
+
 #include "phylogenyviewer.h"
+#include "comparisonviewer.hpp"
+#include "playbackcontrols.h"
 #include "speciestracking.h"
 
 
@@ -22,10 +29,12 @@ int run(int argc, char *argv[]) {
   using Verbosity = config::Verbosity;
 
   auto config = PViewer::defaultConfig();
+  config.layoutSlack = 0; // Static trees: no need for spare room
 
-  std::string configFile, ptreeFile;
+  std::string configFile, ptreeFile, journalFile;
   Verbosity verbosity = Verbosity::SHOW;
   std::string outfile;
+  std::vector<std::string> compareFiles;
 
   static const auto dirFromStr = [] {
     using D = QBoxLayout::Direction;
@@ -50,6 +59,12 @@ int run(int argc, char *argv[]) {
      cxxopts::value(verbosity))
     ("t,tree", "File containing the phenotypic tree [MANDATORY]",
      cxxopts::value(ptreeFile))
+    ("j,journal", "File containing a recorded tree journal to play back",
+     cxxopts::value(journalFile))
+    ("compare", "Other trees to show side by side with the first one."
+                " Differences are only meaningful for trees sharing part of"
+                " their history",
+     cxxopts::value(compareFiles))
     ("min-survival", "Minimal survival duration",
      cxxopts::value(config.minSurvival))
     ("min-enveloppe", "Minimal fullness for the enveloppe",
@@ -68,16 +83,16 @@ int run(int argc, char *argv[]) {
      cxxopts::value(customColors))
     ;
 
-  auto result = options.parse(argc, argv);
   options.parse_positional("tree");
+  auto result = options.parse(argc, argv);
 
   if (result.count("help")) {
       std::cout << options.help() << std::endl;
       return 0;
   }
 
-  if (result.count("tree") != 1) {
-    std::cerr << "Missing mandatory argument 'tree'" << std::endl;
+  if (result.count("tree") + result.count("journal") != 1) {
+    std::cerr << "Missing mandatory argument 'tree' (or 'journal')" << std::endl;
     return 1;
   }
 
@@ -126,18 +141,115 @@ int run(int argc, char *argv[]) {
   QApplication a(argc, argv);
   setlocale(LC_NUMERIC,"C");
 
-  PTree pt = PTree::readFrom(ptreeFile);
-
   auto layoutDir = dirFromStr.value(QString::fromStdString(layoutStr));
-  PViewer pv (nullptr, pt, layoutDir, config);
 
-  if (outfile.empty()) {
-    pv.show();
-    pv.setMinimumSize(500, 500);
+  if (!journalFile.empty()) {
+    using Playback = phylogeny::PlaybackTree<GENOME, UDATA>;
+    Playback pt (journalFile);
+    if (!pt.good()) return 1;
+
+    // The tree grows during playback: keep room for the new species
+    config.layoutSlack = PViewer::defaultConfig().layoutSlack;
+
+    // Declared first so that it is destroyed last
+    QWidget window;
+    window.setWindowTitle("PTreeViewer - " + QString::fromStdString(journalFile));
+
+    PViewer pv (nullptr, pt, layoutDir, config);
+    gui::PlaybackControls controls (pt.firstStep(), pt.lastStep(),
+                                    [&pt] (uint step) {
+      pt.advanceTo(step);
+
+    }, [&pt, &pv] (uint step) {
+      phylogeny::Rewind changes;
+      if (pt.advanceIsCheaper(step))
+        pt.advanceTo(step);
+      else if (pt.rewind(step, changes))
+        pv.rewound(changes);
+      else {
+        pt.seek(step);
+        pv.rebuild();
+      }
+    });
+
+    auto *layout = new QVBoxLayout;
+    layout->addWidget(&pv, 1);
+    layout->addWidget(&controls);
+    window.setLayout(layout);
+
+    window.show();
+    window.setMinimumSize(500, 500);
+    return a.exec();
+  }
+
+  if (!compareFiles.empty()) {
+    using Comparison = gui::ComparisonViewer<GENOME, UDATA>;
+    compareFiles.insert(compareFiles.begin(), ptreeFile);
+
+    QProgressDialog progress ("Loading " + QString::number(compareFiles.size())
+                              + " trees", QString(), 0, 0);
+    progress.setWindowTitle("PTreeViewer");
+    progress.setMinimumDuration(0);
+    progress.show();
+
+    auto loading = std::async(std::launch::async, [&compareFiles] {
+      return Comparison::load(compareFiles);
+    });
+    while (loading.wait_for(std::chrono::milliseconds(40))
+           != std::future_status::ready)
+      a.processEvents(QEventLoop::AllEvents, 40);
+    auto trees = loading.get();
+    progress.close();
+
+    std::vector<typename Comparison::PTree*> ptrees;
+    QStringList names;
+    for (uint i=0; i<trees.size(); i++) {
+      ptrees.push_back(trees[i].get());
+      names << QString::fromStdString(compareFiles[i]);
+    }
+
+    config.progressiveBuild = true;
+    Comparison cv (ptrees, names, config);
+    cv.show();
+    cv.setMinimumSize(500 * std::min(trees.size(), size_t(3)), 500);
     return a.exec();
+  }
 
-  } else {
+  if (!outfile.empty()) {
+    PTree pt = PTree::readFrom(ptreeFile);
+    PViewer pv (nullptr, pt, layoutDir, config);
     pv.renderTo(QString::fromStdString(outfile));
     return 0;
   }
+
+  // Parse in the background while keeping the progress indicator alive
+  QProgressDialog progress ("Loading " + QString::fromStdString(ptreeFile),
+                            QString(), 0, 0);
+  progress.setWindowTitle("PTreeViewer");
+  progress.setMinimumDuration(0);
+  progress.show();
+
+  auto parsing = std::async(std::launch::async, [&ptreeFile] {
+    return std::unique_ptr<PTree>(new PTree(PTree::readFrom(ptreeFile)));
+  });
+  while (parsing.wait_for(std::chrono::milliseconds(40))
+         != std::future_status::ready)
+    a.processEvents(QEventLoop::AllEvents, 40);
+  std::unique_ptr<PTree> pt = parsing.get();
+
+  // The graph is then built by chunks, the viewer being usable meanwhile
+  config.progressiveBuild = true;
+  PViewer pv (nullptr, *pt, layoutDir, config);
+  progress.setLabelText("Building graph");
+  QObject::connect(&pv, &PViewer::onBuildProgress,
+                   [&progress] (uint inserted, uint total) {
+    progress.setMaximum(total);
+    progress.setValue(inserted);
+  });
+  QObject::connect(&pv, &PViewer::onBuildFinished,
+                   &progress, &QProgressDialog::close);
+
+  pv.show();
+  pv.setMinimumSize(500, 500);
+  return a.exec();
 }
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <QPainter>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QFile>
+#include <QDir>
+
+#include "tiledrenderer.h"
+#include "graphicutils.h"
+#include "../render/pngwriter.h"
+
+namespace gui {
+
+/// Rasterizes the recorded commands of a single tile
+class TiledRenderer::Job : public QRunnable {
+public:
+  /// Creates a job rendering \p picture into a \p size image
+  Job (TiledRenderer &renderer, QPicture &&picture, QSize size,
+       Callback callback)
+    : _renderer(renderer), _picture(std::move(picture)), _size(size),
+      _callback(callback) {}
+
+  /// Plays the drawing commands back and hands the image to the callback
+  void run (void) override {
+    QImage image (_size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    QPainter painter (&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.drawPicture(0, 0, _picture);
+    painter.end();
+
+    _callback(std::move(image));
+    _renderer._slots.release();
+  }
+
+private:
+  TiledRenderer &_renderer; ///< The owner
+  QPicture _picture;        ///< The recorded tile
+  const QSize _size;        ///< The tile size
+  Callback _callback;       ///< What to do with the tile
+};
+
+TiledRenderer::TiledRenderer (QGraphicsScene *scene, const QRectF &source,
+                              QSize size)
+  : _scene(scene), _source(source), _size(size),
+    _slots(2 * std::max(1, QThread::idealThreadCount())), _failed(false) {}
+
+void TiledRenderer::submit (const QRect &tile, const QSize &size,
+                            Callback callback) {
+  // Where the source lies in an output of that size
+  QRectF target = centeredInto(QRectF({0,0}, size), _source);
+  double s = target.width() / _source.width();
+  QRectF sceneTile (_source.x() + (tile.x() - target.x()) / s,
+                    _source.y() + (tile.y() - target.y()) / s,
+                    tile.width() / s, tile.height() / s);
+
+  _slots.acquire();
+
+  QPicture picture;
+  QPainter painter (&picture);
+  painter.setRenderHint(QPainter::Antialiasing);
+  _scene->render(&painter, QRectF({0,0}, tile.size()), sceneTile,
+                 Qt::IgnoreAspectRatio);
+  painter.end();
+
+  _pool.start(new Job(*this, std::move(picture), tile.size(), callback));
+}
+
+bool TiledRenderer::renderPNG (const QString &filename) {
+  const int W = _size.width(), H = _size.height();
+  render::PNGWriter writer (filename.toStdString(), W, H, true);
+  if (!writer.good()) return false;
+
+  // Output is produced band by band, whose height shrinks as the width grows
+  // so that a band never exceeds BAND_PIXELS (tiles keep a constant area)
+  const int rows = std::clamp(BAND_PIXELS / std::max(1, W), 1, TILE_SIZE);
+  const int tileWidth = TILE_SIZE * TILE_SIZE / rows;
+  const int columns = (W + tileWidth - 1) / tileWidth;
+  std::vector<QImage> band (columns);
+  std::vector<uint8_t> rgba;
+  for (int y=0; y<H; y+=rows) {
+    int h = std::min(rows, H - y);
+    for (int c=0; c<columns; c++) {
+      QRect tile (c * tileWidth, y, std::min(tileWidth, W - c * tileWidth), h);
+      submit(tile, _size, [&band, c] (QImage &&i) { band[c] = std::move(i); });
+    }
+    _pool.waitForDone();
+
+    rgba.resize(4 * size_t(W) * h);
+    for (int j=0; j<h; j++) {
+      uint8_t *out = &rgba[4 * size_t(W) * j];
+      for (const QImage &i: band) {
+        const QRgb *in = reinterpret_cast<const QRgb*>(i.constScanLine(j));
+        for (int k=0; k<i.width(); k++) {
+          QRgb p = qUnpremultiply(in[k]);
+          *out++ = qRed(p), *out++ = qGreen(p), *out++ = qBlue(p);
+          *out++ = qAlpha(p);
+        }
+      }
+    }
+    writer.writeRows(rgba.data(), h);
+  }
+
+  return writer.close();
+}
+
+bool TiledRenderer::renderDZI (const QString &filename) {
+  const int W = _size.width(), H = _size.height();
+  const int T = DZI_TILE_SIZE, O = DZI_OVERLAP;
+
+  QFileInfo info (filename);
+  QString folder = info.path() + "/" + info.completeBaseName() + "_files";
+
+  // Each level is rendered from the vector data at its own resolution
+  int maxLevel = std::ceil(std::log2(std::max(W, H)));
+  for (int level = maxLevel; level >= 0; level--) {
+    double f = std::pow(2, maxLevel - level);
+    QSize size (std::ceil(W / f), std::ceil(H / f));
+
+    QString dir = folder + "/" + QString::number(level);
+    if (!QDir().mkpath(dir)) {
+      std::cerr << "Failed to create " << dir.toStdString() << std::endl;
+      return false;
+    }
+
+    for (int r=0; r*T<size.height(); r++) {
+      for (int c=0; c*T<size.width(); c++) {
+        QPoint p0 (c * T - (c > 0 ? O : 0), r * T - (r > 0 ? O : 0));
+        QPoint p1 (std::min(size.width(), (c+1) * T + O),
+                   std::min(size.height(), (r+1) * T + O));
+        QString path = QString("%1/%2_%3.png").arg(dir).arg(c).arg(r);
+        submit(QRect(p0, p1 - QPoint(1, 1)), size, [this, path] (QImage &&i) {
+          if (i.save(path)) return;
+          std::cerr << "Failed to save " << path.toStdString() << std::endl;
+          _failed = true;
+        });
+      }
+    }
+  }
+  _pool.waitForDone();
+
+  QFile file (filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    std::cerr << "Failed to open " << filename.toStdString()
+              << " for writing" << std::endl;
+    return false;
+  }
+
+  QTextStream out (&file);
+  out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\""
+      << " Format=\"png\" Overlap=\"" << O << "\" TileSize=\"" << T << "\">\n"
+      << "  <Size Width=\"" << W << "\" Height=\"" << H << "\"/>\n"
+      << "</Image>\n";
+
+  return !_failed;
+}
+
+} // end of namespace gui
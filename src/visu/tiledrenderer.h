@@ -0,0 +1,98 @@
+#ifndef KGD_TILED_RENDERER_H
+#define KGD_TILED_RENDERER_H
+
+#include <atomic>
+#include <functional>
+
+#include <QGraphicsScene>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QPicture>
+#include <QImage>
+
+/*!
+ * \file tiledrenderer.h
+ *
+ * Definition of the parallel, memory-bounded, renderer for very large images
+ */
+
+namespace gui {
+
+/// Renders a scene into images of arbitrary size by splitting them into tiles.
+///
+/// The GUI thread records, for each tile, the drawing commands of the items it
+/// intersects (into a QPicture, through the scene's spatial index) while a
+/// pool of worker threads rasterizes them concurrently. The number of tiles in
+/// flight is bounded and png outputs are streamed by bands of bounded size so
+/// that memory usage does not depend on the output size (beyond a single row
+/// of pixels).
+///
+/// As with the single image path, the background is transparent.
+///
+/// \note The scene must not be modified while rendering
+class TiledRenderer {
+public:
+  /// Side of the tiles used for plain images
+  static constexpr int TILE_SIZE = 512;
+
+  /// Side of the deep zoom tiles (without overlap)
+  static constexpr int DZI_TILE_SIZE = 254;
+
+  /// Overlap between neighboring deep zoom tiles
+  static constexpr int DZI_OVERLAP = 1;
+
+  /// Images with a side larger than that should be rendered through this
+  /// class rather than into a single pixmap
+  static constexpr int MAX_SINGLE_IMAGE = 8192;
+
+  /// Maximal number of pixels in a band of a png output (the band being at
+  /// least one row high)
+  static constexpr int BAND_PIXELS = 1 << 22;
+
+  /// Prepares the rendering of the \p source part of \p scene into an image
+  /// of \p size pixels (aspect ratio is preserved)
+  TiledRenderer (QGraphicsScene *scene, const QRectF &source, QSize size);
+
+  /// Renders into the (streamed) png file \p filename
+  /// \returns whether writing succeeded
+  bool renderPNG (const QString &filename);
+
+  /// Renders into a deep zoom image: a pyramid of tiles, one level per power
+  /// of two, in the \p filename (without extension) + "_files" folder
+  /// described by the xml file \p filename
+  /// \returns whether writing succeeded
+  bool renderDZI (const QString &filename);
+
+private:
+  /// Helper alias for the callback receiving a rasterized tile
+  using Callback = std::function<void(QImage&&)>;
+
+  /// Task for a single tile
+  class Job;
+
+  /// The scene to render
+  QGraphicsScene *_scene;
+
+  /// The rendered part of the scene
+  const QRectF _source;
+
+  /// The full-resolution output size
+  const QSize _size;
+
+  /// The worker threads
+  QThreadPool _pool;
+
+  /// Free places for tiles in flight
+  QSemaphore _slots;
+
+  /// Whether a worker failed to save a tile
+  std::atomic<bool> _failed;
+
+  /// Records the \p tile of an output of size \p size and queues its
+  /// rasterization. Blocks while too many tiles are in flight
+  void submit (const QRect &tile, const QSize &size, Callback callback);
+};
+
+} // end of namespace gui
+
+#endif // KGD_TILED_RENDERER_H